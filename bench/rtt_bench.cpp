@@ -0,0 +1,276 @@
+// Round-trip latency benchmark for EmcEspNow
+//
+// Flash one board with a bench_*_initiator environment and the other with a
+// bench_*_echo environment (see platformio.ini). The echo board returns every
+// FRAME_USER frame it receives to the initiator; the initiator timestamps its
+// probes with esp_timer_get_time() and prints one CSV line per channel,
+// transmission mode and payload size on the serial monitor.
+//
+// Transmission modes (initiator side, the echo board always uses the default retries):
+//   pingpong         - one probe at a time, EmcEspNow resends failed frames
+//   pingpong-noretry - one probe at a time, no resends: raw link loss
+//   stream           - next probe as soon as the previous send completed, no resends: frames per second
+
+#include "EmcEspNow.h"
+#include "EmcLog.h"
+#include "EmcRingBuffer.h"
+#include <algorithm>
+
+#ifndef BENCH_PROBES
+#define BENCH_PROBES 500 // Probes per ping-pong run
+#endif
+
+#ifndef BENCH_STREAM_MS
+#define BENCH_STREAM_MS 2000 // Duration of a stream run
+#endif
+
+#ifndef BENCH_TIMEOUT_US
+#define BENCH_TIMEOUT_US 20000 // A probe without echo after this time is lost
+#endif
+
+#ifndef BENCH_MAX_SAMPLES
+#define BENCH_MAX_SAMPLES 8192 // Round-trip times kept per run for the percentiles
+#endif
+
+// Instance of the ESP-NOW communication handler, master on the initiator, slave on the echo board
+EmcEspNow espNow;
+
+// Frame sent by the initiator and returned unchanged, padded to the payload size of the run
+typedef struct
+{
+  uint32_t id;         // Probe number, unique over all runs
+  uint32_t sentMicros; // esp_timer_get_time() of the initiator when sent
+} __attribute__((packed)) bench_probe_t;
+
+#ifdef BENCH_INITIATOR
+
+enum BenchMode : uint8_t
+{
+  MODE_PINGPONG,
+  MODE_PINGPONG_NORETRY,
+  MODE_STREAM
+};
+const char *modeNames[] = {"pingpong", "pingpong-noretry", "stream"};
+
+// Channels, modes and payload sizes of the sweep, from the 12-byte master_cmd_t to the largest payload
+const uint8_t benchChannels[] = {1, 6, 11};
+const BenchMode benchModes[] = {MODE_PINGPONG, MODE_PINGPONG_NORETRY, MODE_STREAM};
+const uint8_t benchSizes[] = {sizeof(master_cmd_t), 32, 64, 128, ESPNOW_MAX_PAYLOAD_LEN};
+
+// Echo arrival, measured in the receive callback so loop() delays do not count
+typedef struct
+{
+  uint32_t id;  // Probe number
+  uint32_t rtt; // Round-trip time in microseconds
+} bench_echo_t;
+
+EmcRingBuffer<bench_echo_t, 256> echoes;
+
+uint32_t rtts[BENCH_MAX_SAMPLES]; // Round-trip times of the current run
+uint32_t rttCount = 0;            // Echoes received in the current run
+uint32_t runFirstId = 0;          // First probe number of the current run
+uint32_t nextId = 1;              // Next probe number
+uint32_t lastEchoId = 0;          // Probe number of the latest echo
+
+// Runs the link bookkeeping and collects the echoes of the current run
+void pump()
+{
+  espNow.update();
+
+  bench_echo_t echo;
+  while (echoes.pop(echo))
+  {
+    if (echo.id < runFirstId || echo.id >= nextId)
+      continue; // Late echo of an earlier run
+    lastEchoId = echo.id;
+    if (rttCount < BENCH_MAX_SAMPLES)
+      rtts[rttCount++] = echo.rtt;
+  }
+}
+
+// Sends one probe of the given payload size to the echo board
+void sendProbe(uint8_t len)
+{
+  static uint8_t payload[ESPNOW_MAX_PAYLOAD_LEN] = {0};
+  bench_probe_t probe = {nextId++, (uint32_t)esp_timer_get_time()};
+  memcpy(payload, &probe, sizeof(probe));
+  espNow.sendUnicast(espNow.peers.get(1)->peer_mac, FRAME_USER, payload, len);
+}
+
+// Waits for the echo board to be connected
+bool waitForLink(uint32_t timeoutMs)
+{
+  unsigned long start = millis();
+  while (espNow.getLinkState(1) != LINK_CONNECTED)
+  {
+    if (millis() - start >= timeoutMs)
+      return false;
+    pump();
+  }
+  return true;
+}
+
+// Sends completed so far, acknowledged or not
+uint32_t sendsDone()
+{
+  const peer_stats_t *stats = espNow.getPeerStats(1);
+  return stats ? stats->txOk + stats->txFail : 0;
+}
+
+// Runs one benchmark and prints its CSV line
+void runBenchmark(BenchMode mode, uint8_t len)
+{
+  // Probes are never given up because of failures, the benchmark measures the link, not the eviction
+  uint8_t retries = mode == MODE_PINGPONG ? ESPNOW_MAX_RETRIES : 0;
+  espNow.setRetryPolicy(retries, ESPNOW_RETRY_BACKOFF_US, 0xFFFF, 60000);
+
+  rttCount = 0;
+  runFirstId = nextId;
+  uint32_t sent = 0;
+  int64_t start = esp_timer_get_time();
+
+  if (mode == MODE_STREAM)
+  {
+    uint32_t doneBase = sendsDone();
+    while (esp_timer_get_time() - start < BENCH_STREAM_MS * 1000LL && espNow.peers.get(1))
+    {
+      // One frame in flight: send the next one once the driver reported the previous one
+      if (sendsDone() - doneBase >= sent)
+      {
+        sendProbe(len);
+        sent++;
+      }
+      pump();
+    }
+  }
+  else
+  {
+    for (uint32_t i = 0; i < BENCH_PROBES && espNow.peers.get(1); i++)
+    {
+      sendProbe(len);
+      sent++;
+      uint32_t id = nextId - 1;
+      int64_t sentAt = esp_timer_get_time();
+      while (lastEchoId != id && esp_timer_get_time() - sentAt < BENCH_TIMEOUT_US)
+        pump();
+    }
+  }
+  int64_t elapsed = esp_timer_get_time() - start;
+
+  // Late echoes still count for the loss, not for the frame rate
+  int64_t drainStart = esp_timer_get_time();
+  while (esp_timer_get_time() - drainStart < BENCH_TIMEOUT_US)
+    pump();
+
+  std::sort(rtts, rtts + rttCount);
+  uint32_t p50 = rttCount ? rtts[(rttCount - 1) / 2] : 0;
+  uint32_t p99 = rttCount ? rtts[(rttCount * 99 + 99) / 100 - 1] : 0;
+  uint32_t max = rttCount ? rtts[rttCount - 1] : 0;
+  float loss = sent ? 100.0f * (sent - rttCount) / sent : 100.0f;
+  float fps = elapsed > 0 ? rttCount * 1000000.0f / elapsed : 0;
+
+  Serial.printf("%u,%s,%u,%u,%u,%.2f,%u,%u,%u,%.0f\n", espNow.getChannel(), modeNames[mode], len,
+                (unsigned)sent, (unsigned)rttCount, loss, (unsigned)p50, (unsigned)p99, (unsigned)max, fps);
+}
+
+void setup()
+{
+  Serial.begin(115200);
+  EmcLog::begin(); // ESP-NOW messages are printed by a low-priority task, outside the timed path
+
+  // Echoes are timestamped in the WiFi task, right when they arrive
+  espNow.onUserFrame([](uint8_t peerID, const uint8_t *data, size_t len)
+                     {
+                       uint32_t now = (uint32_t)esp_timer_get_time();
+                       if (len < sizeof(bench_probe_t))
+                         return;
+                       bench_probe_t probe;
+                       memcpy(&probe, data, sizeof(probe));
+                       bench_echo_t echo = {probe.id, now - probe.sentMicros};
+                       echoes.push(echo); });
+
+  espNow.setChannel(benchChannels[0]);
+  espNow.begin(true); // true = Master
+  espNow.setCommandRate(1000, ESPNOW_CMD_MAX_RATE); // Fewer keep-alives, the probes keep the link alive
+}
+
+void loop()
+{
+  Serial.println("Waiting for the echo board...");
+  if (!waitForLink(10000))
+    return;
+
+  Serial.println("channel,mode,payload,sent,received,loss_pct,p50_us,p99_us,max_us,fps");
+  for (uint8_t channel : benchChannels)
+  {
+    // The echo board follows the announced switch
+    espNow.setChannel(channel);
+    while (espNow.getChannel() != channel)
+      pump();
+    delay(200);
+    if (!waitForLink(5000))
+    {
+      Serial.printf("Echo board lost on channel %u\n", channel);
+      continue;
+    }
+
+    for (BenchMode mode : benchModes)
+    {
+      for (uint8_t len : benchSizes)
+      {
+        if (!espNow.peers.get(1))
+          waitForLink(5000);
+        runBenchmark(mode, len);
+      }
+    }
+  }
+  Serial.println("Benchmark done");
+
+  // Back to the first channel for the next round
+  espNow.setChannel(benchChannels[0]);
+  while (espNow.getChannel() != benchChannels[0])
+    pump();
+  delay(5000);
+}
+
+#else // Echo board
+
+// Frame waiting to be returned
+typedef struct
+{
+  uint8_t len;
+  uint8_t data[ESPNOW_MAX_PAYLOAD_LEN];
+} bench_frame_t;
+
+EmcRingBuffer<bench_frame_t, 16> pending;
+
+void setup()
+{
+  Serial.begin(115200);
+  EmcLog::begin(); // ESP-NOW messages are printed by a low-priority task, outside the timed path
+
+  // Frames are returned from loop(), which also owns every other send
+  espNow.onUserFrame([](uint8_t peerID, const uint8_t *data, size_t len)
+                     {
+                       bench_frame_t frame;
+                       frame.len = len;
+                       memcpy(frame.data, data, len);
+                       pending.push(frame); });
+
+  espNow.setAutoChannel(true); // Search all channels, in case a channel announcement was missed
+  espNow.begin(false);         // false = Slave
+}
+
+void loop()
+{
+  bench_frame_t frame;
+  while (pending.pop(frame))
+  {
+    const peers_t *master = espNow.peers.get(1);
+    if (master)
+      espNow.sendUnicast(master->peer_mac, FRAME_USER, frame.data, frame.len);
+  }
+  espNow.update();
+}
+
+#endif
@@ -0,0 +1,230 @@
+// USB HID bridge for the master role of EmcEspNow
+//
+// Runs on a board with native USB (the ESP32-S2 of the hid_bridge_s2
+// environment, see platformio.ini) and shows up on the PC as one gamepad with
+// 128 buttons and HID_BRIDGE_AXES analog axes. The bridge is the ESP-NOW
+// master of the button boxes running main.cpp; their frames are merged like
+// EmcEspNow::tryGetLatest() does: the button bits of all slaves are OR'ed and
+// the axes come from the slave with the lowest peer ID.
+//
+// The report uses the layout of slave_data_t directly: button bit n is button
+// n + 1, and the axes are 12-bit fields packed LSB first, exactly what the
+// slaves' EmcAnalogInput::pack() writes, so a frame is copied, not converted.
+//
+// Latency: every changed frame wakes the HID task from the WiFi task, which
+// hands the report to the USB stack right away. The HID interrupt endpoint of
+// the core is polled with bInterval 1, i.e. every 1 ms at full speed, so a
+// change reaches the host within one poll. Frames that arrive while a report
+// is still waiting for its poll are coalesced into the next one.
+//
+// Taps: slaves in redundant edge mode report every press and release as an
+// edge. A press and release of the same button that arrive together while the
+// frames never showed the button pressed, because the tap fell between two
+// lost frames, are reported as pressed for one report before the current
+// state. A press without its release is not a tap: the button may still be
+// held while the merged state just has not caught up yet.
+
+#include "EmcAnalogInput.h"
+#include "EmcEspNow.h"
+#include "EmcLog.h"
+#include "EmcRingBuffer.h"
+#include "USB.h"
+#include "USBHID.h"
+
+#ifndef HID_BRIDGE_AXES
+#define HID_BRIDGE_AXES 8 // Axes in the report, X, Y, Z, Rx, Ry, Rz, slider and dial
+#endif
+
+#ifndef HID_BRIDGE_REPORT_ID
+#define HID_BRIDGE_REPORT_ID 1 // Report ID of the gamepad report
+#endif
+
+#ifndef HID_BRIDGE_IDLE_MS
+#define HID_BRIDGE_IDLE_MS 20 // Longest wait of the HID task, releases the buttons of a slave that was removed
+#endif
+
+#ifndef HID_BRIDGE_TASK_PRIORITY
+#define HID_BRIDGE_TASK_PRIORITY (ESPNOW_TASK_PRIORITY - 1) // Below the ESP-NOW task, above loop()
+#endif
+
+static_assert(HID_BRIDGE_AXES > 0 && HID_BRIDGE_AXES <= 8, "The report has usages for up to 8 axes");
+static_assert(HID_BRIDGE_AXES % 2 == 0, "Axes are reported in pairs, two axes fill three bytes");
+static_assert(HID_BRIDGE_AXES * EmcAnalogInput::AXIS_BITS / 8 <= sizeof(slave_data_t::data), "The axes must fit into slave_data_t::data");
+
+// Gamepad report: 128 buttons, then the 12-bit axes
+typedef struct
+{
+  uint8_t buttons[sizeof(slave_data_t::button_data)];
+  uint8_t axes[HID_BRIDGE_AXES * EmcAnalogInput::AXIS_BITS / 8];
+} __attribute__((packed)) hid_report_t;
+
+const uint8_t reportDescriptor[] = {
+    HID_USAGE_PAGE(HID_USAGE_PAGE_DESKTOP),
+    HID_USAGE(HID_USAGE_DESKTOP_GAMEPAD),
+    HID_COLLECTION(HID_COLLECTION_APPLICATION),
+    HID_REPORT_ID(HID_BRIDGE_REPORT_ID) // TinyUSB adds the comma itself
+
+    // One bit per button, in the order of slave_data_t::button_data
+    HID_USAGE_PAGE(HID_USAGE_PAGE_BUTTON),
+    HID_USAGE_MIN(1),
+    HID_USAGE_MAX(sizeof(slave_data_t::button_data) * 8),
+    HID_LOGICAL_MIN(0),
+    HID_LOGICAL_MAX(1),
+    HID_REPORT_COUNT(sizeof(slave_data_t::button_data) * 8),
+    HID_REPORT_SIZE(1),
+    HID_INPUT(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),
+
+    // The axes as packed by EmcAnalogInput, the usages from X on are consecutive
+    HID_USAGE_PAGE(HID_USAGE_PAGE_DESKTOP),
+    HID_USAGE_MIN(HID_USAGE_DESKTOP_X),
+    HID_USAGE_MAX(HID_USAGE_DESKTOP_X + HID_BRIDGE_AXES - 1),
+    HID_LOGICAL_MIN(0),
+    HID_LOGICAL_MAX_N(EmcAnalogInput::AXIS_MAX, 2),
+    HID_REPORT_COUNT(HID_BRIDGE_AXES),
+    HID_REPORT_SIZE(EmcAnalogInput::AXIS_BITS),
+    HID_INPUT(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),
+
+    HID_COLLECTION_END,
+};
+
+// The gamepad interface, the core asks it for its report descriptor during enumeration
+class HidBridgeDevice : public USBHIDDevice
+{
+public:
+  uint16_t _onGetDescriptor(uint8_t *buffer) override
+  {
+    memcpy(buffer, reportDescriptor, sizeof(reportDescriptor));
+    return sizeof(reportDescriptor);
+  }
+};
+
+// Instance of the ESP-NOW communication handler in master mode
+EmcEspNow espNow;
+
+USBHID hid;
+HidBridgeDevice gamepad;
+TaskHandle_t hidTask = nullptr;
+
+// Press and release edges of the slaves, pushed by the WiFi task and taken by the HID task
+EmcRingBuffer<edge_event_t, 64> edges;
+
+// Report last accepted by the USB stack, a new one is only sent when it differs
+hid_report_t lastReport = {};
+bool lastReportValid = false;
+
+// Reports sent and changed frames received, printed once a second by loop()
+volatile uint32_t reportsSent = 0;
+volatile uint32_t framesReceived = 0;
+
+// Builds the report from the merged slave data and sends it if it changed, with extra buttons pressed
+void sendReport(const slave_data_t &merged, const uint8_t *pressed = nullptr)
+{
+  hid_report_t report;
+  memcpy(report.buttons, merged.button_data, sizeof(report.buttons));
+  memcpy(report.axes, merged.data, sizeof(report.axes));
+  if (pressed)
+  {
+    for (uint8_t b = 0; b < sizeof(report.buttons); b++)
+      report.buttons[b] |= pressed[b];
+  }
+
+  if (lastReportValid && memcmp(&report, &lastReport, sizeof(report)) == 0)
+    return;
+
+  // Waits for the previous report to be polled, at most one interval when the host is there
+  if (hid.SendReport(HID_BRIDGE_REPORT_ID, &report, sizeof(report)))
+  {
+    lastReport = report;
+    lastReportValid = true;
+    reportsSent++;
+  }
+}
+
+// Sends a report whenever slave data changed, woken from the WiFi task
+void hidTaskMain(void *pvParameters)
+{
+  slave_data_t merged;
+  while (true)
+  {
+    // The timeout also catches removed slaves, whose slots are cleared without a frame
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(HID_BRIDGE_IDLE_MS));
+    bool changed = espNow.tryGetLatest(merged);
+
+    // A press and its release the merged state does not show were a tap between lost frames
+    uint8_t pressed[sizeof(merged.button_data)] = {0};
+    uint8_t taps[sizeof(merged.button_data)] = {0};
+    static_assert(sizeof(taps) * 8 >= ESPNOW_EDGE_BITS, "Every bit of an edge must fit into the tap masks");
+    bool tapped = false;
+    edge_event_t edge;
+    while (edges.pop(edge))
+    {
+      // The receiver drops edges beyond the buttons, the bit comes off the air so check it here as well
+      if (edge.bit >= sizeof(taps) * 8)
+        continue;
+
+      uint8_t mask = 1 << (edge.bit % 8);
+      if (edge.pressed)
+        pressed[edge.bit / 8] |= mask;
+      else if ((pressed[edge.bit / 8] & mask) && !(merged.button_data[edge.bit / 8] & mask))
+      {
+        taps[edge.bit / 8] |= mask;
+        tapped = true;
+      }
+    }
+    if (tapped)
+      sendReport(merged, taps);
+
+    if (changed || tapped || !lastReportValid)
+      sendReport(merged);
+  }
+}
+
+void setup()
+{
+  Serial.begin(115200);
+  EmcLog::begin(); // ESP-NOW messages are printed by a low-priority task, outside the report path
+
+  // The gamepad must be registered before the USB stack starts
+  hid.addDevice(&gamepad, sizeof(reportDescriptor));
+  hid.begin();
+  USB.productName("EMC HID bridge");
+  USB.begin();
+
+  xTaskCreate(hidTaskMain, "hidBridge", 4096, nullptr, HID_BRIDGE_TASK_PRIORITY, &hidTask);
+
+  // Every changed frame wakes the HID task right away, the data itself is read there
+  espNow.onSlaveData([](uint8_t peerID, const slave_data_t &data)
+                     {
+                       framesReceived++;
+                       xTaskNotifyGive(hidTask); });
+  espNow.onEdge([](uint8_t peerID, const edge_event_t &edge)
+                {
+                  if (edges.push(edge))
+                    xTaskNotifyGive(hidTask); });
+
+  // Initialize ESP-NOW in Master mode, the slaves follow to the quietest channel
+  espNow.setAutoChannel(true);
+  espNow.begin(true); // true = Master
+#ifdef HID_BRIDGE_SCHEDULED
+  espNow.setScheduled(true); // Bounded uplink latency with many slaves, see setScheduled()
+#endif
+
+  // Commands, retries and the schedule run in their own task, not in loop()
+  espNow.startTask();
+}
+
+void loop()
+{
+  static unsigned long lastPrint = 0;
+  if (millis() - lastPrint >= 1000)
+  {
+    lastPrint = millis();
+    uint8_t slaves = 0;
+    for (uint8_t i = 1; i < ESPNOW_MAX_PEERS; i++)
+      if (espNow.getLinkState(i) == LINK_CONNECTED)
+        slaves++;
+    Serial.printf("channel %u, slaves %u, frames %u, reports %u\n", espNow.getChannel(), slaves,
+                  (unsigned)framesReceived, (unsigned)reportsSent);
+  }
+  delay(10);
+}
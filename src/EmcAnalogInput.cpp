@@ -0,0 +1,218 @@
+/*
+ * EmcAnalogInput.cpp
+ *
+ *  Created on: 14.10.2026
+ *      Author: daenzell
+ */
+
+#include "EmcAnalogInput.h"
+#include "EmcGpioSampler.h"
+
+#if CONFIG_IDF_TARGET_ESP32
+#define ANALOG_OUTPUT_FORMAT ADC_DIGI_OUTPUT_FORMAT_TYPE1
+#define ANALOG_RESULT_CHANNEL(r) ((r)->type1.channel)
+#define ANALOG_RESULT_DATA(r) ((r)->type1.data)
+#define ANALOG_RESULT_BITS 12
+#else
+#define ANALOG_OUTPUT_FORMAT ADC_DIGI_OUTPUT_FORMAT_TYPE2
+#define ANALOG_RESULT_CHANNEL(r) ((r)->type2.channel)
+#define ANALOG_RESULT_DATA(r) ((r)->type2.data)
+#define ANALOG_RESULT_BITS 11 // The ESP32-S2 DMA format carries 11 bits
+#endif
+
+/**
+ * @brief Configures one ADC1 conversion per axis and starts the DMA.
+ *
+ * All axes use 12 dB attenuation for the full 0..3.3 V range. The
+ * calibration of every axis starts as the full raw range.
+ *
+ * @param[in] pins The ADC1 GPIOs of the axes.
+ * @param[in] count The number of axes.
+ * @param[in] sampleRateHz The conversions per second, shared by all axes.
+ * @return false if a pin is not an ADC1 pin, there are too many axes, or the driver failed.
+ */
+bool EmcAnalogInput::begin(const uint8_t *pins, uint8_t count, uint32_t sampleRateHz)
+{
+    this->count = 0;
+    if (handle || count == 0 || count > MAX_AXES)
+    {
+        return false;
+    }
+
+    adc_digi_pattern_config_t pattern[MAX_AXES];
+    memset(channelAxis, 0xFF, sizeof(channelAxis));
+    for (uint8_t i = 0; i < count; i++)
+    {
+        adc_unit_t unit;
+        adc_channel_t channel;
+        if (adc_continuous_io_to_channel(pins[i], &unit, &channel) != ESP_OK || unit != ADC_UNIT_1)
+        {
+            log_e("GPIO %d is not an ADC1 pin\n", pins[i]);
+            return false;
+        }
+        pattern[i].atten = ADC_ATTEN_DB_12;
+        pattern[i].channel = channel;
+        pattern[i].unit = ADC_UNIT_1;
+        pattern[i].bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+        channelAxis[channel & 0x0F] = i;
+
+        rawMin[i] = 0;
+        rawMax[i] = AXIS_MAX;
+        inverted[i] = false;
+        primed[i] = false;
+        filtered[i] = 0;
+        output[i] = 0;
+    }
+
+    adc_continuous_handle_cfg_t handleConfig;
+    memset(&handleConfig, 0, sizeof(handleConfig));
+    handleConfig.max_store_buf_size = ANALOG_FRAME_BYTES * 4;
+    handleConfig.conv_frame_size = ANALOG_FRAME_BYTES;
+    if (adc_continuous_new_handle(&handleConfig, &handle) != ESP_OK)
+    {
+        log_e("ADC continuous init failed\n");
+        handle = nullptr;
+        return false;
+    }
+
+    adc_continuous_config_t config;
+    memset(&config, 0, sizeof(config));
+    config.pattern_num = count;
+    config.adc_pattern = pattern;
+    config.sample_freq_hz = sampleRateHz;
+    config.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+    config.format = ANALOG_OUTPUT_FORMAT;
+    if (adc_continuous_config(handle, &config) != ESP_OK || adc_continuous_start(handle) != ESP_OK)
+    {
+        log_e("ADC continuous start failed\n");
+        adc_continuous_deinit(handle);
+        handle = nullptr;
+        return false;
+    }
+
+    this->count = count;
+    return true;
+}
+
+/**
+ * @brief Stops the conversions and releases the driver.
+ */
+void EmcAnalogInput::end()
+{
+    if (handle)
+    {
+        adc_continuous_stop(handle);
+        adc_continuous_deinit(handle);
+        handle = nullptr;
+    }
+    count = 0;
+}
+
+/**
+ * @brief Sets the raw range of an axis.
+ *
+ * Values outside the range are clamped, so end stops with some play still
+ * reach 0 and AXIS_MAX reliably.
+ *
+ * @param[in] axis The axis index.
+ * @param[in] rawMin The raw value that maps to 0.
+ * @param[in] rawMax The raw value that maps to AXIS_MAX, must be above @p rawMin.
+ * @param[in] invert true to swap the direction of the axis.
+ */
+void EmcAnalogInput::setCalibration(uint8_t axis, uint16_t rawMin, uint16_t rawMax, bool invert)
+{
+    if (axis >= MAX_AXES || rawMax <= rawMin)
+    {
+        return;
+    }
+    this->rawMin[axis] = rawMin;
+    this->rawMax[axis] = rawMax;
+    inverted[axis] = invert;
+}
+
+/**
+ * @brief Drains the DMA results and updates the axes.
+ *
+ * Reads with a zero timeout, so this returns right away when nothing new was
+ * converted. All samples of an axis are averaged, then fed into the IIR
+ * filter once per call; an axis output only moves when the calibrated value
+ * left the deadband around it.
+ *
+ * @return true if the output of any axis changed.
+ */
+bool EmcAnalogInput::poll()
+{
+    if (!handle)
+    {
+        return false;
+    }
+
+    uint32_t sum[MAX_AXES] = {0};
+    uint16_t samples[MAX_AXES] = {0};
+    uint32_t got = 0;
+    while (adc_continuous_read(handle, buffer, sizeof(buffer), &got, 0) == ESP_OK)
+    {
+        for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= got; i += SOC_ADC_DIGI_RESULT_BYTES)
+        {
+            const adc_digi_output_data_t *result = (const adc_digi_output_data_t *)&buffer[i];
+            uint8_t axis = channelAxis[ANALOG_RESULT_CHANNEL(result) & 0x0F];
+            if (axis >= count)
+                continue; // Invalid or unused channel
+            sum[axis] += ANALOG_RESULT_DATA(result) << (12 - ANALOG_RESULT_BITS);
+            samples[axis]++;
+        }
+    }
+
+    bool changed = false;
+    for (uint8_t a = 0; a < count; a++)
+    {
+        if (samples[a] == 0)
+            continue;
+
+        uint32_t average = (sum[a] << 4) / samples[a]; // 12.4 fixed point
+        if (!primed[a])
+        {
+            filtered[a] = average;
+            primed[a] = true;
+        }
+        else
+        {
+            filtered[a] += ((int32_t)average - (int32_t)filtered[a]) >> ANALOG_FILTER_SHIFT;
+        }
+
+        // Map the calibrated range to 0..AXIS_MAX
+        int32_t raw = filtered[a] >> 4;
+        int32_t span = rawMax[a] - rawMin[a];
+        int32_t value = ((raw - rawMin[a]) * AXIS_MAX + span / 2) / span;
+        value = value < 0 ? 0 : value > AXIS_MAX ? AXIS_MAX : value;
+        if (inverted[a])
+            value = AXIS_MAX - value;
+
+        // Also let the end stops through, so a full deflection is always reached
+        int32_t delta = value - output[a];
+        if (delta > deadband || delta < -(int32_t)deadband ||
+            (value != output[a] && (value == 0 || value == AXIS_MAX)))
+        {
+            output[a] = value;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+/**
+ * @brief Packs the axes back to back, 12 bits each, LSB first.
+ *
+ * Two axes take three bytes, so the 64 bytes of slave_data_t::data hold up
+ * to 42 axes.
+ *
+ * @param[out] data The destination buffer.
+ * @param[in] len The size of @p data in bytes.
+ */
+void EmcAnalogInput::pack(uint8_t *data, size_t len) const
+{
+    for (uint8_t a = 0; a < count && (a + 1) * AXIS_BITS <= len * 8; a++)
+    {
+        EmcGpioSampler::pack(data, a * AXIS_BITS, output[a], AXIS_BITS);
+    }
+}
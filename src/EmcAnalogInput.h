@@ -0,0 +1,123 @@
+/*
+ * EmcAnalogInput.h
+ *
+ *  Created on: 14.10.2026
+ *      Author: daenzell
+ */
+
+#pragma once
+
+/**
+ * @file EmcAnalogInput.h
+ * @brief Analog axes sampled by the continuous (DMA) ADC driver
+ *
+ * The ADC converts all axes round-robin in hardware and DMA stores the
+ * results, so no CPU time is spent per conversion. poll() drains what the
+ * DMA collected since the last call, averages all samples of each axis
+ * (oversampling), smooths them with an IIR filter and maps them through a
+ * per-axis calibration to 12 bits. A deadband keeps ADC noise from changing
+ * the output, so a resting axis does not cause frames. pack() writes the axes
+ * densely, 12 bits each, into slave_data_t::data.
+ *
+ * Only ADC1 pins can be used, ADC2 is shared with the WiFi radio.
+ */
+
+#include <Arduino.h>
+#include "esp_adc/adc_continuous.h"
+
+#ifndef ANALOG_SAMPLE_RATE_HZ
+#define ANALOG_SAMPLE_RATE_HZ 20000 ///< Default conversions per second over all axes
+#endif
+
+#ifndef ANALOG_FRAME_BYTES
+#define ANALOG_FRAME_BYTES 256 ///< DMA conversion frame size
+#endif
+
+#ifndef ANALOG_FILTER_SHIFT
+#define ANALOG_FILTER_SHIFT 2 ///< IIR filter constant, each poll moves the axis 1/2^n towards the new average
+#endif
+
+#ifndef ANALOG_DEADBAND
+#define ANALOG_DEADBAND 8 ///< Default change in 12-bit counts needed to update an axis
+#endif
+
+/**
+ * @class EmcAnalogInput
+ * @brief Oversampled, filtered and calibrated analog axes.
+ */
+class EmcAnalogInput
+{
+public:
+    static const uint8_t MAX_AXES = 10;     ///< ADC1 channels
+    static const uint8_t AXIS_BITS = 12;    ///< Bits per packed axis
+    static const uint16_t AXIS_MAX = 4095;  ///< Largest axis value
+
+    /**
+     * @brief Configures the axes and starts continuous conversion.
+     * @param pins ADC1 GPIOs, the first pin is axis 0.
+     * @param count Number of pins, at most MAX_AXES.
+     * @param sampleRateHz Conversions per second over all axes.
+     * @return false if a pin is not on ADC1 or the driver failed.
+     */
+    bool begin(const uint8_t *pins, uint8_t count, uint32_t sampleRateHz = ANALOG_SAMPLE_RATE_HZ);
+
+    /**
+     * @brief Stops conversion and releases the driver.
+     */
+    void end();
+
+    /**
+     * @brief Sets the raw range of an axis, e.g. the end stops of a paddle.
+     * @param axis Axis index.
+     * @param rawMin Raw 12-bit value mapped to 0.
+     * @param rawMax Raw 12-bit value mapped to AXIS_MAX.
+     * @param invert true to swap the direction.
+     */
+    void setCalibration(uint8_t axis, uint16_t rawMin, uint16_t rawMax, bool invert = false);
+
+    /**
+     * @brief Sets the change in counts needed to update an axis.
+     */
+    void setDeadband(uint16_t counts) { deadband = counts; }
+
+    /**
+     * @brief Processes the conversions collected since the last call, never blocks.
+     * @return true if any axis value changed.
+     */
+    bool poll();
+
+    /**
+     * @brief Returns the calibrated value of an axis, 0..AXIS_MAX.
+     */
+    uint16_t getAxis(uint8_t axis) const { return axis < count ? output[axis] : 0; }
+
+    /**
+     * @brief Returns the filtered raw 12-bit value of an axis, for calibration.
+     */
+    uint16_t getRaw(uint8_t axis) const { return axis < count ? filtered[axis] >> 4 : 0; }
+
+    /**
+     * @brief Returns the number of axes.
+     */
+    uint8_t size() const { return count; }
+
+    /**
+     * @brief Writes all axes, 12 bits each, into a byte buffer.
+     * @param data Destination, e.g. slave_data_t::data.
+     * @param len Size of @p data; axes that do not fit are left out.
+     */
+    void pack(uint8_t *data, size_t len) const;
+
+private:
+    adc_continuous_handle_t handle = nullptr; ///< Continuous ADC driver
+    uint8_t count = 0;                 ///< Number of axes
+    uint8_t channelAxis[16];           ///< Axis of each ADC1 channel, 0xFF if unused
+    uint16_t rawMin[MAX_AXES];         ///< Raw value mapped to 0
+    uint16_t rawMax[MAX_AXES];         ///< Raw value mapped to AXIS_MAX
+    bool inverted[MAX_AXES];           ///< Direction of each axis is swapped
+    uint32_t filtered[MAX_AXES];       ///< IIR filtered raw value, 12.4 fixed point
+    bool primed[MAX_AXES];             ///< Filter has seen its first sample
+    uint16_t output[MAX_AXES];         ///< Calibrated value after the deadband
+    uint16_t deadband = ANALOG_DEADBAND; ///< Change needed to update an axis
+    uint8_t buffer[ANALOG_FRAME_BYTES]; ///< Conversion results read from the driver
+};
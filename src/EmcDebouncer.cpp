@@ -0,0 +1,101 @@
+/*
+ * EmcDebouncer.cpp
+ *
+ *  Created on: 14.10.2026
+ *      Author: daenzell
+ */
+
+#include "EmcDebouncer.h"
+
+/**
+ * @brief Creates a debouncer that passes all inputs through unchanged.
+ */
+EmcDebouncer::EmcDebouncer()
+{
+    memset(state, 0, sizeof(state));
+    memset(count, 0, sizeof(count));
+    memset(limit, 0, sizeof(limit));
+}
+
+/**
+ * @brief Sets the debounce time of a group of inputs, in samples.
+ *
+ * At a scan rate of 1 kHz one sample is one millisecond. Mechanical switches
+ * usually need around 5 samples; touch pads, which are filtered in hardware,
+ * get by with fewer.
+ *
+ * @param[in] firstBit The position of the first input of the group in the bitmap.
+ * @param[in] bitCount The number of inputs in the group.
+ * @param[in] samples The number of differing samples in a row that changes an input.
+ * @return false if the group does not fit into the bitmap or @p samples is out of range.
+ */
+bool EmcDebouncer::setSamples(uint16_t firstBit, uint16_t bitCount, uint8_t samples)
+{
+    if (samples < 1 || samples > MAX_SAMPLES || firstBit + bitCount > DEBOUNCE_BITS)
+    {
+        return false;
+    }
+
+    // The counter is compared before it is incremented, so the threshold is one less
+    uint8_t threshold = samples - 1;
+    for (uint16_t bit = firstBit; bit < firstBit + bitCount; bit++)
+    {
+        uint32_t mask = 1UL << (bit % 32);
+        for (uint8_t plane = 0; plane < 3; plane++)
+        {
+            if (threshold & (1 << plane))
+                limit[plane][bit / 32] |= mask;
+            else
+                limit[plane][bit / 32] &= ~mask;
+        }
+        count[0][bit / 32] &= ~mask;
+        count[1][bit / 32] &= ~mask;
+        count[2][bit / 32] &= ~mask;
+    }
+    return true;
+}
+
+/**
+ * @brief Debounces one sample of the bitmap in place.
+ *
+ * For each word, the inputs that differ from the debounced state and whose
+ * counter reached the threshold flip; the other differing inputs count up,
+ * and all agreeing inputs reset their counter. This is a fixed sequence of
+ * logic operations per word regardless of how many inputs bounce.
+ *
+ * @param[in,out] bits The raw bitmap, replaced by the debounced bitmap.
+ */
+void EmcDebouncer::update(uint8_t *bits)
+{
+    uint32_t raw[WORDS];
+    memcpy(raw, bits, sizeof(raw));
+
+    for (uint8_t w = 0; w < WORDS; w++)
+    {
+        uint32_t delta = raw[w] ^ state[w];
+        uint32_t reached = ~((count[0][w] ^ limit[0][w]) | (count[1][w] ^ limit[1][w]) | (count[2][w] ^ limit[2][w]));
+        uint32_t flip = delta & reached;
+        state[w] ^= flip;
+
+        // Ripple-carry increment of the counters still waiting, everything else restarts at zero
+        uint32_t inc = delta & ~flip;
+        uint32_t carry1 = count[0][w] & inc;
+        uint32_t carry2 = count[1][w] & carry1;
+        count[0][w] = (count[0][w] ^ inc) & inc;
+        count[1][w] = (count[1][w] ^ carry1) & inc;
+        count[2][w] = (count[2][w] ^ carry2) & inc;
+    }
+
+    memcpy(bits, state, sizeof(state));
+}
+
+/**
+ * @brief Takes over a bitmap as the debounced state and clears all counters.
+ *
+ * @param[in] bits The bitmap to take over.
+ */
+void EmcDebouncer::reset(const uint8_t *bits)
+{
+    memcpy(state, bits, sizeof(state));
+    memset(count, 0, sizeof(count));
+}
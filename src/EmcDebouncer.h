@@ -0,0 +1,69 @@
+/*
+ * EmcDebouncer.h
+ *
+ *  Created on: 14.10.2026
+ *      Author: daenzell
+ */
+
+#pragma once
+
+/**
+ * @file EmcDebouncer.h
+ * @brief Bit-parallel debouncer for the packed button bitmap
+ *
+ * Every bit has a 3-bit counter of consecutive samples that differ from its
+ * debounced state. The counters are stored as vertical bit planes, one
+ * uint32_t per plane and word, so 32 inputs are debounced with a handful of
+ * logic operations and no branch per bit. A bit changes once its counter
+ * reaches the number of samples configured for it; a sample that agrees with
+ * the debounced state resets the counter. The per-bit threshold is stored as
+ * bit planes as well, so groups of inputs can use different settings.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#ifndef DEBOUNCE_BITS
+#define DEBOUNCE_BITS 128 ///< Number of inputs, matches slave_data_t::button_data
+#endif
+
+static_assert(DEBOUNCE_BITS % 32 == 0, "DEBOUNCE_BITS must be a multiple of 32");
+
+/**
+ * @class EmcDebouncer
+ * @brief Debounces up to DEBOUNCE_BITS packed inputs in parallel.
+ */
+class EmcDebouncer
+{
+public:
+    static const uint8_t WORDS = DEBOUNCE_BITS / 32; ///< Number of 32-bit words in the bitmap
+    static const uint8_t MAX_SAMPLES = 8;            ///< Largest number of samples a counter can wait for
+
+    EmcDebouncer();
+
+    /**
+     * @brief Sets the number of stable samples a group of inputs needs to change.
+     * @param firstBit Position of the first input of the group in the bitmap.
+     * @param bitCount Number of inputs in the group.
+     * @param samples Samples in a row that must differ from the debounced state, 1 passes inputs through.
+     * @return false if the group is out of range or @p samples is not 1..MAX_SAMPLES.
+     */
+    bool setSamples(uint16_t firstBit, uint16_t bitCount, uint8_t samples);
+
+    /**
+     * @brief Debounces one sample of the bitmap in place.
+     * @param bits Raw bitmap of DEBOUNCE_BITS / 8 bytes, replaced by the debounced bitmap.
+     */
+    void update(uint8_t *bits);
+
+    /**
+     * @brief Sets the debounced state without waiting, e.g. after a wake.
+     * @param bits Bitmap of DEBOUNCE_BITS / 8 bytes.
+     */
+    void reset(const uint8_t *bits);
+
+private:
+    uint32_t state[WORDS];      ///< Debounced state
+    uint32_t count[3][WORDS];   ///< Bit planes of the per-bit counters
+    uint32_t limit[3][WORDS];   ///< Bit planes of the per-bit thresholds (samples - 1)
+};
@@ -0,0 +1,186 @@
+/*
+ * EmcEncoder.cpp
+ *
+ *  Created on: 14.10.2026
+ *      Author: daenzell
+ */
+
+#include "EmcEncoder.h"
+#include "esp_timer.h"
+
+// The unit wraps at these limits; accum_count keeps the total across the wrap
+#define ENCODER_COUNT_LIMIT 10000
+
+/**
+ * @brief Sets up a pulse counter unit for a quadrature encoder.
+ *
+ * Channel 0 counts the edges of A with B as direction, channel 1 the edges
+ * of B with A as direction, which gives four counts per quadrature cycle.
+ * The glitch filter drops contact bounce shorter than ENCODER_GLITCH_NS.
+ *
+ * @param[in] pinA The GPIO of signal A.
+ * @param[in] pinB The GPIO of signal B.
+ * @return The encoder index, or -1 if no unit is free or the driver failed.
+ */
+int EmcEncoder::add(uint8_t pinA, uint8_t pinB)
+{
+    if (count >= MAX_ENCODERS)
+    {
+        return -1;
+    }
+
+    pinMode(pinA, INPUT_PULLUP);
+    pinMode(pinB, INPUT_PULLUP);
+
+    pcnt_unit_config_t unitConfig;
+    memset(&unitConfig, 0, sizeof(unitConfig));
+    unitConfig.low_limit = -ENCODER_COUNT_LIMIT;
+    unitConfig.high_limit = ENCODER_COUNT_LIMIT;
+    unitConfig.flags.accum_count = 1;
+
+    pcnt_unit_handle_t unit = nullptr;
+    if (pcnt_new_unit(&unitConfig, &unit) != ESP_OK)
+    {
+        log_e("No pulse counter unit left\n");
+        return -1;
+    }
+
+    pcnt_glitch_filter_config_t filter;
+    filter.max_glitch_ns = ENCODER_GLITCH_NS;
+    pcnt_unit_set_glitch_filter(unit, &filter);
+
+    pcnt_chan_config_t chanA;
+    memset(&chanA, 0, sizeof(chanA));
+    chanA.edge_gpio_num = pinA;
+    chanA.level_gpio_num = pinB;
+    pcnt_chan_config_t chanB;
+    memset(&chanB, 0, sizeof(chanB));
+    chanB.edge_gpio_num = pinB;
+    chanB.level_gpio_num = pinA;
+
+    pcnt_channel_handle_t a = nullptr;
+    pcnt_channel_handle_t b = nullptr;
+    if (pcnt_new_channel(unit, &chanA, &a) != ESP_OK || pcnt_new_channel(unit, &chanB, &b) != ESP_OK)
+    {
+        log_e("Pulse counter channel setup failed\n");
+        if (a)
+            pcnt_del_channel(a);
+        pcnt_del_unit(unit);
+        return -1;
+    }
+    pcnt_channel_set_edge_action(a, PCNT_CHANNEL_EDGE_ACTION_DECREASE, PCNT_CHANNEL_EDGE_ACTION_INCREASE);
+    pcnt_channel_set_level_action(a, PCNT_CHANNEL_LEVEL_ACTION_KEEP, PCNT_CHANNEL_LEVEL_ACTION_INVERSE);
+    pcnt_channel_set_edge_action(b, PCNT_CHANNEL_EDGE_ACTION_INCREASE, PCNT_CHANNEL_EDGE_ACTION_DECREASE);
+    pcnt_channel_set_level_action(b, PCNT_CHANNEL_LEVEL_ACTION_KEEP, PCNT_CHANNEL_LEVEL_ACTION_INVERSE);
+
+    // Watch points at the limits let the driver accumulate across the wrap
+    pcnt_unit_add_watch_point(unit, ENCODER_COUNT_LIMIT);
+    pcnt_unit_add_watch_point(unit, -ENCODER_COUNT_LIMIT);
+
+    pcnt_unit_enable(unit);
+    pcnt_unit_clear_count(unit);
+    pcnt_unit_start(unit);
+
+    units[count] = unit;
+    channels[count][0] = a;
+    channels[count][1] = b;
+    memset(&pulses[count], 0, sizeof(pulse_state_t));
+    return count++;
+}
+
+/**
+ * @brief Stops all counters and releases their units and channels.
+ */
+void EmcEncoder::end()
+{
+    for (uint8_t i = 0; i < count; i++)
+    {
+        pcnt_unit_stop(units[i]);
+        pcnt_unit_disable(units[i]);
+        pcnt_del_channel(channels[i][0]);
+        pcnt_del_channel(channels[i][1]);
+        pcnt_del_unit(units[i]);
+    }
+    count = 0;
+}
+
+/**
+ * @brief Returns the accumulated count of an encoder.
+ *
+ * @param[in] index The encoder index.
+ * @return The count since add(), 0 for an invalid index.
+ */
+int32_t EmcEncoder::getCount(uint8_t index) const
+{
+    if (index >= count)
+    {
+        return 0;
+    }
+    int value = 0;
+    pcnt_unit_get_count(units[index], &value);
+    return value;
+}
+
+/**
+ * @brief Returns the accumulated detents of an encoder.
+ *
+ * Rounds towards negative infinity, so a detent is counted the same in both
+ * directions.
+ *
+ * @param[in] index The encoder index.
+ * @return The detents since add(), clockwise positive.
+ */
+int32_t EmcEncoder::getDetents(uint8_t index) const
+{
+    int32_t steps = getCount(index);
+    return steps >= 0 ? steps / ENCODER_STEPS_PER_DETENT
+                      : -((-steps + ENCODER_STEPS_PER_DETENT - 1) / ENCODER_STEPS_PER_DETENT);
+}
+
+/**
+ * @brief Turns detents that were not sent yet into fixed-width button pulses.
+ *
+ * Each pulse is held for the pulse width and followed by a gap of the same
+ * width, so the receiver sees every detent as a separate press. Detents
+ * queue up while a pulse is running; a fast spin is sent completely, just
+ * spread out over time. Turning back cancels queued detents of the other
+ * direction.
+ *
+ * @return Two bits per encoder: bit 2n is clockwise, bit 2n+1 counter-clockwise.
+ */
+uint32_t EmcEncoder::pulseBits()
+{
+    int64_t now = esp_timer_get_time();
+    uint32_t bits = 0;
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        pulse_state_t &p = pulses[i];
+        int64_t elapsed = now - p.changedUs;
+
+        if (p.active)
+        {
+            if (elapsed >= pulseUs)
+            {
+                p.emitted += p.active;
+                p.active = 0;
+                p.changedUs = now;
+            }
+        }
+        else if (elapsed >= pulseUs)
+        {
+            int32_t pending = getDetents(i) - p.emitted;
+            if (pending)
+            {
+                p.active = pending > 0 ? 1 : -1;
+                p.changedUs = now;
+            }
+        }
+
+        if (p.active > 0)
+            bits |= 1UL << (i * 2);
+        else if (p.active < 0)
+            bits |= 1UL << (i * 2 + 1);
+    }
+    return bits;
+}
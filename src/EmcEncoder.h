@@ -0,0 +1,105 @@
+/*
+ * EmcEncoder.h
+ *
+ *  Created on: 14.10.2026
+ *      Author: daenzell
+ */
+
+#pragma once
+
+/**
+ * @file EmcEncoder.h
+ * @brief Quadrature rotary encoders counted by the PCNT peripheral
+ *
+ * Each encoder gets one pulse counter unit with two channels, so every edge
+ * of both signals is counted in hardware (4 counts per quadrature cycle) and
+ * short glitches are filtered out before counting. No step is lost however
+ * fast the encoder spins or however busy the CPU is; the software only reads
+ * the accumulated count.
+ *
+ * For receivers that expect buttons, pulseBits() turns the counted detents
+ * into button pulses of a fixed width, one clockwise and one counter-clockwise
+ * bit per encoder. Detents that arrive faster than the pulses can be sent are
+ * kept and sent afterwards, so none get lost on a fast spin.
+ */
+
+#include <Arduino.h>
+#include "driver/pulse_cnt.h"
+
+#ifndef ENCODER_STEPS_PER_DETENT
+#define ENCODER_STEPS_PER_DETENT 4 ///< Counted edges per detent, 4 for a full quadrature cycle per detent
+#endif
+
+#ifndef ENCODER_GLITCH_NS
+#define ENCODER_GLITCH_NS 1000 ///< Pulses shorter than this are ignored by the hardware filter
+#endif
+
+#ifndef ENCODER_PULSE_MS
+#define ENCODER_PULSE_MS 20 ///< Default width of a button pulse and of the gap after it
+#endif
+
+/**
+ * @class EmcEncoder
+ * @brief Hardware counted rotary encoders with optional button pulse output.
+ */
+class EmcEncoder
+{
+public:
+    static const uint8_t MAX_ENCODERS = 4; ///< PCNT units of the ESP32-S2
+
+    /**
+     * @brief Adds an encoder and starts counting.
+     * @param pinA GPIO of signal A.
+     * @param pinB GPIO of signal B.
+     * @return Encoder index, or -1 if all units are in use or the driver failed.
+     */
+    int add(uint8_t pinA, uint8_t pinB);
+
+    /**
+     * @brief Stops counting and releases all units.
+     */
+    void end();
+
+    /**
+     * @brief Returns the number of encoders.
+     */
+    uint8_t size() const { return count; }
+
+    /**
+     * @brief Returns the accumulated hardware count of an encoder.
+     */
+    int32_t getCount(uint8_t index) const;
+
+    /**
+     * @brief Returns the accumulated detents of an encoder, clockwise positive.
+     */
+    int32_t getDetents(uint8_t index) const;
+
+    /**
+     * @brief Sets the width of a button pulse and of the gap after it.
+     */
+    void setPulseWidth(uint32_t ms) { pulseUs = ms * 1000; }
+
+    /**
+     * @brief Advances the button pulses, call once per scan.
+     * @return Two bits per encoder in index order: clockwise, then counter-clockwise.
+     */
+    uint32_t pulseBits();
+
+private:
+    /**
+     * @brief Pulse output state of one encoder.
+     */
+    typedef struct
+    {
+        int32_t emitted;      ///< Detents already sent as pulses
+        int8_t active;        ///< Direction of the pulse being sent, 0 if none
+        int64_t changedUs;    ///< Start of the current pulse or gap
+    } pulse_state_t;
+
+    pcnt_unit_handle_t units[MAX_ENCODERS];       ///< Counter unit of each encoder
+    pcnt_channel_handle_t channels[MAX_ENCODERS][2]; ///< Channels for the edges of A and B
+    pulse_state_t pulses[MAX_ENCODERS];           ///< Pulse output state
+    uint8_t count = 0;                            ///< Number of encoders
+    uint32_t pulseUs = ENCODER_PULSE_MS * 1000;   ///< Pulse and gap width
+};
@@ -8,9 +8,28 @@
 #if defined(ESP32)
 
 #include "EmcEspNow.h"
+#include "EmcLog.h"
+#include "esp_sleep.h"
+#include "esp_wifi.h"
 
 EmcEspNow *EmcEspNow::instance = nullptr;
 
+#define RTC_PAIRING_MAGIC 0x454D4331 ///< Marks valid pairing data in RTC memory
+
+/**
+ * @struct rtc_pairing_t
+ * @brief Pairing state of a slave that survives deep sleep.
+ */
+typedef struct
+{
+    uint32_t magic;       ///< RTC_PAIRING_MAGIC if the data is valid
+    uint8_t masterMac[6]; ///< MAC address of the paired master
+    uint8_t channel;      ///< WiFi channel of the master
+    uint16_t txSeq;       ///< Next sequence number to the master
+} rtc_pairing_t;
+
+static RTC_DATA_ATTR rtc_pairing_t rtcPairing; ///< Pairing state kept in RTC memory across deep sleep
+
 /**
  * @brief Initialize the ESP-NOW communication module in either master or slave mode.
  *
@@ -18,18 +37,34 @@ EmcEspNow *EmcEspNow::instance = nullptr;
  * It initializes the ESP-NOW module and registers the callbacks for sending
  * and receiving messages.
  *
+ * A slave that wakes from deep sleep re-adds the master it was paired with
+ * from RTC memory, so its first frame goes out without waiting for discovery.
+ * If the restored master does not acknowledge, discovery starts as usual.
+ *
  * @param isMaster If true, the ESP-NOW module will operate in master mode.
  */
 void EmcEspNow::begin(bool isMaster)
 {
+    // Reuse the paired master after a wake from deep sleep
+    bool restore = !isMaster && rtcPairing.magic == RTC_PAIRING_MAGIC && esp_sleep_get_wakeup_cause() != ESP_SLEEP_WAKEUP_UNDEFINED;
+    if (restore)
+    {
+        channel = rtcPairing.channel;
+    }
+
     // Set WiFi mode to station and set the channel
     WiFi.mode(WIFI_STA);
-    WiFi.setChannel(ESPNOW_WIFI_CHANNEL);
+    if (isMaster && autoChannel)
+    {
+        channel = surveyChannels();
+    }
+    WiFi.setChannel(channel);
+    WiFi.macAddress(ownMac); // Finds our slot in the syncs of a scheduled master
 
     if (esp_now_init() != ESP_OK)
     {
         // Error handling
-        log_e("Failed to initialize ESP-NOW");
+        EMC_LOGE("Failed to initialize ESP-NOW");
         return;
     }
 
@@ -40,10 +75,34 @@ void EmcEspNow::begin(bool isMaster)
 
     // Set the mode
     this->isMaster = isMaster;
+    discoveryIntervalMs = ESPNOW_DISCOVERY_MIN_MS;
+    discoveryBackoffMs = ESPNOW_DISCOVERY_MIN_MS;
+    discoveryStartChannel = channel;
+    hopCheckMillis = millis();
 
     // Set the instance
     instance = this;
 
+    // Sends the syncs on a master and wakes a slave for its slot, see setScheduled()
+    if (!tdmaTimer)
+    {
+        esp_timer_create_args_t args;
+        memset(&args, 0, sizeof(args));
+        args.callback = onScheduleTimer;
+        args.arg = this;
+        args.dispatch_method = ESP_TIMER_TASK;
+        args.name = "espnow_tdma";
+        args.skip_unhandled_events = true; // A late sync is not repeated, the next one is due soon
+        if (esp_timer_create(&args, &tdmaTimer) != ESP_OK)
+        {
+            EMC_LOGE("Failed to create the schedule timer");
+            tdmaTimer = nullptr;
+        }
+    }
+
+    // Command numbers start anywhere, so a slave does not take those of a restarted master for duplicates
+    cmdLogHead = random(0x10000);
+
     // Add the broadcast peer
     if (!isMaster)
     {
@@ -57,8 +116,82 @@ void EmcEspNow::begin(bool isMaster)
     // Reset the data
     resetData();
 
-    // Start the task
-    // xTaskCreatePinnedToCore(espNowTask, "espNowTask", 2048, NULL, 1, NULL, 0);
+    if (restore)
+    {
+        txSeq[1] = rtcPairing.txSeq; // Continue the sequence the master knows
+        addPeer(rtcPairing.masterMac); // Takes peer ID 1, the master's ID
+        masterRestored = peers.get(1) != nullptr;
+        EMC_LOGD("Master restored from RTC memory: " MACSTR "\n", MAC2STR(rtcPairing.masterMac));
+    }
+}
+
+/**
+ * @brief Starts a dedicated task that runs the ESP-NOW updates.
+ *
+ * Once the task runs, update() no longer transmits by itself. It only hands
+ * changed slaveSendData / masterCmdData to the task and wakes it with a task
+ * notification, so the radio latency no longer depends on how long the rest
+ * of loop() takes. Between notifications the task sleeps until the next
+ * discovery, keep-alive or keyframe deadline.
+ *
+ * @param[in] core The core to pin the task to.
+ * @param[in] priority The FreeRTOS priority of the task.
+ * @param[in] stackSize The stack size of the task in bytes.
+ * @return true if the task is running.
+ */
+bool EmcEspNow::startTask(BaseType_t core, UBaseType_t priority, uint32_t stackSize)
+{
+    if (taskHandle)
+    {
+        return true;
+    }
+
+    // Hand the current data to the task before it runs for the first time
+    slaveTxData.store(slaveSendData);
+    masterTxCmd.store(masterCmdData);
+
+    taskRunning = true;
+    TaskHandle_t handle = nullptr;
+    if (xTaskCreatePinnedToCore(espNowTask, "espNowTask", stackSize, this, priority, &handle, core) != pdPASS)
+    {
+        EMC_LOGE("Failed to start ESP-NOW task");
+        taskRunning = false;
+        return false;
+    }
+    taskHandle = handle;
+    return true;
+}
+
+/**
+ * @brief Stops the ESP-NOW task and waits until it has exited.
+ *
+ * After this, update() transmits directly again.
+ */
+void EmcEspNow::stopTask()
+{
+    if (!taskHandle)
+    {
+        return;
+    }
+
+    taskRunning = false;
+    notify();
+    while (taskHandle)
+    {
+        vTaskDelay(1);
+    }
+}
+
+/**
+ * @brief Wakes the ESP-NOW task, if it is running.
+ */
+void EmcEspNow::notify()
+{
+    TaskHandle_t handle = taskHandle;
+    if (handle)
+    {
+        xTaskNotifyGive(handle);
+    }
 }
 
 /**
@@ -70,16 +203,34 @@ void EmcEspNow::begin(bool isMaster)
  */
 void EmcEspNow::end()
 {
-    resetData(); // Clear any stored data
+    stopTask(); // Stop sending before the peers go away
 
     // Unregister callbacks to prevent any during shutdown
     esp_now_unregister_send_cb();
     esp_now_unregister_recv_cb();
-    
+
+    // No more syncs or slot wake-ups
+    if (tdmaTimer)
+    {
+        esp_timer_stop(tdmaTimer);
+        esp_timer_delete(tdmaTimer);
+        tdmaTimer = nullptr;
+    }
+    tdmaCycleUs = 0;
+    tdmaSlot.reset();
+
+    // Keep the sequence to the master, so it accepts our frames right after a wake
+    if (!isMaster && peers.get(1) && rtcPairing.magic == RTC_PAIRING_MAGIC)
+    {
+        rtcPairing.txSeq = txSeq[1];
+    }
+
+    resetData(); // Clear any stored data
+
     // Remove all peers from the ESP-NOW network
-    for (auto it = peers.begin(); it != peers.end(); ++it)
+    for (const auto &peer : peers)
     {
-        esp_now_del_peer(it->peer_mac);
+        esp_now_del_peer(peer.peer_mac);
     }
 
     // Deinitialize the ESP-NOW communication protocol
@@ -88,43 +239,85 @@ void EmcEspNow::end()
     // Turn off the WiFi to save power
     WiFi.mode(WIFI_OFF);
 
-    // Clear the instance pointer and peer list
+    // Clear the instance pointer, peer table and command queues
     instance = nullptr;
     peers.clear();
+    cmdQueue.clear();
+    cmdRecvQueue.clear();
+    edgeQueue.clear();
+    edgeHistoryCount = 0;
 }
 
 /**
  * @brief Adds a new peer to the ESP-NOW network.
  *
- * This function adds a new peer device to the ESP-NOW network by creating a
- * peer info struct and using the esp_now_add_peer() function to add the peer.
- * If the peer does not already exist, it is added to the list of peers.
+ * This function adds a new peer device to the ESP-NOW network. The peer table
+ * is checked first, so a known peer costs one hash lookup and never reaches
+ * the ESP-NOW driver. A new peer takes the lowest free peer ID and is then
+ * registered with esp_now_add_peer(). Nothing is allocated, so this is safe
+ * to call from the receive callback. The table is changed under peerLock,
+ * as the WiFi task and the transmit context both add and remove peers.
  * @param[in] peer_addr The MAC address of the peer device to add.
  */
 void EmcEspNow::addPeer(const uint8_t *peer_addr)
 {
+    // Check if the peer already exists in the peer table
+    portENTER_CRITICAL(&peerLock);
+    bool known = peers.find(peer_addr) >= 0;
+    int peerID = known ? -1 : peers.add(peer_addr);
+    portEXIT_CRITICAL(&peerLock);
+    if (known)
+    {
+        return;
+    }
+
+    if (peerID < 0)
+    {
+        EMC_LOGE("Peer table full");
+        return;
+    }
+
     esp_now_peer_info_t peer;
     memset(&peer, 0, sizeof(esp_now_peer_info_t));
     memcpy(peer.peer_addr, peer_addr, 6);
-    peer.channel = ESPNOW_WIFI_CHANNEL;
+    peer.channel = channel;
     peer.encrypt = false;
 
-    // Check if the peer already exists in the list of peers
-    if (!esp_now_is_peer_exist(peer.peer_addr))
+    if (esp_now_add_peer(&peer) == ESP_OK)
     {
-        // Add the peer to the list of peers if it does not already exist
-        if (esp_now_add_peer(&peer) == ESP_OK)
-        {
-            log_d("Peer added: " MACSTR "\n", MAC2STR(peer.peer_addr));
-            peers_t new_peer;
-            new_peer.peerID = peers.size();
-            memcpy(new_peer.peer_mac, peer.peer_addr, 6);
-            peers.push_back(new_peer);
-        }
-        else
+        memset(&peerStats[peerID], 0, sizeof(peer_stats_t));
+        peerStats[peerID].lastAckMillis = millis();
+        peerStats[peerID].lastRxMillis = millis();
+        txSlots[peerID].retryPending = false;
+        txSlots[peerID].sentMillis = millis();
+        txSlots[peerID].txCount = txSlots[peerID].statusCount; // Statuses still due for a removed peer are dropped
+        txSlots[peerID].frameTxCount = txSlots[peerID].txCount;
+        linkStates[peerID] = LINK_CONNECTED;
+
+        // Remember the master in RTC memory for a fast reconnect after deep sleep
+        if (!isMaster && peerID == 1)
         {
-            log_e("Failed to add peer");
+            rtcPairing.magic = RTC_PAIRING_MAGIC;
+            memcpy(rtcPairing.masterMac, peer_addr, 6);
+            rtcPairing.channel = channel;
+            rtcPairing.txSeq = txSeq[1];
         }
+        rxKeyframeValid[peerID] = false;
+        forceKeyframe = true;
+
+        // A new slave gets the current command on the next update(), and the commands queued from now on
+        cmdPending[peerID] = true;
+        cmdAcked[peerID] = cmdLogHead;
+        cmdInFlight[peerID] = cmdLogHead;
+        cmdRecvValid = false; // A new master numbers its commands on its own
+        EMC_LOGD("Peer added: " MACSTR "\n", MAC2STR(peer.peer_addr));
+    }
+    else
+    {
+        portENTER_CRITICAL(&peerLock);
+        peers.remove(peer_addr);
+        portEXIT_CRITICAL(&peerLock);
+        EMC_LOGE("Failed to add peer");
     }
 }
 
@@ -132,233 +325,2419 @@ void EmcEspNow::addPeer(const uint8_t *peer_addr)
  * @brief Removes a peer from the ESP-NOW network.
  *
  * This function removes a peer device from the ESP-NOW network by deleting the
- * peer from the list of peers and calling the esp_now_del_peer() function to
- * remove the peer. After removing the peer, the data is reset to prevent any
- * further communication with the peer.
+ * peer from the peer table and calling the esp_now_del_peer() function to
+ * remove the peer. Only the state belonging to this peer is cleared: a pending
+ * retry and, on the master, the peer's receive slot. The slave data and the
+ * current command are kept, so a reconnect continues with the latest state.
+ * The peer ID becomes free again.
+ *
+ * Lost peers are removed by the transmit context, failing ones by the WiFi
+ * task, so the table and the receive slot are changed under peerLock. The
+ * lock also makes the slot reset and storeSlaveData() take turns as writers
+ * of the slot's sequence lock.
  * @param[in] peer_mac The MAC address of the peer device to remove.
  */
 void EmcEspNow::removePeer(const uint8_t *peer_mac)
 {
-    // Reset the data to prevent any further communication with the peer
-    resetData();
+    portENTER_CRITICAL(&peerLock);
+    int peerID = peers.find(peer_mac);
+    if (peerID >= 0)
+    {
+        masterRecvData[peerID].reset();
+        peers.remove(peer_mac);
+    }
+    portEXIT_CRITICAL(&peerLock);
+    if (peerID < 0)
+    {
+        return;
+    }
 
-    // Iterate over the list of peers and find the peer to remove
-    for (auto it = peers.begin(); it != peers.end(); ++it)
+    txSlots[peerID].retryPending = false;
+    txSlots[peerID].copiesLeft = 0;
+    rxKeyframeValid[peerID] = false;
+    rxEdgeValid[peerID] = false;
+
+    esp_now_del_peer(peer_mac);
+
+    // Look for a new master quickly, the backoff starts over
+    if (!isMaster && peerID == 1)
     {
-        if (memcmp(it->peer_mac, peer_mac, 6) == 0)
-        {
-            // Remove the peer from the list of peers
-            esp_now_del_peer(peer_mac);
-            peers.erase(it);
-            log_d("Peer removed: " MACSTR "\n", MAC2STR(peer_mac));
-            break;
-        }
+        discoveryIntervalMs = ESPNOW_DISCOVERY_MIN_MS;
+        discoveryBackoffMs = ESPNOW_DISCOVERY_MIN_MS;
+        discoveryStartChannel = channel;
     }
+    EMC_LOGD("Peer removed: " MACSTR "\n", MAC2STR(peer_mac));
 }
 
 /**
- * @brief Resets the data used for communication to its initial state.
+ * @brief Looks up the peer ID of a MAC address.
  *
- * This function is used to reset the data used for communication with the
- * master device to its initial state. This is necessary to prevent any
- * further communication with the master device after the connection has been
- * closed.
+ * Used by both the WiFi task and the transmit context, so the lookup runs
+ * under peerLock and never sees the hash index in the middle of a change.
+ *
+ * @param[in] peer_mac The MAC address.
+ * @return The peer ID, or -1 if the peer is unknown.
  */
-void EmcEspNow::resetData()
+int EmcEspNow::findPeer(const uint8_t *peer_mac)
 {
-    // Reset the data used for communication
-    memset(&slaveSendData, 0, sizeof(slave_data_t));
-    memset(&lastSlaveSendData, 0, sizeof(slave_data_t));
-    memset(&masterRecvData, 0, sizeof(slave_data_t));
-    memset(&masterCmdData, 0, sizeof(master_cmd_t));
-    memset(&lastmasterCmdData, 0, sizeof(master_cmd_t));
+    portENTER_CRITICAL(&peerLock);
+    int peerID = peers.find(peer_mac);
+    portEXIT_CRITICAL(&peerLock);
+    return peerID;
 }
 
 /**
- * @brief Sends a broadcast message to all peers in the ESP-NOW network.
+ * @brief Returns the overall link state.
  *
- * This function is used to send a broadcast message to all peers in the ESP-NOW
- * network. The message is sent using the esp_now_send() function and the
- * broadcast MAC address of the slave or master device is used as the destination
- * address depending on the mode of the device.
+ * On a slave this is the state of the link to the master. On a master it is
+ * LINK_CONNECTED if any slave is connected, LINK_DEGRADED if slaves are only
+ * degraded. Without a connected peer it is LINK_DISCOVERING until the first
+ * peer was found, and LINK_LOST after the last peer timed out.
+ *
+ * @return The link state.
  */
-void EmcEspNow::sendBroadcast()
+LinkState EmcEspNow::getLinkState() const
 {
-    // Send the broadcast message using the broadcast MAC address of the slave or master device
-    if (!isMaster)
-    {
-        // Send the broadcast message to all slave devices
-        esp_now_send(BROADCAST_MAC_SLAVE, (uint8_t *)&BROADCAST_SLAVE_MESSAGE, strlen(BROADCAST_SLAVE_MESSAGE));
-    }
-    else
+    LinkState best = linkState;
+    for (const auto &peer : peers)
     {
-        // Send the broadcast message to all master devices
-        esp_now_send(BROADCAST_MAC_MASTER, (uint8_t *)&BROADCAST_MASTER_MESSAGE, strlen(BROADCAST_MASTER_MESSAGE));
+        if (peer.peerID == 0)
+            continue; // Skip the broadcast peer
+
+        LinkState state = linkStates[peer.peerID];
+        if (state == LINK_CONNECTED)
+        {
+            return LINK_CONNECTED;
+        }
+        if (state == LINK_DEGRADED)
+        {
+            best = LINK_DEGRADED;
+        }
     }
+    return best;
 }
 
 /**
- * @brief Sends a unicast message to a specific peer in the ESP-NOW network.
+ * @brief Returns the link state of a peer.
  *
- * This function is used to send a unicast message to a specific peer in the ESP-NOW
- * network. The message is sent using the esp_now_send() function and the
- * destination address of the peer is specified.
+ * @param[in] peerID The peer ID.
+ * @return The link state, or LINK_LOST if the ID is not in use.
+ */
+LinkState EmcEspNow::getLinkState(uint8_t peerID) const
+{
+    return peerID > 0 && peers.get(peerID) ? linkStates[peerID] : LINK_LOST;
+}
+
+/**
+ * @brief Configures heartbeats and the link timeouts.
  *
- * @param[in] peer_mac The MAC address of the peer device to send the message to.
- * @param[in] data The data to be sent to the peer device.
- * @param[in] len The length of the data to be sent.
+ * Whenever nothing was sent to a peer for @p heartbeatMs, an empty heartbeat
+ * frame is sent, so an idle link still shows as alive on the other side. A
+ * peer that was silent for @p degradedMs is LINK_DEGRADED; after @p lostMs it
+ * is LINK_LOST and removed, which frees its slot on the master and restarts
+ * discovery on a slave.
+ *
+ * @param[in] heartbeatMs Heartbeat interval in milliseconds.
+ * @param[in] degradedMs Degraded timeout in milliseconds.
+ * @param[in] lostMs Lost timeout in milliseconds.
  */
-void EmcEspNow::sendUnicast(const uint8_t *peer_mac, const uint8_t *data, size_t len)
+void EmcEspNow::setLinkTimeouts(unsigned long heartbeatMs, unsigned long degradedMs, unsigned long lostMs)
 {
-    esp_now_send(peer_mac, data, len);
-    // Handle failure
-    // esp_err_t result = esp_now_send(peer_mac, data, len);
-    // if (result != ESP_OK) {
-    //     removePeer(peer_mac);
-    // }
+    this->heartbeatMs = heartbeatMs;
+    this->degradedMs = degradedMs;
+    this->lostMs = lostMs;
 }
 
 /**
- * @brief Periodically sends the latest data to all peers in the ESP-NOW network.
+ * @brief Updates the link state of every peer.
  *
- * This function is called periodically to send the latest data to all peers in the
- * ESP-NOW network. If the device is in master mode, it sends the latest command data
- * to all slave devices. If the device is in slave mode, it sends the latest data to
- * the master device.
+ * Peers that were silent for longer than the lost timeout are removed.
+ * Heartbeats are sent to peers that did not get any frame within the
+ * heartbeat interval. A command batch that is still being resent is not
+ * replaced by a heartbeat, it keeps the link alive by itself.
  */
-void EmcEspNow::update()
+void EmcEspNow::updateLinks()
 {
-    if (!isMaster && peers.size() == 1)
+    unsigned long now = millis();
+    for (const auto &peer : peers)
     {
-        if (millis() - broadcastMillis > 100)
+        uint8_t peerID = peer.peerID;
+        if (peerID == 0)
+            continue; // Skip the broadcast peer
+
+        unsigned long silent = now - peerStats[peerID].lastRxMillis;
+        if (silent >= lostMs)
         {
-            broadcastMillis = millis();
-            sendBroadcast();
+            EMC_LOGD("Peer lost: " MACSTR "\n", MAC2STR(peer.peer_mac));
+            linkStates[peerID] = LINK_LOST;
+            linkState = LINK_LOST;
+            removePeer(peer.peer_mac);
+            continue;
         }
-        return;
-    }
 
-    if (isMaster)
-    {
-        // If the master command data has changed, send it to all slave devices
-        // if (memcmp(&masterCmdData, &lastmasterCmdData, sizeof(master_cmd_t)) != 0)
-        // {
-        //     for (uint8_t i = 1; i < peers.size(); i++)
-        //     {
-        //         sendUnicast(peers[i].peer_mac, (uint8_t *)&masterCmdData, sizeof(master_cmd_t));
-        //     }
+        linkStates[peerID] = silent >= degradedMs ? LINK_DEGRADED : LINK_CONNECTED;
 
-        //     memcpy(&lastmasterCmdData, &masterCmdData, sizeof(master_cmd_t));
-        // }
-        // Send the master command data to all slave devices
-        for (uint8_t i = 1; i < peers.size(); i++)
+        // A scheduled slave sends its heartbeat in its slot, after the data, see process()
+        if (now - txSlots[peerID].sentMillis >= heartbeatMs && (isMaster || !isScheduled()) && !cmdBatchOpen(peerID))
         {
-            sendUnicast(peers[i].peer_mac, (uint8_t *)&masterCmdData, sizeof(master_cmd_t));
+            sendFrame(peer.peer_mac, peerID, FRAME_HEARTBEAT, nullptr, 0);
         }
     }
-    else
-    {
-        if (masterHasCommand)
-            return;
+}
 
-        // If the slave data has changed, send it to the master device
-        if (memcmp(&slaveSendData, &lastSlaveSendData, sizeof(slave_data_t)) != 0)
-        {
-            sendUnicast(peers[1].peer_mac, (uint8_t *)&slaveSendData, sizeof(slave_data_t)); // Master always at index 1
-            memcpy(&lastSlaveSendData, &slaveSendData, sizeof(slave_data_t));
-        }
+/**
+ * @brief Queues a command for all slaves.
+ *
+ * The command is sent with the next update(), packed together with any other
+ * queued commands into one frame. Commands are delivered in queue order.
+ *
+ * @param[in] cmd The command to queue.
+ * @return true if the command was queued, false if the queue is full.
+ */
+bool EmcEspNow::queueCommand(const master_cmd_t &cmd)
+{
+    if (!cmdQueue.push(cmd))
+    {
+        return false;
     }
-    // yield();
+    notify();
+    return true;
 }
 
 /**
- * @brief Receive callback function for ESP-NOW messages.
+ * @brief Returns the oldest command the master queued with queueCommand().
  *
- * This function is called when a message is received from another ESP-NOW device.
- * The message is processed according to the mode of operation of the device.
- * If the device is in master mode, it processes the message as a slave device.
- * If the device is in slave mode, it processes the message as a master device.
+ * All queued commands of a batched frame are queued in the order the master
+ * sent them; the current command it repeats as a keep-alive is not. Commands
+ * that arrive while the queue is full are dropped.
  *
- * @param[in] recv_info The information about the received message.
- * @param[in] data The data received in the message.
- * @param[in] len The length of the data received in the message.
+ * @param[out] out The oldest waiting command.
+ * @return true if a command was copied to @p out.
  */
-void EmcEspNow::onReceive(const esp_now_recv_info_t *recv_info, const uint8_t *data, int len)
+bool EmcEspNow::popCommand(master_cmd_t &out)
 {
-    if (isMaster)
+    return cmdRecvQueue.pop(out);
+}
+
+/**
+ * @brief Registers the handler for commands the master queued with queueCommand().
+ *
+ * The current command the master repeats as a keep-alive is not passed to the
+ * handler, poll it with tryGetLatest() instead. A direct handler is called from the receive callback with a view into the
+ * received frame, so there is no copy and no polling in loop(). Deferred
+ * commands are queued and passed to the handler by dispatch(); commands that
+ * arrive while that queue is full are dropped.
+ *
+ * @param[in] handler The handler, or nullptr to remove it.
+ * @param[in] deferred true to call the handler from update() or the ESP-NOW task.
+ */
+void EmcEspNow::onCommand(CommandHandler handler, bool deferred)
+{
+    commandHandler = handler;
+    commandDeferred = deferred;
+}
+
+/**
+ * @brief Registers the handler for changed data received from a slave.
+ *
+ * A direct handler is called from the receive callback whenever a slave's
+ * data changed. A deferred handler is called by dispatch() once per slave
+ * that changed since the last dispatch, with that slave's latest data.
+ *
+ * @param[in] handler The handler, or nullptr to remove it.
+ * @param[in] deferred true to call the handler from update() or the ESP-NOW task.
+ */
+void EmcEspNow::onSlaveData(SlaveDataHandler handler, bool deferred)
+{
+    slaveDataHandler = handler;
+    slaveDataDeferred = deferred;
+}
+
+/**
+ * @brief Registers the handler for application frames.
+ *
+ * FRAME_USER frames carry any payload the application sends with
+ * sendUnicast(), in both directions. The handler is called from the receive
+ * callback, after duplicates were dropped.
+ *
+ * @param[in] handler The handler, or nullptr to remove it.
+ */
+void EmcEspNow::onUserFrame(UserFrameHandler handler)
+{
+    userFrameHandler = handler;
+}
+
+/**
+ * @brief Registers the handler for button edges of slaves.
+ *
+ * Slaves in redundant edge mode repeat their latest edges in every data
+ * frame. The handler is called from the receive callback once for every edge
+ * that was not reported before, so a tap whose press and release frames were
+ * both lost is still reported when the next frame arrives.
+ *
+ * @param[in] handler The handler, or nullptr to remove it.
+ */
+void EmcEspNow::onEdge(EdgeHandler handler)
+{
+    edgeHandler = handler;
+}
+
+/**
+ * @brief Calls the deferred handlers.
+ *
+ * Runs in the context that calls update(), or in the ESP-NOW task when it is
+ * running. Commands are passed in the order they were received; slave data is
+ * read from the receive slots, so a slave that changed several times since the
+ * last dispatch is reported once with its latest data.
+ */
+void EmcEspNow::dispatch()
+{
+    if (commandHandler && commandDeferred)
     {
-        if (memcmp(recv_info->des_addr, BROADCAST_MAC_SLAVE, 6) == 0)
+        master_cmd_t cmd;
+        while (cmdDispatchQueue.pop(cmd))
         {
-            sendBroadcast();
-            if (!esp_now_is_peer_exist(recv_info->src_addr))
-            {
-                addPeer(recv_info->src_addr);
-            }
+            commandHandler(cmd);
         }
+    }
 
-        if (len == sizeof(slave_data_t))
+    if (slaveDataHandler && slaveDataDeferred)
+    {
+        for (uint8_t i = 1; i < ESPNOW_MAX_PEERS; i++)
         {
-            if (memcmp(&masterRecvData, data, sizeof(slave_data_t)) != 0)
+            slave_slot_t slot;
+            if (masterRecvData[i].tryLoad(slot, dispatchSeen[i]))
             {
-                memcpy(&masterRecvData, data, sizeof(slave_data_t));
+                slaveDataHandler(i, slot.data);
             }
         }
     }
+}
+
+/**
+ * @brief Enables or disables delta encoding of the slave uplink.
+ *
+ * In compact mode, a change of slaveSendData only sends the 32-bit words that
+ * differ from the last keyframe, typically 8 payload bytes instead of 80 for a
+ * single button. The master must run a firmware that understands
+ * FRAME_SLAVE_DELTA; full frames are always understood.
+ *
+ * @param[in] enabled true to send deltas.
+ * @param[in] keyframeIntervalMs Interval in milliseconds for full keyframes.
+ */
+void EmcEspNow::setCompactUplink(bool enabled, unsigned long keyframeIntervalMs)
+{
+    compactUplink = enabled;
+    this->keyframeIntervalMs = keyframeIntervalMs;
+    forceKeyframe = true;
+}
+
+/**
+ * @brief Enables or disables redundant transmission of button edges.
+ *
+ * A lost frame normally costs a retry backoff, and a run of lost frames can
+ * even remove the master. In redundant edge mode every frame with a new
+ * button edge is sent @p copies times, @p spacingUs apart, without waiting
+ * for its send status. All copies carry the same sequence number, so the
+ * master accepts the first one that arrives and drops the others as
+ * duplicates. Only when every copy failed is the frame retried and counted
+ * as a failure of the link. Changes of the analog data alone are sent once.
+ *
+ * Every FRAME_SLAVE_DATA and FRAME_SLAVE_DELTA frame also carries the last
+ * ESPNOW_EDGE_HISTORY edges of the last ESPNOW_EDGE_HOLD_MS with their
+ * timestamps, see onEdge(). The master needs this version of the library to
+ * understand the edge block.
+ *
+ * @param[in] enabled true to send copies and edges.
+ * @param[in] copies Transmissions of every frame with a new edge, including the first.
+ * @param[in] spacingUs Time in microseconds between two copies.
+ */
+void EmcEspNow::setRedundantEdges(bool enabled, uint8_t copies, unsigned long spacingUs)
+{
+    redundantEdges = enabled;
+    edgeCopies = copies > 0 ? copies : 1;
+    edgeSpacingUs = spacingUs;
+}
+
+/**
+ * @brief Configures how unacknowledged frames are retried and when a peer is dropped.
+ *
+ * A frame that was not acknowledged is resent up to @p maxRetries times with
+ * exponential backoff, unless a newer frame to the same peer was sent in the
+ * meantime. A peer is only removed after @p evictFailures consecutive
+ * frames were given up after their last resend, or when it keeps failing and
+ * nothing was acknowledged for @p timeoutMs.
+ *
+ * @param[in] maxRetries Resends of one frame.
+ * @param[in] backoffUs Delay in microseconds before the first resend.
+ * @param[in] evictFailures Consecutive frames given up that remove a peer.
+ * @param[in] timeoutMs Time in milliseconds without acknowledge that removes a failing peer.
+ */
+void EmcEspNow::setRetryPolicy(uint8_t maxRetries, unsigned long backoffUs, uint16_t evictFailures, unsigned long timeoutMs)
+{
+    this->maxRetries = maxRetries;
+    retryBackoffUs = backoffUs;
+    this->evictFailures = evictFailures;
+    peerTimeoutMs = timeoutMs;
+}
+
+/**
+ * @brief Switches WiFi modem sleep on or off for the ESP-NOW link.
+ *
+ * Uses the connectionless power save of the WiFi driver, as there is no
+ * access point whose beacons could time the wake-ups. Outgoing frames wake
+ * the radio on their own; incoming frames are only received within the wake
+ * window, so the peer's retries and the link timeouts should allow for the
+ * wake interval.
+ *
+ * @param[in] enabled true to let the radio sleep between wake windows.
+ * @param[in] wakeIntervalMs The interval in which the radio wakes up.
+ * @param[in] wakeWindowMs The time the radio stays awake per interval.
+ */
+void EmcEspNow::setPowerSave(bool enabled, uint16_t wakeIntervalMs, uint16_t wakeWindowMs)
+{
+    if (enabled)
+    {
+        esp_now_set_wake_window(wakeWindowMs);
+        esp_wifi_connectionless_module_set_wake_interval(wakeIntervalMs);
+        esp_wifi_set_ps(WIFI_PS_MIN_MODEM);
+    }
     else
     {
-        if (memcmp(recv_info->des_addr, BROADCAST_MAC_MASTER, 6) == 0)
-        {
-            if (!esp_now_is_peer_exist(recv_info->src_addr))
-            {
-                addPeer(recv_info->src_addr);
-            }
-        }
-
-        if (len == sizeof(master_cmd_t))
-        {
-            masterHasCommand = true;
-            if (memcmp(&masterCmdData, data, sizeof(master_cmd_t)) != 0)
-            {
-                memcpy(&masterCmdData, data, sizeof(master_cmd_t));
-            }
-            masterHasCommand = false;
-        }
+        esp_wifi_set_ps(WIFI_PS_NONE);
     }
 }
 
 /**
- * @brief Called when a message is sent using the esp_now_send() function.
+ * @brief Enables or disables the scheduled (TDMA) mode of a master.
  *
- * This function is called when a message is sent using the esp_now_send() function.
- * If the message fails to send, it removes the peer from the list of peers.
+ * The master broadcasts a FRAME_SYNC from an esp_timer at the start of every
+ * cycle. The cycle has one slot per peer ID up to the highest one in use:
+ * slot 0 for the master's command frames, slot n for the slave with peer ID
+ * n. A slave finds its slot by its MAC address in the sync and sends all its
+ * frames to the master there, at most one per slot. Frames that need a
+ * resend wait for the next slot, so slaves no longer collide and retry into
+ * each other, and a change waits at most one cycle.
  *
- * @param[in] mac_addr The MAC address of the device that sent the message.
- * @param[in] status The status of the message send operation.
+ * Slaves follow the syncs whenever their master sends them, and transmit
+ * freely again when the syncs stop. Application frames sent with
+ * sendUnicast() are not scheduled.
+ *
+ * @param[in] enabled true to send syncs.
+ * @param[in] slotUs The length of one slot.
+ * @param[in] guardUs The time at the end of a slot in which no frame starts.
+ * @return false if @p guardUs is not shorter than @p slotUs.
  */
-void EmcEspNow::onSend(const uint8_t *mac_addr, esp_now_send_status_t status)
+bool EmcEspNow::setScheduled(bool enabled, uint16_t slotUs, uint16_t guardUs)
 {
-    if (status == ESP_NOW_SEND_FAIL)
+    if (guardUs >= slotUs)
     {
-        log_d("Failed to send unicast, removing peer...");
-        instance->removePeer(mac_addr);
+        return false;
     }
+
+    tdmaSlotUs = slotUs;
+    tdmaGuardUs = guardUs;
+    scheduled = enabled;
+    notify(); // The task starts or stops the sync timer
+    return true;
 }
 
 /**
- * @brief Periodic task to update the ESP-NOW communication.
+ * @brief Checks whether transmissions follow the schedule.
  *
- * This task is responsible for periodically sending the latest data to all
- * peers in the ESP-NOW network. If the device is in master mode, it sends the
- * latest command data to all slave devices. If the device is in slave mode, it
- * sends the latest data to the master device.
+ * @return On a master, true if scheduled mode is enabled. On a slave, true
+ * while the syncs of its master are current and assign it a slot.
  */
-void EmcEspNow::espNowTask(void *pvParameters)
+bool EmcEspNow::isScheduled() const
 {
-    while (true)
+    if (isMaster)
     {
-        instance->update();
-        vTaskDelay(1 / portTICK_PERIOD_MS); // 1 ms delay between updates
+        return scheduled;
     }
+    tdma_slot_t slot;
+    return currentSlot(slot);
+}
+
+/**
+ * @brief Rebuilds the slot table and keeps the sync timer at the cycle length.
+ *
+ * Runs in the transmit context of the master, the only writer of the slot
+ * table. The timer only reads it, so a peer that joins or leaves changes the
+ * next sync. Without any slave there is nothing to schedule and no sync is
+ * sent.
+ */
+void EmcEspNow::updateSchedule()
+{
+    unsigned long cycleUs = 0;
+    if (scheduled)
+    {
+        tdma_beacon_t beacon;
+        memset(&beacon, 0, sizeof(tdma_beacon_t));
+        uint8_t slotCount = 1;
+        for (const auto &peer : peers)
+        {
+            if (peer.peerID == 0)
+                continue; // The broadcast peer has no slot, slot 0 is the master's own
+
+            memcpy(beacon.macs[peer.peerID - 1], peer.peer_mac, 6);
+            if (peer.peerID + 1 > slotCount)
+                slotCount = peer.peerID + 1;
+        }
+        beacon.sync.slotUs = tdmaSlotUs;
+        beacon.sync.windowUs = tdmaSlotUs - tdmaGuardUs;
+        beacon.sync.slotCount = slotCount;
+
+        if (memcmp(&beacon, &tdmaBeacon.writerView(), sizeof(tdma_beacon_t)) != 0)
+        {
+            tdmaBeacon.store(beacon);
+        }
+        cycleUs = slotCount > 1 ? (unsigned long)slotCount * tdmaSlotUs : 0;
+    }
+
+    if (cycleUs == tdmaCycleUs || !tdmaTimer)
+    {
+        return;
+    }
+
+    // The cycle length changed, restart the syncs with the new period
+    esp_timer_stop(tdmaTimer);
+    tdmaCycleUs = cycleUs;
+    if (cycleUs > 0)
+    {
+        esp_timer_start_periodic(tdmaTimer, cycleUs);
+    }
+}
+
+/**
+ * @brief Broadcasts the sync that starts a cycle.
+ *
+ * Runs in the esp_timer task, so the cycle keeps its period whatever the
+ * ESP-NOW task or loop() are doing. The sync has its own sequence counter
+ * and is not acknowledged. The task is woken afterwards, because slot 0 is
+ * the time for the master's command frames.
+ */
+void EmcEspNow::sendSync()
+{
+    tdma_beacon_t beacon;
+    if (tdmaBeacon.load(beacon) == 0 || beacon.sync.slotCount < 2)
+    {
+        return;
+    }
+
+    uint8_t frame[ESP_NOW_MAX_DATA_LEN];
+    size_t len = sizeof(tdma_sync_t) + (beacon.sync.slotCount - 1) * 6;
+    frame_header_t *header = (frame_header_t *)frame;
+    header->type = FRAME_SYNC;
+    header->version = ESPNOW_PROTOCOL_VERSION;
+    header->seq = tdmaSyncSeq++;
+    header->timestamp = (uint32_t)esp_timer_get_time();
+    memcpy(frame + sizeof(frame_header_t), &beacon, len);
+
+    tdmaSyncMicros = header->timestamp;
+    esp_now_send(BROADCAST_MAC_MASTER, frame, sizeof(frame_header_t) + len);
+    notify();
+}
+
+/**
+ * @brief Takes the own slot from a sync of the master.
+ *
+ * Runs in the WiFi task. The slot is timed from the arrival of the sync;
+ * every slave hears it at almost the same moment, so the slots keep their
+ * order. A slave that is not in the slot table yet, because the master just
+ * added it, transmits freely until the next sync lists it. The slot timer is
+ * armed for the start of the slot and then repeats once per cycle, so a
+ * missed sync does not cost the slot.
+ *
+ * @param[in] payload The payload of the FRAME_SYNC frame.
+ * @param[in] len The length of the payload.
+ */
+void EmcEspNow::followSync(const uint8_t *payload, int len)
+{
+    tdma_sync_t sync;
+    if (len < (int)sizeof(tdma_sync_t))
+    {
+        return;
+    }
+    memcpy(&sync, payload, sizeof(tdma_sync_t));
+    if (sync.slotCount < 2 || sync.slotCount > ESPNOW_MAX_PEERS || sync.windowUs == 0 || sync.windowUs > sync.slotUs ||
+        len != (int)(sizeof(tdma_sync_t) + (sync.slotCount - 1) * 6))
+    {
+        return;
+    }
+
+    tdma_slot_t slot;
+    slot.syncMicros = (uint32_t)esp_timer_get_time();
+    slot.cycleUs = (uint32_t)sync.slotCount * sync.slotUs;
+    slot.offsetUs = 0;
+    slot.windowUs = sync.windowUs;
+
+    const uint8_t *macs = payload + sizeof(tdma_sync_t);
+    for (uint8_t n = 1; n < sync.slotCount; n++)
+    {
+        if (memcmp(macs + (n - 1) * 6, ownMac, 6) == 0)
+        {
+            slot.offsetUs = (uint32_t)n * sync.slotUs;
+            break;
+        }
+    }
+    tdmaSlot.store(slot);
+
+    if (tdmaTimer && slot.offsetUs > 0)
+    {
+        esp_timer_stop(tdmaTimer);
+        esp_timer_start_once(tdmaTimer, slot.offsetUs);
+    }
+}
+
+/**
+ * @brief Copies the own slot while the syncs of the master are current.
+ *
+ * @param[out] out The own slot.
+ * @return false if the slave has no slot or missed ESPNOW_TDMA_SYNC_LOST_CYCLES syncs.
+ */
+bool EmcEspNow::currentSlot(tdma_slot_t &out) const
+{
+    if (tdmaSlot.load(out) == 0 || out.offsetUs == 0)
+    {
+        return false;
+    }
+    uint32_t sinceSync = (uint32_t)esp_timer_get_time() - out.syncMicros;
+    return sinceSync < out.cycleUs * ESPNOW_TDMA_SYNC_LOST_CYCLES;
+}
+
+/**
+ * @brief Checks whether the schedule lets this device transmit now.
+ *
+ * A scheduled master starts its command frames in the window of slot 0,
+ * right after its sync. A scheduled slave sends to the master within the
+ * window of its own slot, one frame per slot; the cycles after a missed sync
+ * are extrapolated from the last one.
+ *
+ * @return true if the device may transmit, always true without a schedule.
+ */
+bool EmcEspNow::slotOpen() const
+{
+    uint32_t now = (uint32_t)esp_timer_get_time();
+    if (isMaster)
+    {
+        return !scheduled || tdmaCycleUs == 0 || now - tdmaSyncMicros < (uint32_t)(tdmaSlotUs - tdmaGuardUs);
+    }
+
+    tdma_slot_t slot;
+    if (!currentSlot(slot))
+    {
+        return true;
+    }
+
+    uint32_t inCycle = (now - slot.syncMicros) % slot.cycleUs;
+    if (inCycle < slot.offsetUs || inCycle >= slot.offsetUs + slot.windowUs)
+    {
+        return false;
+    }
+
+    // One frame per slot, a resend waits for the next one
+    uint32_t windowStart = now - (inCycle - slot.offsetUs);
+    return (int32_t)(txSlots[1].sentMicros - windowStart) < 0;
+}
+
+/**
+ * @brief esp_timer callback of the schedule.
+ *
+ * On a master it sends the sync of the next cycle. On a slave its slot
+ * begins: the ESP-NOW task is woken to transmit, and the timer is armed for
+ * the same slot in the next cycle as long as the syncs are current. A
+ * free-running slave uses the timer to wake the task for its next redundant
+ * copy, see armCopyTimer().
+ *
+ * @param[in] arg The EmcEspNow instance.
+ */
+void EmcEspNow::onScheduleTimer(void *arg)
+{
+    EmcEspNow *self = (EmcEspNow *)arg;
+    if (self->isMaster)
+    {
+        self->sendSync();
+        return;
+    }
+
+    self->notify();
+    tdma_slot_t slot;
+    if (self->currentSlot(slot))
+    {
+        esp_timer_start_once(self->tdmaTimer, slot.cycleUs);
+    }
+}
+
+/**
+ * @brief Enables or disables automatic channel selection.
+ *
+ * Must be called before begin(). A master then surveys the channels at
+ * begin() and changes channel at runtime when too many frames fail; the
+ * slaves are told in advance with a FRAME_CHANNEL frame. A slave walks
+ * through all channels while it discovers, so it also finds a master that
+ * moved while it missed the announcement.
+ *
+ * @param[in] enabled true to select the channel automatically.
+ * @param[in] lossThreshold Share of failed frames (0..1) in one evaluation window that triggers a change.
+ */
+void EmcEspNow::setAutoChannel(bool enabled, float lossThreshold)
+{
+    autoChannel = enabled;
+    hopLossThreshold = lossThreshold;
+}
+
+/**
+ * @brief Scans for access points and picks the channel with the least interference.
+ *
+ * Every access point adds a load based on its signal strength to its own
+ * channel, and a reduced load to the overlapping neighbour channels. The
+ * scores are kept, so a later channel change can pick the next best channel
+ * without scanning again.
+ *
+ * @return The channel with the lowest score.
+ */
+uint8_t EmcEspNow::surveyChannels()
+{
+    memset(channelScore, 0, sizeof(channelScore));
+
+    int16_t count = WiFi.scanNetworks(false, true, false, 80);
+    for (int16_t i = 0; i < count; i++)
+    {
+        int32_t apChannel = WiFi.channel(i);
+        int32_t load = WiFi.RSSI(i) + 100; // -100 dBm costs nothing, stronger is worse
+        if (load <= 0)
+            continue;
+
+        for (uint8_t c = ESPNOW_CHANNEL_MIN; c <= ESPNOW_CHANNEL_MAX; c++)
+        {
+            int32_t distance = abs((int32_t)c - apChannel);
+            if (distance == 0)
+                channelScore[c] += load;
+            else if (distance <= 2)
+                channelScore[c] += load / 2;
+            else if (distance <= 4)
+                channelScore[c] += load / 4;
+        }
+    }
+    WiFi.scanDelete();
+
+    uint8_t best = channel;
+    for (uint8_t c = ESPNOW_CHANNEL_MIN; c <= ESPNOW_CHANNEL_MAX; c++)
+    {
+        if (channelScore[c] < channelScore[best])
+            best = c;
+    }
+    EMC_LOGD("Channel survey: %d access points, using channel %d\n", count, best);
+    return best;
+}
+
+/**
+ * @brief Moves WiFi and all registered peers to another channel.
+ *
+ * @param[in] newChannel The channel to switch to.
+ */
+void EmcEspNow::switchChannel(uint8_t newChannel)
+{
+    channel = newChannel;
+    WiFi.setChannel(channel);
+
+    for (const auto &peer : peers)
+    {
+        esp_now_peer_info_t info;
+        memset(&info, 0, sizeof(esp_now_peer_info_t));
+        memcpy(info.peer_addr, peer.peer_mac, 6);
+        info.channel = channel;
+        info.encrypt = false;
+        esp_now_mod_peer(&info);
+    }
+}
+
+/**
+ * @brief Runs scheduled channel switches and watches the loss on the channel.
+ *
+ * On the master, the share of failed frames to all slaves is evaluated once
+ * per ESPNOW_HOP_CHECK_MS. Above the loss threshold, the current channel is
+ * penalised and the best other channel from the survey is announced to the
+ * slaves, repeatedly until the switch happens ESPNOW_HOP_DELAY_MS later. A
+ * slave runs the switch it was told about.
+ */
+void EmcEspNow::updateChannel()
+{
+    unsigned long now = millis();
+
+    if (pendingChannel)
+    {
+        if ((long)(now - channelSwitchMillis) >= 0)
+        {
+            EMC_LOGD("Switching to channel %d\n", pendingChannel);
+            switchChannel(pendingChannel);
+            pendingChannel = 0;
+        }
+        else if (isMaster && now - channelAnnounceMillis >= ESPNOW_HOP_DELAY_MS / 4)
+        {
+            // Repeat the announcement, so a slave that misses one frame still follows
+            channelAnnounceMillis = now;
+            channel_switch_t announce;
+            announce.channel = pendingChannel;
+            announce.delayMs = channelSwitchMillis - now;
+            for (const auto &peer : peers)
+            {
+                if (peer.peerID != 0)
+                    sendFrame(peer.peer_mac, peer.peerID, FRAME_CHANNEL, &announce, sizeof(announce));
+            }
+        }
+        return;
+    }
+
+    if (!isMaster || !autoChannel || now - hopCheckMillis < ESPNOW_HOP_CHECK_MS)
+    {
+        return;
+    }
+    hopCheckMillis = now;
+
+    uint32_t txOk = 0;
+    uint32_t txFail = 0;
+    for (const auto &peer : peers)
+    {
+        if (peer.peerID == 0)
+            continue;
+        txOk += peerStats[peer.peerID].txOk;
+        txFail += peerStats[peer.peerID].txFail;
+    }
+
+    // Counters of removed peers are gone, so a shrinking total starts a new window
+    uint32_t sent = (txOk - hopTxOk) + (txFail - hopTxFail);
+    bool valid = txOk >= hopTxOk && txFail >= hopTxFail && sent >= 20;
+    float loss = valid ? (float)(txFail - hopTxFail) / sent : 0;
+    hopTxOk = txOk;
+    hopTxFail = txFail;
+
+    if (loss <= hopLossThreshold)
+    {
+        return;
+    }
+
+    // Do not come back to this channel soon, then take the best remaining one
+    channelScore[channel] += 1000;
+    uint8_t best = channel == ESPNOW_CHANNEL_MIN ? ESPNOW_CHANNEL_MIN + 1 : ESPNOW_CHANNEL_MIN;
+    for (uint8_t c = ESPNOW_CHANNEL_MIN; c <= ESPNOW_CHANNEL_MAX; c++)
+    {
+        if (c != channel && channelScore[c] < channelScore[best])
+            best = c;
+    }
+
+    EMC_LOGD("Loss %u%% on channel %d, moving to channel %d\n", (unsigned)(loss * 100), channel, best);
+    scheduleChannel(best);
+}
+
+/**
+ * @brief Schedules a channel switch of the master and its slaves.
+ *
+ * The switch happens ESPNOW_HOP_DELAY_MS from now; until then updateChannel()
+ * repeats the announcement to the slaves.
+ *
+ * @param[in] newChannel The channel to switch to.
+ */
+void EmcEspNow::scheduleChannel(uint8_t newChannel)
+{
+    unsigned long now = millis();
+    channelSwitchMillis = now + ESPNOW_HOP_DELAY_MS;
+    channelAnnounceMillis = now - ESPNOW_HOP_DELAY_MS; // Announce right away
+    pendingChannel = newChannel;
+    notify();
+}
+
+/**
+ * @brief Selects the WiFi channel.
+ *
+ * Before begin(), this only sets the channel that begin() starts on; with
+ * automatic channel selection, the master's survey still overrides it. A
+ * running master switches in coordination with its slaves, see
+ * scheduleChannel(). A running slave always follows its master.
+ *
+ * @param[in] newChannel The channel to use.
+ * @return true if the channel was set or the switch was scheduled.
+ */
+bool EmcEspNow::setChannel(uint8_t newChannel)
+{
+    if (newChannel < ESPNOW_CHANNEL_MIN || newChannel > ESPNOW_CHANNEL_MAX)
+    {
+        return false;
+    }
+
+    if (instance != this)
+    {
+        channel = newChannel;
+        return true;
+    }
+
+    if (!isMaster || pendingChannel)
+    {
+        return false;
+    }
+    if (newChannel != channel)
+    {
+        scheduleChannel(newChannel);
+    }
+    return true;
+}
+
+/**
+ * @brief Configures how often the master sends its command to each slave.
+ *
+ * A changed command is sent on the next update(). An unchanged command is
+ * only repeated every @p keepAliveMs as a keep-alive. Independently, no slave
+ * receives more than @p maxFrameRate command frames per second; queued
+ * commands wait for the next frame and are sent together in one batch.
+ *
+ * @param[in] keepAliveMs Interval in milliseconds for repeating an unchanged command.
+ * @param[in] maxFrameRate Maximum number of command frames per second and slave.
+ */
+void EmcEspNow::setCommandRate(unsigned long keepAliveMs, unsigned long maxFrameRate)
+{
+    cmdKeepAliveMs = keepAliveMs;
+    cmdMinIntervalUs = maxFrameRate ? 1000000UL / maxFrameRate : 0;
+}
+
+/**
+ * @brief Resets the data used for communication to its initial state.
+ *
+ * This function is used to reset the data used for communication with the
+ * master device to its initial state. This is necessary to prevent any
+ * further communication with the master device after the connection has been
+ * closed. The readers are moved to the reset sequences, so the zeroed slots
+ * are not reported as new data; only frames received afterwards are.
+ */
+void EmcEspNow::resetData()
+{
+    // Reset the data used for communication
+    memset(&slaveSendData, 0, sizeof(slave_data_t));
+    memset(&lastSlaveSendData, 0, sizeof(slave_data_t));
+    memset(&masterCmdData, 0, sizeof(master_cmd_t));
+    memset(&lastmasterCmdData, 0, sizeof(master_cmd_t));
+
+    // The WiFi task writes the same sequence locks, see storeSlaveData()
+    portENTER_CRITICAL(&peerLock);
+    for (uint8_t i = 0; i < ESPNOW_MAX_PEERS; i++)
+    {
+        masterRecvData[i].reset();
+        masterRecvSeen[i] = masterRecvData[i].sequence();
+        masterMergedSeen[i] = masterRecvSeen[i];
+        dispatchSeen[i] = masterRecvSeen[i];
+    }
+    slaveRecvCmd.reset();
+    slaveRecvCmdSeen = slaveRecvCmd.sequence();
+    portEXIT_CRITICAL(&peerLock);
+}
+
+/**
+ * @brief Returns the master's current command.
+ *
+ * onReceive() publishes it only when it changed, so keep-alive repeats are
+ * not reported again. It goes through a sequence lock, so this
+ * can be polled from loop() without any locking. A snapshot that was being
+ * overwritten during the copy is discarded and picked up on the next call.
+ *
+ * @param[out] out The latest command.
+ * @return true if a new command was copied to @p out.
+ */
+bool EmcEspNow::tryGetLatest(master_cmd_t &out)
+{
+    return slaveRecvCmd.tryLoad(out, slaveRecvCmdSeen);
+}
+
+/**
+ * @brief Merges the latest data received from all slaves.
+ *
+ * Every slave has its own receive slot, so two button boxes never overwrite
+ * each other. The button bits of all slots are OR'ed together; the analog
+ * data is taken from the slave with the lowest peer ID that sent anything.
+ *
+ * @param[out] out The merged slave data.
+ * @return true if any slot changed since the last call.
+ */
+bool EmcEspNow::tryGetLatest(slave_data_t &out)
+{
+    bool changed = false;
+    bool haveData = false;
+    slave_data_t merged;
+
+    for (uint8_t i = 1; i < ESPNOW_MAX_PEERS; i++)
+    {
+        slave_slot_t slot;
+        uint32_t seen = masterRecvData[i].load(slot);
+        if (seen == 0)
+        {
+            continue; // Slot never written
+        }
+
+        if (seen != masterMergedSeen[i])
+        {
+            masterMergedSeen[i] = seen;
+            changed = true;
+        }
+
+        for (uint8_t b = 0; b < sizeof(merged.button_data); b++)
+        {
+            merged.button_data[b] |= slot.data.button_data[b];
+        }
+
+        if (!haveData)
+        {
+            memcpy(merged.data, slot.data.data, sizeof(merged.data));
+            haveData = true;
+        }
+    }
+
+    if (changed)
+    {
+        memcpy(&out, &merged, sizeof(slave_data_t));
+    }
+    return changed;
+}
+
+/**
+ * @brief Returns the latest data received from one slave.
+ *
+ * @param[in] peerID The peer ID of the slave.
+ * @param[out] out The latest data of that slave.
+ * @param[out] recvMicros Optional receive timestamp of the data.
+ * @return true if new data was copied to @p out.
+ */
+bool EmcEspNow::tryGetLatest(uint8_t peerID, slave_data_t &out, unsigned long *recvMicros)
+{
+    if (peerID >= ESPNOW_MAX_PEERS)
+    {
+        return false;
+    }
+
+    slave_slot_t slot;
+    if (!masterRecvData[peerID].tryLoad(slot, masterRecvSeen[peerID]))
+    {
+        return false;
+    }
+
+    memcpy(&out, &slot.data, sizeof(slave_data_t));
+    if (recvMicros)
+    {
+        *recvMicros = slot.recvMicros;
+    }
+    return true;
+}
+
+/**
+ * @brief Checks whether new data is waiting in a slave slot.
+ *
+ * @param[in] peerID The peer ID of the slave.
+ * @return true if the slot was written since it was last read.
+ */
+bool EmcEspNow::isUpdated(uint8_t peerID) const
+{
+    return peerID < ESPNOW_MAX_PEERS && masterRecvData[peerID].sequence() != masterRecvSeen[peerID];
+}
+
+/**
+ * @brief Sends a broadcast message to all peers in the ESP-NOW network.
+ *
+ * This function is used to send a broadcast message to all peers in the ESP-NOW
+ * network. The message is sent as a FRAME_DISCOVERY frame and the broadcast MAC
+ * address of the slave or master device is used as the destination address
+ * depending on the mode of the device.
+ */
+void EmcEspNow::sendBroadcast()
+{
+    // Send the broadcast message using the broadcast MAC address of the slave or master device
+    if (!isMaster)
+    {
+        // Send the broadcast message to all slave devices
+        sendFrame(BROADCAST_MAC_SLAVE, 0, FRAME_DISCOVERY, BROADCAST_SLAVE_MESSAGE, strlen(BROADCAST_SLAVE_MESSAGE));
+    }
+    else
+    {
+        // Send the broadcast message to all master devices
+        sendFrame(BROADCAST_MAC_MASTER, 0, FRAME_DISCOVERY, BROADCAST_MASTER_MESSAGE, strlen(BROADCAST_MASTER_MESSAGE));
+    }
+}
+
+/**
+ * @brief Sends a unicast message to a specific peer in the ESP-NOW network.
+ *
+ * This function is used to send a unicast message to a specific peer in the ESP-NOW
+ * network. The payload is sent behind a frame header carrying its type and the
+ * next sequence number for that peer.
+ *
+ * @param[in] peer_mac The MAC address of the peer device to send the message to.
+ * @param[in] type The frame type of the payload.
+ * @param[in] data The payload to be sent to the peer device.
+ * @param[in] len The length of the payload.
+ */
+void EmcEspNow::sendUnicast(const uint8_t *peer_mac, FrameType type, const uint8_t *data, size_t len)
+{
+    int peerID = findPeer(peer_mac);
+    if (peerID < 0)
+    {
+        EMC_LOGE("Unicast to unknown peer");
+        return;
+    }
+
+    sendFrame(peer_mac, peerID, type, data, len);
+}
+
+/**
+ * @brief Builds a frame from a header and a payload and sends it.
+ *
+ * Every peer ID has its own sequence counter, so a receiver sees consecutive
+ * numbers and can count gaps as lost frames.
+ *
+ * @param[in] peer_mac The MAC address to send the frame to.
+ * @param[in] peerID The peer ID of the destination.
+ * @param[in] type The frame type of the payload.
+ * @param[in] data The payload.
+ * @param[in] len The length of the payload.
+ * @return The sequence number of the frame.
+ */
+uint16_t EmcEspNow::sendFrame(const uint8_t *peer_mac, uint8_t peerID, FrameType type, const void *data, size_t len)
+{
+    if (len > ESPNOW_MAX_PAYLOAD_LEN)
+    {
+        EMC_LOGE("Payload too long: %u", (unsigned)len);
+        return txSeq[peerID];
+    }
+
+    // The frame is built in the peer's transmit slot, so it can be resent; a newer frame replaces a pending retry,
+    // except for a command batch, see cmdBatchOpen()
+    tx_slot_t &slot = txSlots[peerID];
+    slot.retryPending = false;
+    slot.copiesLeft = 0;
+    slot.acked = false;
+    slot.frameTxCount = slot.txCount;
+    slot.attempts = 0;
+    slot.len = sizeof(frame_header_t) + len;
+    slot.sentMillis = millis();
+
+    frame_header_t *header = (frame_header_t *)slot.frame;
+    header->type = type;
+    header->version = ESPNOW_PROTOCOL_VERSION;
+    header->seq = txSeq[peerID]++;
+    header->timestamp = (uint32_t)esp_timer_get_time();
+    slot.sentMicros = header->timestamp;
+    if (len > 0)
+    {
+        memcpy(slot.frame + sizeof(frame_header_t), data, len);
+    }
+
+    if (esp_now_send(peer_mac, slot.frame, slot.len) == ESP_OK)
+    {
+        slot.txCount++;
+    }
+    return header->seq;
+}
+
+/**
+ * @brief Resends frames that failed and whose backoff elapsed.
+ *
+ * A resent frame keeps its sequence number, so a receiver that did get the
+ * first copy and only the acknowledge was lost drops it as a duplicate. The
+ * redundant copies of redundant edge mode go out the same way, on their own
+ * schedule.
+ */
+void EmcEspNow::processRetries()
+{
+    unsigned long now = micros();
+    for (const auto &peer : peers)
+    {
+        tx_slot_t &slot = txSlots[peer.peerID];
+        if (slot.copiesLeft && (long)(now - slot.copyAtMicros) >= 0)
+        {
+            if (!isMaster && peer.peerID == 1 && !slotOpen())
+                continue; // Scheduled: one copy per slot
+
+            slot.copiesLeft--;
+            slot.copyAtMicros = now + edgeSpacingUs;
+            peerStats[peer.peerID].txCopies++;
+            slot.sentMicros = (uint32_t)esp_timer_get_time();
+            if (esp_now_send(peer.peer_mac, slot.frame, slot.len) == ESP_OK)
+            {
+                slot.txCount++;
+            }
+            if (slot.copiesLeft)
+            {
+                armCopyTimer();
+            }
+            continue;
+        }
+
+        if (slot.retryPending && (long)(now - slot.retryAtMicros) >= 0)
+        {
+            if (!isMaster && peer.peerID == 1 && !slotOpen())
+                continue; // Scheduled: the resend waits for the own slot
+
+            slot.retryPending = false;
+            peerStats[peer.peerID].txRetries++;
+            slot.sentMicros = (uint32_t)esp_timer_get_time();
+            if (esp_now_send(peer.peer_mac, slot.frame, slot.len) == ESP_OK)
+            {
+                slot.txCount++;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Checks a received sequence number against the last one of the peer.
+ *
+ * A frame with the same or a slightly older sequence number is a duplicate or
+ * arrived out of order and is dropped. A gap is counted as lost frames. A
+ * sequence number far behind the last one means the sender restarted, so the
+ * peer's sequence is resynchronised.
+ *
+ * @param[in] peerID The peer ID of the sender.
+ * @param[in] header The header of the received frame.
+ * @return true if the frame is new and should be processed.
+ */
+bool EmcEspNow::acceptSequence(uint8_t peerID, const frame_header_t *header)
+{
+    peer_stats_t &stats = peerStats[peerID];
+    if (stats.seqValid)
+    {
+        int16_t diff = (int16_t)(header->seq - stats.lastSeq);
+        if (diff <= 0 && diff > -ESPNOW_SEQ_REORDER_WINDOW)
+        {
+            stats.rxDropped++;
+            return false;
+        }
+        if (diff > 0)
+        {
+            stats.rxLost += diff - 1;
+        }
+    }
+
+    stats.lastSeq = header->seq;
+    stats.seqValid = true;
+    stats.lastTimestamp = header->timestamp;
+    stats.lastRxMillis = millis();
+    stats.rxFrames++;
+    return true;
+}
+
+/**
+ * @brief Returns the receive statistics of a peer.
+ *
+ * @param[in] peerID The peer ID.
+ * @return Pointer to the statistics, or nullptr if the ID is not in use.
+ */
+const peer_stats_t *EmcEspNow::getPeerStats(uint8_t peerID) const
+{
+    return peers.get(peerID) ? &peerStats[peerID] : nullptr;
+}
+
+/**
+ * @brief Collects the counters of a peer and the local histograms into one report.
+ *
+ * This is the report a slave sends to the master, so the same numbers can be
+ * read locally, e.g. on the serial monitor, and remotely.
+ *
+ * @param[in] peerID The peer ID.
+ * @param[out] out The statistics.
+ * @return false if the ID is not in use.
+ */
+bool EmcEspNow::getLinkStats(uint8_t peerID, link_stats_t &out) const
+{
+    const peer_stats_t *stats = getPeerStats(peerID);
+    if (!stats)
+    {
+        return false;
+    }
+
+    out.uptimeMs = millis();
+    out.txOk = stats->txOk;
+    out.txFail = stats->txFail;
+    out.txRetries = stats->txRetries;
+    out.rxFrames = stats->rxFrames;
+    out.rxLost = stats->rxLost;
+    out.rxDropped = stats->rxDropped;
+    out.rssi = stats->rssi;
+    out.noiseFloor = stats->noiseFloor;
+    out.linkState = linkStates[peerID];
+    out.channel = channel;
+    for (uint8_t i = 0; i < HIST_COUNT; i++)
+    {
+        histograms[i].summarize(out.histograms[i]);
+    }
+    return true;
+}
+
+/**
+ * @brief Clears the traffic counters of all peers and the local histograms.
+ *
+ * The sequence tracking, RSSI and link timing of the peers are kept, so the
+ * link is not disturbed.
+ */
+void EmcEspNow::resetStats()
+{
+    for (peer_stats_t &stats : peerStats)
+    {
+        stats.rxFrames = 0;
+        stats.rxLost = 0;
+        stats.rxDropped = 0;
+        stats.txOk = 0;
+        stats.txFail = 0;
+        stats.txRetries = 0;
+    }
+    for (EmcHistogram &histogram : histograms)
+    {
+        histogram.reset();
+    }
+}
+
+/**
+ * @brief Asks all slaves for a statistics report.
+ *
+ * The query is an ordinary queued command, so it reaches the slaves in the
+ * next command frame. A slave recognises it by its mainId, answers with
+ * FRAME_STATS and does not pass it on to its command handlers.
+ *
+ * @param[in] reset true to let the slaves clear their statistics after the report.
+ * @return false if the command queue is full.
+ */
+bool EmcEspNow::requestStats(bool reset)
+{
+    master_cmd_t query;
+    query.mainId = ESPNOW_CMD_STATS;
+    query.subId = CMD_GET;
+    query.index1 = reset ? 1 : 0;
+    return queueCommand(query);
+}
+
+/**
+ * @brief Returns the last statistics report of a slave.
+ *
+ * @param[in] peerID The peer ID of the slave.
+ * @param[out] out The reported statistics.
+ * @return true if a new report was copied to @p out.
+ */
+bool EmcEspNow::tryGetRemoteStats(uint8_t peerID, link_stats_t &out)
+{
+    if (peerID >= ESPNOW_MAX_PEERS)
+    {
+        return false;
+    }
+    return remoteStats[peerID].tryLoad(out, remoteStatsSeen[peerID]);
+}
+
+/**
+ * @brief Answers a statistics query of the master.
+ *
+ * Runs in the transmit context, so the report is sent like any other frame
+ * and is counted in the statistics of the next report.
+ */
+void EmcEspNow::sendStatsReport()
+{
+    if (!statsRequested)
+    {
+        return;
+    }
+    statsRequested = false;
+
+    link_stats_t report;
+    if (getLinkStats(1, report)) // Master always has peer ID 1
+    {
+        sendUnicast(peers.get(1)->peer_mac, FRAME_STATS, (const uint8_t *)&report, sizeof(report));
+    }
+
+    if (statsResetRequested)
+    {
+        statsResetRequested = false;
+        resetStats();
+    }
+}
+
+/**
+ * @brief Periodically sends the latest data to all peers in the ESP-NOW network.
+ *
+ * This function is called periodically to send the latest data to all peers in the
+ * ESP-NOW network. If the device is in master mode, it sends the command data to
+ * all slave devices when it changed or when the keep-alive interval elapsed,
+ * limited to the configured frame rate per slave (see setCommandRate()). If the
+ * device is in slave mode, it sends the latest data to the master device when it
+ * changed.
+ */
+void EmcEspNow::update()
+{
+    if (taskHandle)
+    {
+        // The task transmits, only hand over changed data and wake it
+        bool changed = false;
+        if (!slaveSubmitted && memcmp(&slaveSendData, &slaveTxData.writerView(), sizeof(slave_data_t)) != 0)
+        {
+            recordEdges(slaveSendData);
+            slaveTxData.store(slaveSendData);
+            changed = true;
+        }
+        if (memcmp(&masterCmdData, &masterTxCmd.writerView(), sizeof(master_cmd_t)) != 0)
+        {
+            masterTxCmd.store(masterCmdData);
+            changed = true;
+        }
+        if (changed)
+        {
+            notify();
+        }
+        return;
+    }
+
+    dispatch();
+    processRetries();
+    int64_t start = esp_timer_get_time();
+    if (slaveSubmitted)
+    {
+        slave_data_t tx;
+        slaveTxData.load(tx);
+        process(tx, masterCmdData);
+    }
+    else
+    {
+        recordEdges(slaveSendData);
+        process(slaveSendData, masterCmdData);
+    }
+    histograms[HIST_PROCESS].record(esp_timer_get_time() - start);
+}
+
+/**
+ * @brief Hands new slave data to the transmit path from outside of loop().
+ *
+ * The data is published through the same sequence lock that update() uses
+ * to feed the ESP-NOW task, and the task is woken right away, so a change
+ * does not wait for the next loop(). Without the task, the next update()
+ * sends it. Only one context may call this; after the first call update()
+ * stops copying slaveSendData, so the two never write concurrently.
+ *
+ * @param[in] data The slave data to send.
+ */
+void EmcEspNow::submit(const slave_data_t &data)
+{
+    slaveSubmitted = true;
+    recordEdges(data);
+    slaveTxData.store(data);
+    notify();
+}
+
+/**
+ * @brief Runs one transmit cycle with the given data.
+ *
+ * Called by update() when no task is running, and by the ESP-NOW task with
+ * the data that update() handed over.
+ *
+ * @param[in] tx The slave data to send (slave mode).
+ * @param[in] cmd The current command to send (master mode).
+ */
+void EmcEspNow::process(const slave_data_t &tx, const master_cmd_t &cmd)
+{
+    updateChannel();
+    updateLinks();
+
+    if (!isMaster && !peers.get(1))
+    {
+        // Back off exponentially while no master answers, with jitter so several slaves drift apart
+        if (millis() - broadcastMillis >= discoveryIntervalMs)
+        {
+            broadcastMillis = millis();
+            sendBroadcast();
+
+            // With automatic channel selection, every broadcast goes out on the next channel
+            // and the backoff only grows once all channels were tried
+            bool cycleDone = true;
+            if (autoChannel)
+            {
+                uint8_t next = channel >= ESPNOW_CHANNEL_MAX ? ESPNOW_CHANNEL_MIN : channel + 1;
+                switchChannel(next);
+                cycleDone = next == discoveryStartChannel;
+            }
+
+            if (cycleDone)
+            {
+                unsigned long next = discoveryBackoffMs * 2;
+                discoveryBackoffMs = next < ESPNOW_DISCOVERY_MAX_MS ? next : ESPNOW_DISCOVERY_MAX_MS;
+                discoveryIntervalMs = discoveryBackoffMs + random(discoveryBackoffMs / 8 + 1);
+            }
+            else
+            {
+                discoveryIntervalMs = ESPNOW_DISCOVERY_MIN_MS; // Time to wait for an answer on this channel
+            }
+        }
+        return;
+    }
+
+    // Answer discovery broadcasts at most once per reply window
+    if (isMaster && discoveryReplyPending && millis() - broadcastMillis >= ESPNOW_DISCOVERY_REPLY_MS)
+    {
+        discoveryReplyPending = false;
+        broadcastMillis = millis();
+        sendBroadcast();
+    }
+
+    if (isMaster)
+    {
+        updateSchedule();
+
+        // A changed command is due for every slave immediately
+        if (memcmp(&cmd, &lastmasterCmdData, sizeof(master_cmd_t)) != 0)
+        {
+            memcpy(&lastmasterCmdData, &cmd, sizeof(master_cmd_t));
+            for (auto &pending : cmdPending)
+            {
+                pending = true;
+            }
+        }
+
+        // In scheduled mode the command frames wait for slot 0, the sync wakes the task for it
+        if (!slotOpen())
+        {
+            return;
+        }
+
+        // Queued commands move into the log, which keeps them until every slave acknowledged them
+        uint16_t backlog = 0;
+        for (const auto &peer : peers)
+        {
+            if (peer.peerID == 0)
+                continue; // Skip the broadcast peer
+
+            if ((uint16_t)(cmdLogHead - cmdAcked[peer.peerID]) > ESPNOW_CMD_QUEUE_SIZE)
+            {
+                cmdAcked[peer.peerID] = cmdLogHead; // Left over from a removed peer, see addPeer()
+            }
+            uint16_t unacked = cmdLogHead - cmdAcked[peer.peerID];
+            backlog = unacked > backlog ? unacked : backlog;
+        }
+        master_cmd_t queued;
+        while (backlog < ESPNOW_CMD_QUEUE_SIZE && cmdQueue.pop(queued))
+        {
+            memcpy(&cmdLog[cmdLogHead++ & (ESPNOW_CMD_QUEUE_SIZE - 1)], &queued, sizeof(master_cmd_t));
+            backlog++;
+        }
+
+        // Send to every slave that has unacknowledged commands or is due for the current command, never faster
+        // than the per-peer frame limit; commands queued in between pile up into one batch
+        const uint16_t batchMax = (ESPNOW_MAX_PAYLOAD_LEN - sizeof(master_cmd_batch_t)) / sizeof(master_cmd_t) - 1;
+        uint8_t frame[ESPNOW_MAX_PAYLOAD_LEN];
+        unsigned long now = micros();
+        for (const auto &peer : peers)
+        {
+            if (peer.peerID == 0 || cmdBatchOpen(peer.peerID))
+                continue; // Skip the broadcast peer, and never replace a batch whose resends still run
+
+            unsigned long elapsed = now - cmdSentMicros[peer.peerID];
+            if (elapsed < cmdMinIntervalUs)
+                continue;
+
+            // Pack as many unacknowledged commands as fit into one frame, keeping one entry for the current command
+            master_cmd_batch_t batch;
+            batch.current = 0;
+            batch.firstCmd = cmdAcked[peer.peerID];
+            uint16_t count = cmdLogHead - batch.firstCmd;
+            count = count < batchMax ? count : batchMax;
+            size_t len = sizeof(master_cmd_batch_t);
+            for (uint16_t i = 0; i < count; i++)
+            {
+                memcpy(frame + len, &cmdLog[(batch.firstCmd + i) & (ESPNOW_CMD_QUEUE_SIZE - 1)], sizeof(master_cmd_t));
+                len += sizeof(master_cmd_t);
+            }
+
+            bool due = cmdPending[peer.peerID] || elapsed >= cmdKeepAliveMs * 1000UL;
+            if (due)
+            {
+                // The current command goes last and is marked, so the slave does not take a repeat for a new command
+                memcpy(frame + len, &lastmasterCmdData, sizeof(master_cmd_t));
+                len += sizeof(master_cmd_t);
+                batch.current = 1;
+                cmdPending[peer.peerID] = false;
+            }
+
+            if (len > sizeof(master_cmd_batch_t))
+            {
+                memcpy(frame, &batch, sizeof(master_cmd_batch_t));
+                cmdInFlight[peer.peerID] = batch.firstCmd + count; // Before the send, the status may come right away
+                sendUnicast(peer.peer_mac, FRAME_MASTER_CMD, frame, len);
+                cmdSentMicros[peer.peerID] = now;
+            }
+        }
+    }
+    else
+    {
+        // In scheduled mode everything to the master waits for the own slot, one frame per slot
+        if (!slotOpen())
+        {
+            return;
+        }
+        sendStatsReport();
+        if (!slotOpen())
+        {
+            return;
+        }
+
+        // If the slave data has changed or new edges wait, send it to the master device
+        bool newEdges = takeEdges();
+        bool changed = newEdges || memcmp(&tx, &lastSlaveSendData, sizeof(slave_data_t)) != 0;
+        sendSlaveData(tx, changed, newEdges);
+
+        // A slot that was not needed for data carries the heartbeat, see updateLinks()
+        if (isScheduled() && slotOpen() && millis() - txSlots[1].sentMillis >= heartbeatMs)
+        {
+            sendFrame(peers.get(1)->peer_mac, 1, FRAME_HEARTBEAT, nullptr, 0);
+        }
+    }
+}
+
+/**
+ * @brief Sends the slave data to the master.
+ *
+ * Without compact mode, a full frame is sent on every change. In compact mode
+ * a FRAME_SLAVE_DELTA with the words that differ from the last keyframe is sent
+ * instead. A keyframe is sent when one is forced (new master, send failure),
+ * when the keyframe interval elapsed, or when the delta would be larger than
+ * half a full frame. After a delta, a keyframe follows once the interval
+ * elapses even without further changes, so a lost last delta is repaired.
+ * Periodic keyframes are held back while the link is degraded. Without a
+ * change, a forced keyframe waits for keyframeRepairDue(), so it does not cut
+ * the resends of the failed frame short.
+ *
+ * In redundant edge mode both kinds of frame end in the edge block, and a
+ * frame with new edges is sent again as redundant copies.
+ *
+ * @param[in] tx The slave data to send.
+ * @param[in] changed true if @p tx differs from the last frame sent or new edges wait.
+ * @param[in] newEdges true if the edge history holds edges that were not sent before.
+ */
+void EmcEspNow::sendSlaveData(const slave_data_t &tx, bool changed, bool newEdges)
+{
+    const uint8_t *masterMac = peers.get(1)->peer_mac; // Master always has peer ID 1
+
+    // No periodic keyframes into a degraded link, only changes and heartbeats
+    bool periodicDue = linkStates[1] == LINK_CONNECTED && millis() - keyframeMillis >= keyframeIntervalMs;
+    bool keyframeDue = forceKeyframe || periodicDue;
+
+    if (!changed && !(compactUplink && ((periodicDue && lastWasDelta) || keyframeRepairDue())))
+    {
+        return;
+    }
+
+    memcpy(&lastSlaveSendData, &tx, sizeof(slave_data_t));
+
+    if (compactUplink && !keyframeDue)
+    {
+        // Collect the words that differ from the keyframe
+        const uint8_t *current = (const uint8_t *)&tx;
+        const uint8_t *base = (const uint8_t *)&keyframeData;
+        uint8_t payload[sizeof(slave_delta_t) + sizeof(slave_data_t) + ESPNOW_EDGE_BLOCK_LEN];
+        slave_delta_t delta;
+        delta.baseSeq = keyframeSeq;
+        delta.wordMask = 0;
+        size_t len = sizeof(slave_delta_t);
+
+        for (uint8_t w = 0; w < sizeof(slave_data_t) / 4; w++)
+        {
+            if (memcmp(current + w * 4, base + w * 4, 4) != 0)
+            {
+                delta.wordMask |= 1UL << w;
+                memcpy(payload + len, current + w * 4, 4);
+                len += 4;
+            }
+        }
+
+        // Only send the delta while it is clearly smaller than a keyframe
+        if (len < sizeof(slave_data_t) / 2)
+        {
+            memcpy(payload, &delta, sizeof(slave_delta_t));
+            if (redundantEdges)
+            {
+                len += writeEdges(payload + len);
+            }
+            sendFrame(masterMac, 1, FRAME_SLAVE_DELTA, payload, len);
+            lastWasDelta = true;
+            if (newEdges)
+            {
+                scheduleCopies();
+            }
+            return;
+        }
+    }
+
+    uint8_t payload[sizeof(slave_data_t) + ESPNOW_EDGE_BLOCK_LEN];
+    memcpy(payload, &tx, sizeof(slave_data_t));
+    size_t len = sizeof(slave_data_t);
+    if (redundantEdges)
+    {
+        len += writeEdges(payload + len);
+    }
+    keyframeSeq = sendFrame(masterMac, 1, FRAME_SLAVE_DATA, payload, len);
+    memcpy(&keyframeData, &tx, sizeof(slave_data_t));
+    keyframeMillis = millis();
+    lastWasDelta = false;
+    forceKeyframe = false;
+    if (newEdges)
+    {
+        scheduleCopies();
+    }
+}
+
+/**
+ * @brief Checks whether a forced keyframe may go out without a change of the data.
+ *
+ * The keyframe waits until the frame in the master's transmit slot was
+ * acknowledged or given up, so it never replaces a frame whose resends are
+ * still running. Once a repair keyframe was given up as well, the next one
+ * waits for any acknowledge of the master, e.g. of a heartbeat, so an outage
+ * costs a heartbeat per interval instead of a keyframe per resend series.
+ *
+ * @return true if process() should send the forced keyframe now.
+ */
+bool EmcEspNow::keyframeRepairDue() const
+{
+    const tx_slot_t &slot = txSlots[1];
+    bool settled = !slot.retryPending && !slot.copiesLeft && slot.statusCount == slot.txCount;
+    return forceKeyframe && settled && peerStats[1].consecutiveFails <= 1;
+}
+
+/**
+ * @brief Checks whether a command batch in the transmit slot of a slave is not settled yet.
+ *
+ * A batch is settled once its last transmission was acknowledged or given
+ * up. An acknowledge moves the slave's command cursor behind the batch, a
+ * batch that was given up leaves it, so its commands go out again with the
+ * next batch. Until then neither a heartbeat nor the next batch may replace
+ * it, or the commands would wait for nothing.
+ *
+ * @param[in] peerID The peer ID of the slave.
+ * @return true if the slot holds a command batch that waits for its send status or a resend.
+ */
+bool EmcEspNow::cmdBatchOpen(uint8_t peerID) const
+{
+    const tx_slot_t &slot = txSlots[peerID];
+    if (!isMaster || ((const frame_header_t *)slot.frame)->type != FRAME_MASTER_CMD)
+    {
+        return false;
+    }
+    return slot.retryPending || slot.statusCount != slot.txCount;
+}
+
+/**
+ * @brief Queues every button that changed since the last call as an edge.
+ *
+ * Called with every frame handed to the transmit path, from the context of
+ * update() or submit(), so an edge is timestamped when it was scanned and a
+ * press and release between two transmit cycles are both kept. A full queue
+ * drops the edge; the buttons themselves still reach the master.
+ *
+ * @param[in] data The slave data just handed to the transmit path.
+ */
+void EmcEspNow::recordEdges(const slave_data_t &data)
+{
+    if (!redundantEdges || memcmp(edgeButtons, data.button_data, sizeof(edgeButtons)) == 0)
+    {
+        return;
+    }
+
+    uint32_t now = (uint32_t)esp_timer_get_time();
+    for (uint8_t b = 0; b < sizeof(edgeButtons); b++)
+    {
+        uint8_t changed = edgeButtons[b] ^ data.button_data[b];
+        while (changed)
+        {
+            uint8_t bit = __builtin_ctz(changed);
+            changed &= changed - 1;
+
+            edge_event_t edge;
+            edge.bit = b * 8 + bit;
+            edge.pressed = (data.button_data[b] >> bit) & 1;
+            edge.micros = now;
+            edgeQueue.push(edge);
+        }
+    }
+    memcpy(edgeButtons, data.button_data, sizeof(edgeButtons));
+}
+
+/**
+ * @brief Takes the queued edges into the history that goes out with every data frame.
+ *
+ * The history keeps the latest ESPNOW_EDGE_HISTORY edges; an edge leaves it
+ * once it is older than ESPNOW_EDGE_HOLD_MS, by then it went out in several
+ * frames or their retries.
+ *
+ * @return true if at least one new edge was taken.
+ */
+bool EmcEspNow::takeEdges()
+{
+    if (!redundantEdges)
+    {
+        return false;
+    }
+
+    bool added = false;
+    edge_event_t edge;
+    while (edgeQueue.pop(edge))
+    {
+        if (edgeHistoryCount == ESPNOW_EDGE_HISTORY)
+        {
+            memmove(edgeHistory, edgeHistory + 1, (ESPNOW_EDGE_HISTORY - 1) * sizeof(edge_event_t));
+            edgeHistoryCount--;
+        }
+        edgeHistory[edgeHistoryCount++] = edge;
+        edgeNext++;
+        added = true;
+    }
+
+    uint32_t now = (uint32_t)esp_timer_get_time();
+    uint8_t expired = 0;
+    while (expired < edgeHistoryCount && now - edgeHistory[expired].micros >= ESPNOW_EDGE_HOLD_MS * 1000UL)
+    {
+        expired++;
+    }
+    if (expired > 0)
+    {
+        memmove(edgeHistory, edgeHistory + expired, (edgeHistoryCount - expired) * sizeof(edge_event_t));
+        edgeHistoryCount -= expired;
+    }
+    return added;
+}
+
+/**
+ * @brief Writes the edge history as the edge block of a data frame.
+ *
+ * The block is written even without edges, so the master always knows the
+ * number of the next edge and notices a restarted slave.
+ *
+ * @param[out] out The destination, with room for ESPNOW_EDGE_BLOCK_LEN bytes.
+ * @return The length of the block.
+ */
+size_t EmcEspNow::writeEdges(uint8_t *out) const
+{
+    slave_edges_t block;
+    block.firstEdge = edgeNext - edgeHistoryCount;
+    block.count = edgeHistoryCount;
+    memcpy(out, &block, sizeof(slave_edges_t));
+    memcpy(out + sizeof(slave_edges_t), edgeHistory, edgeHistoryCount * sizeof(edge_event_t));
+    return sizeof(slave_edges_t) + edgeHistoryCount * sizeof(edge_event_t);
+}
+
+/**
+ * @brief Schedules the redundant copies of the frame just sent to the master.
+ *
+ * The copies go out without waiting for a send status. Once a transmission
+ * of the frame is acknowledged, the remaining copies are dropped, so a clean
+ * channel costs almost no extra airtime.
+ */
+void EmcEspNow::scheduleCopies()
+{
+    if (edgeCopies < 2)
+    {
+        return;
+    }
+
+    tx_slot_t &slot = txSlots[1];
+    slot.copyAtMicros = micros() + edgeSpacingUs;
+    slot.copiesLeft = edgeCopies - 1;
+    armCopyTimer();
+}
+
+/**
+ * @brief Wakes the ESP-NOW task when the next redundant copy is due.
+ *
+ * The FreeRTOS tick is too coarse for the copy spacing, so a free-running
+ * slave arms the schedule timer, which is idle without syncs. A scheduled
+ * slave sends one copy per slot and is woken by its slot timer anyway.
+ */
+void EmcEspNow::armCopyTimer()
+{
+    if (tdmaTimer && !isScheduled())
+    {
+        esp_timer_stop(tdmaTimer);
+        esp_timer_start_once(tdmaTimer, edgeSpacingUs);
+    }
+}
+
+/**
+ * @brief Publishes data received from a slave into its receive slot.
+ *
+ * Every slave writes into its own slot, indexed by peer ID. The slot is only
+ * written when the data changed, so readers see one update per change. A
+ * direct slave data handler is called with @p data, which may point into the
+ * received frame. The slot is written under peerLock, like its reset in
+ * removePeer(), and not at all once the slave was removed.
+ *
+ * @param[in] peerID The peer ID of the slave.
+ * @param[in] data The received slave data.
+ */
+void EmcEspNow::storeSlaveData(uint8_t peerID, const slave_data_t &data)
+{
+    EmcSeqLock<slave_slot_t> &slot = masterRecvData[peerID];
+    bool changed = false;
+    portENTER_CRITICAL(&peerLock);
+    if (peers.get(peerID) && memcmp(&slot.writerView().data, &data, sizeof(slave_data_t)) != 0)
+    {
+        slave_slot_t frame;
+        memcpy(&frame.data, &data, sizeof(slave_data_t));
+        frame.recvMicros = micros();
+        slot.store(frame);
+        changed = true;
+    }
+    portEXIT_CRITICAL(&peerLock);
+
+    if (changed)
+    {
+        if (slaveDataHandler)
+        {
+            if (slaveDataDeferred)
+            {
+                notify();
+            }
+            else
+            {
+                slaveDataHandler(peerID, data);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Reports the edges of a received edge block that are new.
+ *
+ * The block always ends with the newest edge of the slave, so edges numbered
+ * below the next expected one were reported before, and a block that ends
+ * below it comes from a slave that restarted its numbering. Edges that left
+ * the slave's history before any of their frames arrived are counted as
+ * lost. An edge whose bit lies outside slave_data_t::button_data was never
+ * sent by a slave and is dropped, so handlers can index by the bit.
+ *
+ * @param[in] peerID The peer ID of the slave.
+ * @param[in] block The edge block.
+ * @param[in] len The length of the block.
+ */
+void EmcEspNow::receiveEdges(uint8_t peerID, const uint8_t *block, int len)
+{
+    slave_edges_t edges;
+    if (len < (int)sizeof(slave_edges_t))
+    {
+        return;
+    }
+    memcpy(&edges, block, sizeof(slave_edges_t));
+    if (len != (int)(sizeof(slave_edges_t) + edges.count * sizeof(edge_event_t)))
+    {
+        return;
+    }
+
+    uint16_t end = edges.firstEdge + edges.count;
+    if (!rxEdgeValid[peerID] || (int16_t)(end - rxEdgeNext[peerID]) < 0)
+    {
+        rxEdgeNext[peerID] = edges.firstEdge;
+        rxEdgeValid[peerID] = true;
+    }
+
+    int16_t gap = (int16_t)(edges.firstEdge - rxEdgeNext[peerID]);
+    if (gap > 0)
+    {
+        peerStats[peerID].rxEdgesLost += gap;
+    }
+
+    const edge_event_t *events = (const edge_event_t *)(block + sizeof(slave_edges_t));
+    for (uint8_t i = 0; i < edges.count; i++)
+    {
+        if ((int16_t)(uint16_t)(edges.firstEdge + i - rxEdgeNext[peerID]) >= 0 && events[i].bit < ESPNOW_EDGE_BITS && edgeHandler)
+        {
+            edgeHandler(peerID, events[i]); // View into the received frame
+        }
+    }
+    rxEdgeNext[peerID] = end;
+}
+
+/**
+ * @brief Receive callback function for ESP-NOW messages.
+ *
+ * This function is called when a message is received from another ESP-NOW device.
+ * The message is processed according to the mode of operation of the device.
+ * If the device is in master mode, it processes the message as a slave device.
+ * If the device is in slave mode, it processes the message as a master device.
+ * Frames with a foreign protocol version, duplicates and stale frames are
+ * dropped before anything is copied. A master adds an unknown sender only
+ * for a slave uplink frame sent to its own address, e.g. of a slave that
+ * restored its pairing after deep sleep.
+ *
+ * @param[in] recv_info The information about the received message.
+ * @param[in] data The data received in the message.
+ * @param[in] len The length of the data received in the message.
+ */
+void EmcEspNow::onReceive(const esp_now_recv_info_t *recv_info, const uint8_t *data, int len)
+{
+    // Every frame starts with a header of our protocol version
+    if (len < (int)sizeof(frame_header_t))
+    {
+        return;
+    }
+
+    const frame_header_t *header = (const frame_header_t *)data;
+    if (header->version != ESPNOW_PROTOCOL_VERSION)
+    {
+        return;
+    }
+
+    const uint8_t *payload = data + sizeof(frame_header_t);
+    int payloadLen = len - sizeof(frame_header_t);
+
+    if (header->type == FRAME_DISCOVERY)
+    {
+        const uint8_t *broadcastMac = isMaster ? BROADCAST_MAC_SLAVE : BROADCAST_MAC_MASTER;
+        if (memcmp(recv_info->des_addr, broadcastMac, 6) == 0)
+        {
+            if (isMaster)
+            {
+                // Answered once per reply window by process(), however many slaves asked
+                discoveryReplyPending = true;
+                notify();
+            }
+
+            // A known peer that announces itself again has restarted its sequence
+            int peerID = findPeer(recv_info->src_addr);
+            if (peerID >= 0)
+            {
+                peerStats[peerID].seqValid = false;
+                rxEdgeValid[peerID] = false;
+            }
+            addPeer(recv_info->src_addr);
+        }
+        return;
+    }
+
+    int peerID = findPeer(recv_info->src_addr);
+    if (peerID < 0 && isMaster)
+    {
+        // A slave that restored its pairing after deep sleep talks to us before discovery. Only its uplink
+        // frames to our own address count, a neighbouring master on the channel must not take a slave slot.
+        bool uplink = header->type == FRAME_SLAVE_DATA || header->type == FRAME_SLAVE_DELTA || header->type == FRAME_HEARTBEAT;
+        if (!uplink || memcmp(recv_info->des_addr, ownMac, 6) != 0)
+        {
+            return;
+        }
+        addPeer(recv_info->src_addr);
+        peerID = findPeer(recv_info->src_addr);
+    }
+    if (peerID <= 0)
+    {
+        return; // Only accept data from discovered peers
+    }
+
+    if (recv_info->rx_ctrl)
+    {
+        peerStats[peerID].rssi = recv_info->rx_ctrl->rssi;
+        peerStats[peerID].noiseFloor = recv_info->rx_ctrl->noise_floor;
+    }
+
+    // A heartbeat only refreshes the peer's liveness
+    if (header->type == FRAME_HEARTBEAT)
+    {
+        acceptSequence(peerID, header);
+        return;
+    }
+
+    // The master announces a channel change, follow it at the same time
+    if (header->type == FRAME_CHANNEL)
+    {
+        if (!isMaster && payloadLen == sizeof(channel_switch_t) && acceptSequence(peerID, header))
+        {
+            channel_switch_t announce;
+            memcpy(&announce, payload, sizeof(channel_switch_t));
+            if (announce.channel >= ESPNOW_CHANNEL_MIN && announce.channel <= ESPNOW_CHANNEL_MAX && announce.channel != channel)
+            {
+                channelSwitchMillis = millis() + announce.delayMs;
+                pendingChannel = announce.channel;
+                notify();
+            }
+        }
+        return;
+    }
+
+    // The sync of a scheduled master assigns the transmit slots. It has its own
+    // sequence counter and is not part of the master's sequence to us
+    if (header->type == FRAME_SYNC)
+    {
+        if (!isMaster && peerID == 1)
+        {
+            followSync(payload, payloadLen);
+        }
+        return;
+    }
+
+    // Application frames go straight to the user handler, in both roles
+    if (header->type == FRAME_USER)
+    {
+        if (acceptSequence(peerID, header) && userFrameHandler)
+        {
+            userFrameHandler(peerID, payload, payloadLen);
+        }
+        return;
+    }
+
+    if (isMaster)
+    {
+        // Slaves in redundant edge mode append an edge block to their data frames
+        if (header->type == FRAME_SLAVE_DATA && payloadLen >= (int)sizeof(slave_data_t) && acceptSequence(peerID, header))
+        {
+            // A full frame is also the base for following deltas
+            memcpy(&rxKeyframe[peerID], payload, sizeof(slave_data_t));
+            rxKeyframeSeq[peerID] = header->seq;
+            rxKeyframeValid[peerID] = true;
+            storeSlaveData(peerID, *(const slave_data_t *)payload);
+            if (payloadLen > (int)sizeof(slave_data_t))
+            {
+                receiveEdges(peerID, payload + sizeof(slave_data_t), payloadLen - sizeof(slave_data_t));
+            }
+        }
+        else if (header->type == FRAME_SLAVE_DELTA && payloadLen >= (int)sizeof(slave_delta_t) && acceptSequence(peerID, header))
+        {
+            slave_delta_t delta;
+            memcpy(&delta, payload, sizeof(slave_delta_t));
+            uint32_t wordMask = delta.wordMask & ((1UL << (sizeof(slave_data_t) / 4)) - 1);
+            int offset = sizeof(slave_delta_t) + 4 * __builtin_popcount(wordMask);
+            if (offset > payloadLen)
+            {
+                return; // Truncated delta
+            }
+
+            // A delta against a keyframe we did not receive cannot be applied, wait for the next keyframe
+            if (rxKeyframeValid[peerID] && delta.baseSeq == rxKeyframeSeq[peerID])
+            {
+                slave_data_t current;
+                memcpy(&current, &rxKeyframe[peerID], sizeof(slave_data_t));
+                uint8_t *words = (uint8_t *)&current;
+                const uint8_t *changed = payload + sizeof(slave_delta_t);
+                for (uint8_t w = 0; w < sizeof(slave_data_t) / 4; w++)
+                {
+                    if (wordMask & (1UL << w))
+                    {
+                        memcpy(words + w * 4, changed, 4);
+                        changed += 4;
+                    }
+                }
+                storeSlaveData(peerID, current);
+            }
+
+            // The edges count even when the delta could not be applied
+            if (offset < payloadLen)
+            {
+                receiveEdges(peerID, payload + offset, payloadLen - offset);
+            }
+        }
+        else if (header->type == FRAME_STATS && payloadLen == sizeof(link_stats_t) && acceptSequence(peerID, header))
+        {
+            remoteStats[peerID].store(*(const link_stats_t *)payload);
+        }
+    }
+    else
+    {
+        // A command frame holds the queued commands in the order they were issued, then the current command if marked
+        int cmdsLen = payloadLen - (int)sizeof(master_cmd_batch_t);
+        if (header->type == FRAME_MASTER_CMD && cmdsLen > 0 && cmdsLen % sizeof(master_cmd_t) == 0 && acceptSequence(peerID, header))
+        {
+            master_cmd_batch_t batch;
+            memcpy(&batch, payload, sizeof(master_cmd_batch_t));
+            const master_cmd_t *cmds = (const master_cmd_t *)(payload + sizeof(master_cmd_batch_t));
+            uint8_t count = cmdsLen / sizeof(master_cmd_t);
+            const master_cmd_t *current = batch.current ? &cmds[--count] : nullptr;
+            for (uint8_t i = 0; i < count; i++)
+            {
+                // A batch whose acknowledge was lost comes again, the commands already taken are dropped
+                uint16_t number = batch.firstCmd + i;
+                int16_t behind = (int16_t)(cmdRecvNext - number);
+                if (cmdRecvValid && behind > 0 && behind <= ESPNOW_CMD_QUEUE_SIZE)
+                {
+                    continue;
+                }
+                cmdRecvNext = number + 1;
+                cmdRecvValid = true;
+
+                // A statistics query is answered here and never reaches the application
+                if (cmds[i].mainId == ESPNOW_CMD_STATS && cmds[i].subId == CMD_GET)
+                {
+                    statsResetRequested = cmds[i].index1 != 0;
+                    statsRequested = true;
+                    notify();
+                    continue;
+                }
+
+                cmdRecvQueue.push(cmds[i]);
+
+                if (commandHandler)
+                {
+                    if (commandDeferred)
+                    {
+                        cmdDispatchQueue.push(cmds[i]);
+                    }
+                    else
+                    {
+                        commandHandler(cmds[i]); // View into the received frame
+                    }
+                }
+            }
+
+            if (commandHandler && commandDeferred)
+            {
+                notify();
+            }
+
+            // The current command is state, a repeat of it is no new command
+            portENTER_CRITICAL(&peerLock); // resetData() writes the slot as well
+            if (current && memcmp(&slaveRecvCmd.writerView(), current, sizeof(master_cmd_t)) != 0)
+            {
+                slaveRecvCmd.store(*current);
+            }
+            portEXIT_CRITICAL(&peerLock);
+        }
+    }
+}
+
+/**
+ * @brief Called when a message is sent using the esp_now_send() function.
+ *
+ * This function is called when a message is sent using the esp_now_send() function.
+ * The status is recorded for the destination peer, see handleSendStatus().
+ *
+ * @param[in] mac_addr The MAC address of the device the message was sent to.
+ * @param[in] status The status of the message send operation.
+ */
+void EmcEspNow::onSend(const uint8_t *mac_addr, esp_now_send_status_t status)
+{
+    instance->handleSendStatus(mac_addr, status);
+}
+
+/**
+ * @brief Records the send status of a frame.
+ *
+ * An acknowledged frame resets the peer's failure run. A failed frame is
+ * scheduled for a resend with exponential backoff, while retries are left.
+ * In redundant edge mode a failed copy brings the next one forward; only the
+ * failure of the last copy counts, and only if no copy was acknowledged.
+ * A frame counts as one failure once its last resend failed; the status of
+ * a frame that a newer one replaced is counted with the newer one. The peer
+ * is only removed after a run of frames that were given up, or when it keeps
+ * failing and nothing was acknowledged within the peer timeout, so a short
+ * outage costs a few frames but not the link.
+ *
+ * @param[in] mac_addr The MAC address of the device the message was sent to.
+ * @param[in] status The status of the message send operation.
+ */
+void EmcEspNow::handleSendStatus(const uint8_t *mac_addr, esp_now_send_status_t status)
+{
+    int peerID = findPeer(mac_addr);
+    if (peerID <= 0)
+    {
+        return; // Broadcasts are not acknowledged
+    }
+
+    // The driver reports in send order, so the count tells whether the status is one of the frame in the slot
+    tx_slot_t &slot = txSlots[peerID];
+    bool current = (int32_t)(slot.statusCount++ - slot.frameTxCount) >= 0;
+
+    peer_stats_t &stats = peerStats[peerID];
+    if (status == ESP_NOW_SEND_SUCCESS)
+    {
+        stats.txOk++;
+        stats.consecutiveFails = 0;
+        if (current)
+        {
+            slot.acked = true;
+            slot.copiesLeft = 0; // The master has the frame, the remaining copies are not needed
+
+            // An acknowledged keyframe is the latest one, the master no longer misses one
+            if (!isMaster && peerID == 1 && ((const frame_header_t *)slot.frame)->type == FRAME_SLAVE_DATA)
+            {
+                forceKeyframe = false;
+            }
+
+            // The slave has the commands of the batch, the next batch starts behind them
+            if (isMaster && ((const frame_header_t *)slot.frame)->type == FRAME_MASTER_CMD)
+            {
+                cmdAcked[peerID] = cmdInFlight[peerID];
+            }
+        }
+        if (forceKeyframe)
+        {
+            notify(); // The keyframe waited for this frame, see keyframeRepairDue()
+        }
+        histograms[HIST_ACK].record((uint32_t)esp_timer_get_time() - txSlots[peerID].sentMicros);
+        stats.lastAckMillis = millis();
+        masterRestored = false;
+        return;
+    }
+
+    stats.txFail++;
+
+    // A failed copy is no loss while another copy is still coming or already got through;
+    // the next copy goes out right away instead of after the spacing
+    if (redundantEdges && current && (slot.copiesLeft > 0 || slot.acked))
+    {
+        if (slot.copiesLeft > 0)
+        {
+            slot.copyAtMicros = micros();
+            notify();
+        }
+        return;
+    }
+
+    // The master may have missed a keyframe, so the next uplink must be a full frame
+    forceKeyframe = true;
+
+    if (current && slot.attempts < maxRetries)
+    {
+        slot.attempts++;
+        slot.retryAtMicros = micros() + (retryBackoffUs << (slot.attempts - 1));
+        slot.retryPending = true;
+        notify();
+    }
+    else if (current)
+    {
+        // The last resend failed, the frame is given up
+        stats.consecutiveFails++;
+        notify(); // A forced keyframe waited for the resends, see keyframeRepairDue()
+
+        // A master restored from RTC memory that never answers is gone, fall back to discovery
+        if (masterRestored)
+        {
+            EMC_LOGD("Restored master not responding, starting discovery...");
+            masterRestored = false;
+            removePeer(mac_addr);
+            return;
+        }
+    }
+
+    if (stats.consecutiveFails >= evictFailures || millis() - stats.lastAckMillis >= peerTimeoutMs)
+    {
+        EMC_LOGD("Peer not responding, removing peer...");
+        removePeer(mac_addr);
+    }
+}
+
+/**
+ * @brief Returns how long the ESP-NOW task may sleep without missing a deadline.
+ *
+ * The task is woken early by notify() whenever new data is handed over, so
+ * this only covers work that is due without new data: retries, redundant
+ * copies without a timer for them, discovery
+ * broadcasts, command keep-alives and rate-limited resends, keyframes, and
+ * heartbeats and link timeouts. A forced keyframe that waits for the send
+ * status of a frame is woken by handleSendStatus().
+ *
+ * @return The sleep time in ticks, at least one tick.
+ */
+TickType_t EmcEspNow::nextWakeTicks() const
+{
+    unsigned long waitMs;
+    bool slotted = !isMaster && isScheduled(); // The slot timer wakes the task for everything to the master
+    for (const auto &peer : peers)
+    {
+        if (txSlots[peer.peerID].retryPending && !(slotted && peer.peerID == 1))
+        {
+            return 1; // Resend as soon as the backoff allows
+        }
+        if (txSlots[peer.peerID].copiesLeft && !tdmaTimer && !slotted)
+        {
+            return 1; // No timer for the copies, poll
+        }
+    }
+
+    if (isMaster)
+    {
+        waitMs = discoveryReplyPending ? ESPNOW_DISCOVERY_REPLY_MS : cmdKeepAliveMs;
+        for (const auto &peer : peers)
+        {
+            // Commands a slave did not acknowledge go out again with the next batch
+            bool pending = cmdPending[peer.peerID] || (peer.peerID != 0 && cmdAcked[peer.peerID] != cmdLogHead);
+            if (pending && tdmaCycleUs == 0) // Scheduled: the sync wakes the task for slot 0
+            {
+                waitMs = cmdMinIntervalUs / 1000;
+                break;
+            }
+        }
+    }
+    else if (!peers.get(1))
+    {
+        unsigned long elapsed = millis() - broadcastMillis;
+        waitMs = elapsed < discoveryIntervalMs ? discoveryIntervalMs - elapsed : 0; // Next discovery broadcast
+    }
+    else if (slotted)
+    {
+        waitMs = portMAX_DELAY;
+    }
+    else if (keyframeRepairDue())
+    {
+        waitMs = 0; // A forced keyframe that waited for a frame is due, see handleSendStatus()
+    }
+    else
+    {
+        waitMs = compactUplink && lastWasDelta ? keyframeIntervalMs : portMAX_DELAY;
+    }
+
+    if (pendingChannel)
+    {
+        long untilSwitch = (long)(channelSwitchMillis - millis());
+        unsigned long switchMs = untilSwitch > 0 ? untilSwitch : 0;
+        if (switchMs < waitMs)
+        {
+            waitMs = switchMs;
+        }
+    }
+
+    // Connected peers need heartbeats and timeout checks
+    if (peers.size() > 1 && heartbeatMs < waitMs)
+    {
+        waitMs = heartbeatMs;
+    }
+
+    if (waitMs == portMAX_DELAY)
+    {
+        return portMAX_DELAY;
+    }
+
+    TickType_t ticks = pdMS_TO_TICKS(waitMs);
+    return ticks > 0 ? ticks : 1;
+}
+
+/**
+ * @brief Task that runs the ESP-NOW updates.
+ *
+ * This task blocks on its task notification until update() or queueCommand()
+ * hands over new data, a frame for a deferred handler arrives, or until
+ * nextWakeTicks() elapsed. It then calls the deferred handlers, takes a
+ * consistent copy of the data and runs one transmit cycle. If the device is in
+ * master mode, it sends the command data to all slave devices. If the device
+ * is in slave mode, it sends the latest data to the master device.
+ *
+ * @param[in] pvParameters The EmcEspNow instance.
+ */
+void EmcEspNow::espNowTask(void *pvParameters)
+{
+    EmcEspNow *self = (EmcEspNow *)pvParameters;
+    slave_data_t tx;
+    master_cmd_t cmd;
+
+    while (self->taskRunning)
+    {
+        ulTaskNotifyTake(pdTRUE, self->nextWakeTicks());
+        if (!self->taskRunning)
+        {
+            break;
+        }
+
+        self->dispatch();
+        self->processRetries();
+
+        self->slaveTxData.load(tx);
+        self->masterTxCmd.load(cmd);
+        int64_t start = esp_timer_get_time();
+        self->process(tx, cmd);
+        self->histograms[HIST_PROCESS].record(esp_timer_get_time() - start);
+    }
+
+    self->taskHandle = nullptr;
+    vTaskDelete(NULL);
 }
 
 #endif
\ No newline at end of file
@@ -28,9 +28,153 @@
  */
 
 #include <esp_now.h>
+#include <esp_timer.h>
 #include <WiFi.h>
+#include <functional>
+#include "EmcHistogram.h"
+#include "EmcPeerTable.h"
+#include "EmcRingBuffer.h"
+#include "EmcSeqLock.h"
 #define ESPNOW_WIFI_CHANNEL 6
 
+#define ESPNOW_PROTOCOL_VERSION 3 ///< Version carried in every frame header, frames of other versions are dropped
+
+#ifndef ESPNOW_SEQ_REORDER_WINDOW
+#define ESPNOW_SEQ_REORDER_WINDOW 64 ///< Sequence numbers this far behind the last one are stale, further back means the sender restarted
+#endif
+
+#ifndef ESPNOW_KEYFRAME_INTERVAL_MS
+#define ESPNOW_KEYFRAME_INTERVAL_MS 250 ///< Default interval for full slave_data_t keyframes in compact uplink mode
+#endif
+
+#ifndef ESPNOW_TASK_CORE
+#define ESPNOW_TASK_CORE 0 ///< Default core of the ESP-NOW task, next to the WiFi task
+#endif
+
+#ifndef ESPNOW_TASK_PRIORITY
+#define ESPNOW_TASK_PRIORITY 5 ///< Default priority of the ESP-NOW task, above loop()
+#endif
+
+#ifndef ESPNOW_TASK_STACK_SIZE
+#define ESPNOW_TASK_STACK_SIZE 4096 ///< Default stack size of the ESP-NOW task in bytes
+#endif
+
+#ifndef ESPNOW_MAX_RETRIES
+#define ESPNOW_MAX_RETRIES 3 ///< Default number of resends of a frame that was not acknowledged
+#endif
+
+#ifndef ESPNOW_RETRY_BACKOFF_US
+#define ESPNOW_RETRY_BACKOFF_US 1000 ///< Default delay before the first resend, doubled for every further one
+#endif
+
+#ifndef ESPNOW_EVICT_FAILURES
+#define ESPNOW_EVICT_FAILURES 20 ///< Default number of consecutive frames given up after all resends before a peer is removed
+#endif
+
+#ifndef ESPNOW_PEER_TIMEOUT_MS
+#define ESPNOW_PEER_TIMEOUT_MS 1000 ///< Default time without an acknowledged frame before a failing peer is removed
+#endif
+
+#ifndef ESPNOW_HEARTBEAT_MS
+#define ESPNOW_HEARTBEAT_MS 100 ///< Default time without any frame to a peer before a heartbeat is sent
+#endif
+
+#ifndef ESPNOW_DEGRADED_MS
+#define ESPNOW_DEGRADED_MS 300 ///< Default time without any frame from a peer before its link is degraded
+#endif
+
+#ifndef ESPNOW_LOST_MS
+#define ESPNOW_LOST_MS 1000 ///< Default time without any frame from a peer before it is lost and removed
+#endif
+
+#ifndef ESPNOW_DISCOVERY_MIN_MS
+#define ESPNOW_DISCOVERY_MIN_MS 50 ///< First slave discovery interval, doubled after every unanswered broadcast
+#endif
+
+#ifndef ESPNOW_DISCOVERY_MAX_MS
+#define ESPNOW_DISCOVERY_MAX_MS 2000 ///< Longest slave discovery interval
+#endif
+
+#ifndef ESPNOW_DISCOVERY_REPLY_MS
+#define ESPNOW_DISCOVERY_REPLY_MS 50 ///< Window in which the master answers any number of discovery broadcasts once
+#endif
+
+#ifndef ESPNOW_CHANNEL_MIN
+#define ESPNOW_CHANNEL_MIN 1 ///< Lowest WiFi channel used by automatic channel selection
+#endif
+
+#ifndef ESPNOW_CHANNEL_MAX
+#define ESPNOW_CHANNEL_MAX 13 ///< Highest WiFi channel used by automatic channel selection, 11 in the US
+#endif
+
+#ifndef ESPNOW_HOP_LOSS_THRESHOLD
+#define ESPNOW_HOP_LOSS_THRESHOLD 0.2f ///< Default share of failed frames that makes the master change the channel
+#endif
+
+#ifndef ESPNOW_HOP_CHECK_MS
+#define ESPNOW_HOP_CHECK_MS 2000 ///< Interval in which the master evaluates the loss on its channel
+#endif
+
+#ifndef ESPNOW_HOP_DELAY_MS
+#define ESPNOW_HOP_DELAY_MS 100 ///< Time between announcing a channel switch and switching
+#endif
+
+#ifndef ESPNOW_PS_WAKE_INTERVAL_MS
+#define ESPNOW_PS_WAKE_INTERVAL_MS 100 ///< Default radio wake interval in modem sleep
+#endif
+
+#ifndef ESPNOW_PS_WAKE_WINDOW_MS
+#define ESPNOW_PS_WAKE_WINDOW_MS 20 ///< Default time the radio stays awake per wake interval
+#endif
+
+#ifndef ESPNOW_TDMA_SLOT_US
+#define ESPNOW_TDMA_SLOT_US 2000 ///< Default length of one transmit slot in scheduled mode, fits a full slave_data_t frame at 1 Mbps
+#endif
+
+#ifndef ESPNOW_TDMA_GUARD_US
+#define ESPNOW_TDMA_GUARD_US 1000 ///< Default time at the end of a slot in which no frame starts, so it leaves the air in time
+#endif
+
+#ifndef ESPNOW_TDMA_SYNC_LOST_CYCLES
+#define ESPNOW_TDMA_SYNC_LOST_CYCLES 4 ///< Cycles without a sync after which a slave transmits freely again
+#endif
+
+#ifndef ESPNOW_EDGE_COPIES
+#define ESPNOW_EDGE_COPIES 3 ///< Default transmissions of every slave frame with new button edges in redundant edge mode
+#endif
+
+#ifndef ESPNOW_EDGE_SPACING_US
+#define ESPNOW_EDGE_SPACING_US 500 ///< Default time between the copies of a frame, so one burst of interference does not hit them all
+#endif
+
+#ifndef ESPNOW_EDGE_HISTORY
+#define ESPNOW_EDGE_HISTORY 8 ///< Latest button edges repeated in every slave data frame in redundant edge mode
+#endif
+
+#ifndef ESPNOW_EDGE_HOLD_MS
+#define ESPNOW_EDGE_HOLD_MS 250 ///< Time an edge is repeated in the following slave data frames
+#endif
+
+#ifndef ESPNOW_EDGE_QUEUE_SIZE
+#define ESPNOW_EDGE_QUEUE_SIZE 32 ///< Button edges waiting for the transmit path, power of two
+#endif
+
+#ifndef ESPNOW_CMD_STATS
+#define ESPNOW_CMD_STATS 0xFE ///< master_cmd_t::mainId of a CMD_GET that asks a slave for its link_stats_t
+#endif
+
+#ifndef ESPNOW_CMD_KEEPALIVE_MS
+#define ESPNOW_CMD_KEEPALIVE_MS 100 ///< Default interval for repeating an unchanged master command
+#endif
+
+#ifndef ESPNOW_CMD_QUEUE_SIZE
+#define ESPNOW_CMD_QUEUE_SIZE 32 ///< Depth of the master command queue and the slave receive queue, power of two
+#endif
+
+#ifndef ESPNOW_CMD_MAX_RATE
+#define ESPNOW_CMD_MAX_RATE 500 ///< Default maximum command frames per second and slave
+#endif
+
 /**
  * @brief Define the WiFi channel used for ESP-NOW communication.
  *
@@ -52,6 +196,217 @@ enum CMDType : uint8_t
     CMD_GET
 };
 
+/**
+ * @brief Type tag carried in the header of every frame.
+ */
+enum FrameType : uint8_t
+{
+    FRAME_DISCOVERY,  ///< Broadcast announcement of a master or slave
+    FRAME_SLAVE_DATA, ///< slave_data_t sent by a slave
+    FRAME_MASTER_CMD, ///< master_cmd_batch_t followed by one or more master_cmd_t sent by the master
+    FRAME_SLAVE_DELTA, ///< slave_delta_t followed by the changed 32-bit words of slave_data_t
+    FRAME_HEARTBEAT,   ///< Empty frame that keeps an idle link alive
+    FRAME_CHANNEL,     ///< channel_switch_t announcing a channel change by the master
+    FRAME_STATS,       ///< link_stats_t sent by a slave in reply to an ESPNOW_CMD_STATS query
+    FRAME_USER,        ///< Application payload, passed to the onUserFrame() handler
+    FRAME_SYNC         ///< tdma_sync_t and the slot table, broadcast by a master in scheduled mode
+};
+
+/**
+ * @struct channel_switch_t
+ * @brief Payload of a FRAME_CHANNEL frame.
+ */
+typedef struct
+{
+    uint8_t channel;  ///< Channel the master switches to
+    uint16_t delayMs; ///< Time from this frame until the switch
+} __attribute__((packed)) channel_switch_t;
+
+/**
+ * @struct tdma_sync_t
+ * @brief Payload of a FRAME_SYNC frame, followed by the MAC address of every slave slot.
+ *
+ * Slot n starts n * slotUs after the sync and belongs to the slave with peer
+ * ID n on the master; slot 0 is the master's own. The MAC addresses for the
+ * slots 1 to slotCount - 1 follow in order, all zero for a free peer ID.
+ */
+typedef struct
+{
+    uint16_t slotUs;   ///< Length of one slot
+    uint16_t windowUs; ///< Time from the start of a slot in which a frame may start
+    uint8_t slotCount; ///< Slots per cycle, including slot 0
+} __attribute__((packed)) tdma_sync_t;
+
+/**
+ * @brief State of the link to a peer, driven by the time since its last frame.
+ */
+enum LinkState : uint8_t
+{
+    LINK_DISCOVERING, ///< No peer found yet, discovery is running
+    LINK_CONNECTED,   ///< Frames arrive within the degraded timeout
+    LINK_DEGRADED,    ///< The peer was silent for longer than the degraded timeout
+    LINK_LOST         ///< The peer was silent for longer than the lost timeout and was removed
+};
+
+/**
+ * @struct frame_header_t
+ * @brief Header that precedes the payload of every ESP-NOW frame.
+ */
+typedef struct
+{
+    uint8_t type;       ///< FrameType of the payload
+    uint8_t version;    ///< ESPNOW_PROTOCOL_VERSION of the sender
+    uint16_t seq;       ///< Per-destination sequence number
+    uint32_t timestamp; ///< Sender esp_timer_get_time() in microseconds, truncated to 32 bits
+} __attribute__((packed)) frame_header_t;
+
+#define ESPNOW_MAX_PAYLOAD_LEN (ESP_NOW_MAX_DATA_LEN - sizeof(frame_header_t)) ///< Payload bytes left after the frame header
+
+/**
+ * @struct slave_delta_t
+ * @brief Prefix of a FRAME_SLAVE_DELTA payload.
+ *
+ * A delta lists every 32-bit word of slave_data_t that differs from the last
+ * keyframe (a full FRAME_SLAVE_DATA frame), so losing one delta does not
+ * matter: the next one carries all changes again.
+ */
+typedef struct
+{
+    uint16_t baseSeq;  ///< Sequence number of the keyframe the delta applies to
+    uint32_t wordMask; ///< Bit n set: word n of slave_data_t follows, in ascending order
+} __attribute__((packed)) slave_delta_t;
+
+/**
+ * @struct edge_event_t
+ * @brief One press or release of a slave input, carried in the edge block of its data frames.
+ */
+typedef struct
+{
+    uint8_t bit;     ///< Bit of the input in slave_data_t::button_data, below ESPNOW_EDGE_BITS
+    bool pressed;    ///< true for a press, false for a release
+    uint32_t micros; ///< Slave esp_timer_get_time() when the edge was seen, truncated to 32 bits
+} __attribute__((packed)) edge_event_t;
+
+#define ESPNOW_EDGE_BITS (sizeof(slave_data_t::button_data) * 8) ///< Inputs an edge_event_t can name, received edges beyond are dropped
+
+/**
+ * @struct slave_edges_t
+ * @brief Edge block at the end of FRAME_SLAVE_DATA and FRAME_SLAVE_DELTA frames in redundant edge mode.
+ *
+ * The block lists the latest edges of the slave, oldest first, so an edge
+ * whose frame was lost arrives with the next one. Edges are numbered per
+ * slave; firstEdge + count is the number the next edge will get.
+ */
+typedef struct
+{
+    uint16_t firstEdge; ///< Number of the first edge_event_t that follows
+    uint8_t count;      ///< Edges that follow
+} __attribute__((packed)) slave_edges_t;
+
+#define ESPNOW_EDGE_BLOCK_LEN (sizeof(slave_edges_t) + ESPNOW_EDGE_HISTORY * sizeof(edge_event_t)) ///< Largest edge block
+
+/**
+ * @struct peer_stats_t
+ * @brief Link statistics of one peer.
+ */
+typedef struct
+{
+    uint32_t rxFrames;          ///< Frames accepted from the peer
+    uint32_t rxLost;            ///< Frames missing in the peer's sequence
+    uint32_t rxDropped;         ///< Duplicate or stale frames dropped
+    uint32_t lastTimestamp;     ///< Sender timestamp of the last accepted frame
+    uint16_t lastSeq;           ///< Sequence number of the last accepted frame
+    bool seqValid;              ///< lastSeq holds a sequence number from this peer
+    uint32_t txOk;              ///< Frames acknowledged by the peer
+    uint32_t txFail;            ///< Frames not acknowledged by the peer, including retries
+    uint32_t txRetries;         ///< Frames resent after a failure
+    uint32_t txCopies;          ///< Redundant copies of frames sent in redundant edge mode
+    uint32_t rxEdgesLost;       ///< Edges of the peer that left its edge history before a frame arrived
+    uint16_t consecutiveFails;  ///< Frames given up after all resends since the last acknowledged frame
+    unsigned long lastAckMillis; ///< Time of the last acknowledged frame
+    unsigned long lastRxMillis; ///< Time of the last accepted frame, including heartbeats
+    int8_t rssi;                ///< RSSI of the last frame in dBm
+    int8_t noiseFloor;          ///< Noise floor at the last frame in dBm
+} peer_stats_t;
+
+/**
+ * @brief Duration histograms kept by EmcEspNow.
+ */
+enum StatsHistogram : uint8_t
+{
+    HIST_LOOP,    ///< Duration of loop(), recorded by the application
+    HIST_SCAN,    ///< Duration of one input scan, recorded by the application
+    HIST_PROCESS, ///< Duration of one transmit cycle
+    HIST_ACK,     ///< Time from sending a frame to its acknowledge
+    HIST_COUNT    ///< Number of histograms
+};
+
+/**
+ * @struct link_stats_t
+ * @brief Link and timing statistics of one device, payload of a FRAME_STATS frame.
+ */
+typedef struct
+{
+    uint32_t uptimeMs;   ///< millis() of the reporting device
+    uint32_t txOk;       ///< Frames acknowledged by the peer
+    uint32_t txFail;     ///< Frames not acknowledged by the peer, including retries
+    uint32_t txRetries;  ///< Frames resent after a failure
+    uint32_t rxFrames;   ///< Frames accepted from the peer
+    uint32_t rxLost;     ///< Frames missing in the peer's sequence
+    uint32_t rxDropped;  ///< Duplicate or stale frames dropped
+    int8_t rssi;         ///< RSSI of the last frame from the peer in dBm
+    int8_t noiseFloor;   ///< Noise floor at the last frame in dBm
+    uint8_t linkState;   ///< LinkState of the peer
+    uint8_t channel;     ///< WiFi channel in use
+    histogram_summary_t histograms[HIST_COUNT]; ///< Summaries, indexed by StatsHistogram
+} __attribute__((packed)) link_stats_t;
+
+static_assert(sizeof(link_stats_t) <= ESPNOW_MAX_PAYLOAD_LEN, "link_stats_t must fit into one frame");
+static_assert(sizeof(tdma_sync_t) + (ESPNOW_MAX_PEERS - 1) * 6 <= ESPNOW_MAX_PAYLOAD_LEN, "The slot table must fit into one frame");
+static_assert(sizeof(slave_data_t) + ESPNOW_EDGE_BLOCK_LEN <= ESPNOW_MAX_PAYLOAD_LEN, "A keyframe with a full edge history must fit into one frame");
+
+/**
+ * @struct master_cmd_t
+ * @brief Represents a command structure used by the master device.
+ */
+typedef struct
+{
+    uint8_t mainId = 0;   ///< Main command identifier
+    uint8_t subId = 0;    ///< Sub-command identifier
+    uint8_t index1 = 0;   ///< First index value
+    uint8_t index2 = 0;   ///< Second index value
+    float value = 0;      ///< Floating point value
+    int32_t valueInt = 0; ///< Integer value
+} __attribute__((packed)) master_cmd_t;
+
+/**
+ * @struct master_cmd_batch_t
+ * @brief Prefix of a FRAME_MASTER_CMD payload, followed by the master_cmd_t entries.
+ *
+ * The queued commands come first, in the order they were queued. If current
+ * is set, the last entry is the master's current command, masterCmdData. It
+ * is repeated as a keep-alive, so it is state for tryGetLatest() and not a
+ * new command for the queue and the handlers.
+ *
+ * The master numbers the queued commands and resends those a slave did not
+ * acknowledge in its next batch, so a slave drops entries it already has.
+ */
+typedef struct
+{
+    uint8_t current;   ///< 1 if the last entry is the current command
+    uint16_t firstCmd; ///< Number of the first queued entry, the following ones count up
+} __attribute__((packed)) master_cmd_batch_t;
+
+/**
+ * @struct slave_slot_t
+ * @brief Holds the last frame received by the master from one slave.
+ */
+typedef struct
+{
+    slave_data_t data;          ///< Last data received from the slave
+    unsigned long recvMicros;   ///< micros() timestamp of the frame
+} __attribute__((packed)) slave_slot_t;
+
 /**
  * @class EmcEspNow
  * @brief Provides an interface for ESP-NOW communication between ESP32 devices.
@@ -61,31 +416,35 @@ enum CMDType : uint8_t
  */
 class EmcEspNow
 {
+public:
     /**
-     * @struct master_cmd_t
-     * @brief Represents a command structure used by the master device.
+     * @brief Handler for commands received from the master (slave mode).
+     *
+     * The command is a view into the received frame and is only valid during the call.
      */
-    typedef struct
-    {
-        uint8_t mainId = 0;   ///< Main command identifier
-        uint8_t subId = 0;    ///< Sub-command identifier
-        uint8_t index1 = 0;   ///< First index value
-        uint8_t index2 = 0;   ///< Second index value
-        float value = 0;      ///< Floating point value
-        int32_t valueInt = 0; ///< Integer value
-    } __attribute__((packed)) master_cmd_t;
+    typedef std::function<void(const master_cmd_t &cmd)> CommandHandler;
 
     /**
-     * @struct peers_t
-     * @brief Represents a peer device in the ESP-NOW network.
+     * @brief Handler for changed data received from a slave (master mode).
+     *
+     * The data is a view into the received frame and is only valid during the call.
      */
-    typedef struct
-    {
-        uint8_t peerID;        ///< Unique identifier for the peer
-        uint8_t peer_mac[6];   ///< MAC address of the peer
-    } __attribute__((packed)) peers_t;
+    typedef std::function<void(uint8_t peerID, const slave_data_t &data)> SlaveDataHandler;
+
+    /**
+     * @brief Handler for FRAME_USER frames received from any peer.
+     *
+     * The payload is a view into the received frame and is only valid during the call.
+     */
+    typedef std::function<void(uint8_t peerID, const uint8_t *data, size_t len)> UserFrameHandler;
+
+    /**
+     * @brief Handler for button edges received from a slave in redundant edge mode (master mode).
+     *
+     * The edge is a view into the received frame and is only valid during the call.
+     */
+    typedef std::function<void(uint8_t peerID, const edge_event_t &edge)> EdgeHandler;
 
-public:
     /**
      * @brief Initializes the ESP-NOW communication.
      * @param isMaster Indicates if the device is operating in master mode.
@@ -97,6 +456,27 @@ public:
      */
     void end();
 
+    /**
+     * @brief Runs the ESP-NOW updates in a dedicated, pinned task.
+     *
+     * While the task runs, update() only hands changed data to the task.
+     * @param core Core to pin the task to.
+     * @param priority FreeRTOS priority of the task.
+     * @param stackSize Stack size of the task in bytes.
+     * @return true if the task is running.
+     */
+    bool startTask(BaseType_t core = ESPNOW_TASK_CORE, UBaseType_t priority = ESPNOW_TASK_PRIORITY, uint32_t stackSize = ESPNOW_TASK_STACK_SIZE);
+
+    /**
+     * @brief Stops the ESP-NOW task; update() transmits directly again.
+     */
+    void stopTask();
+
+    /**
+     * @brief Wakes the ESP-NOW task, if it is running.
+     */
+    void notify();
+
     /**
      * @brief Adds a peer to the ESP-NOW network.
      * @param peer_addr MAC address of the peer to be added.
@@ -117,16 +497,265 @@ public:
     /**
      * @brief Sends a unicast message to a specific peer.
      * @param peer_mac MAC address of the target peer.
-     * @param data Pointer to the data to be sent.
-     * @param len Length of the data to be sent.
+     * @param type Frame type written into the header.
+     * @param data Pointer to the payload to be sent.
+     * @param len Length of the payload, at most ESPNOW_MAX_PAYLOAD_LEN.
      */
-    void sendUnicast(const uint8_t *peer_mac, const uint8_t *data, size_t len);
+    void sendUnicast(const uint8_t *peer_mac, FrameType type, const uint8_t *data, size_t len);
 
     /**
      * @brief Periodically updates the state of the ESP-NOW communication.
+     *
+     * With the ESP-NOW task running, this only hands changed data to the task.
      */
     void update();
 
+    /**
+     * @brief Hands new slave data to the transmit path, e.g. from a scan timer.
+     *
+     * Use this instead of writing slaveSendData when the data is produced
+     * outside of loop(). Must only be called from one context. Once called,
+     * update() no longer reads slaveSendData.
+     * @param data The data to send.
+     */
+    void submit(const slave_data_t &data);
+
+    /**
+     * @brief Returns the link statistics of a peer.
+     * @param peerID Peer ID.
+     * @return Pointer to the statistics, or nullptr if the ID is not in use.
+     */
+    const peer_stats_t *getPeerStats(uint8_t peerID) const;
+
+    /**
+     * @brief Collects the link statistics of a peer and the local histograms.
+     * @param peerID Peer ID, 1 for the master on a slave.
+     * @param out Destination for the statistics.
+     * @return false if the ID is not in use.
+     */
+    bool getLinkStats(uint8_t peerID, link_stats_t &out) const;
+
+    /**
+     * @brief Returns one of the local duration histograms.
+     *
+     * HIST_LOOP and HIST_SCAN are recorded by the application, each from a
+     * single context.
+     * @param id Histogram to return.
+     */
+    EmcHistogram &getHistogram(StatsHistogram id) { return histograms[id < HIST_COUNT ? id : HIST_LOOP]; }
+
+    /**
+     * @brief Clears the counters of all peers and the local histograms.
+     */
+    void resetStats();
+
+    /**
+     * @brief Asks all slaves for their link statistics (master mode).
+     *
+     * Queues a CMD_GET with mainId ESPNOW_CMD_STATS. Every slave answers with
+     * a FRAME_STATS frame, see tryGetRemoteStats().
+     * @param reset true to let the slaves clear their statistics after the report.
+     * @return false if the command queue is full.
+     */
+    bool requestStats(bool reset = false);
+
+    /**
+     * @brief Copies the last statistics reported by a slave (master mode).
+     * @param peerID Peer ID of the slave.
+     * @param out Destination for the statistics.
+     * @return true if a report arrived since the last call.
+     */
+    bool tryGetRemoteStats(uint8_t peerID, link_stats_t &out);
+
+    /**
+     * @brief Returns the overall link state.
+     *
+     * On a slave this is the link to the master. On a master it is the best
+     * link to any slave.
+     */
+    LinkState getLinkState() const;
+
+    /**
+     * @brief Returns the link state of one peer.
+     * @param peerID Peer ID.
+     * @return Link state, LINK_LOST if the ID is not in use.
+     */
+    LinkState getLinkState(uint8_t peerID) const;
+
+    /**
+     * @brief Configures heartbeats and link timeouts.
+     * @param heartbeatMs Time without a frame to a peer before a heartbeat is sent.
+     * @param degradedMs Time without a frame from a peer before its link is degraded.
+     * @param lostMs Time without a frame from a peer before it is lost and removed.
+     */
+    void setLinkTimeouts(unsigned long heartbeatMs, unsigned long degradedMs, unsigned long lostMs);
+
+    /**
+     * @brief Queues a command for transmission to all slaves (master mode).
+     *
+     * Queued commands are packed into as few frames as possible by update()
+     * and delivered to the slaves in order, so several commands issued in one
+     * control cycle are not lost. A batch a slave does not acknowledge is
+     * sent again, and the slave drops the commands it already has, so every
+     * slave connected at the time gets each command exactly once. While a
+     * slave lags behind, the commands wait here, so the queue can fill up.
+     * @param cmd Command to queue.
+     * @return false if the queue is full.
+     */
+    bool queueCommand(const master_cmd_t &cmd);
+
+    /**
+     * @brief Removes the oldest command the master queued with queueCommand() (slave mode).
+     * @param out Destination for the command.
+     * @return false if no command is waiting.
+     */
+    bool popCommand(master_cmd_t &out);
+
+    /**
+     * @brief Registers a handler for commands the master queued with queueCommand() (slave mode).
+     *
+     * A direct handler runs in the WiFi task for every received command and
+     * must return quickly. A deferred handler runs from update(), or from the
+     * ESP-NOW task when it is running. Register handlers before begin().
+     * @param handler Handler to call, nullptr to remove it.
+     * @param deferred true to call the handler outside of the WiFi task.
+     */
+    void onCommand(CommandHandler handler, bool deferred = false);
+
+    /**
+     * @brief Registers a handler for changed slave data (master mode).
+     *
+     * A direct handler runs in the WiFi task on every change, a deferred
+     * handler runs like a deferred onCommand() handler and only sees the
+     * latest data of each slave. Register handlers before begin().
+     * @param handler Handler to call, nullptr to remove it.
+     * @param deferred true to call the handler outside of the WiFi task.
+     */
+    void onSlaveData(SlaveDataHandler handler, bool deferred = false);
+
+    /**
+     * @brief Registers a handler for FRAME_USER frames, sent with sendUnicast().
+     *
+     * The handler runs in the WiFi task for every new frame and must return
+     * quickly. Duplicates of resent frames are dropped before. Register the
+     * handler before begin().
+     * @param handler Handler to call, nullptr to remove it.
+     */
+    void onUserFrame(UserFrameHandler handler);
+
+    /**
+     * @brief Registers a handler for button edges of slaves in redundant edge mode (master mode).
+     *
+     * The handler runs in the WiFi task once for every edge, in the order of
+     * the edges, and must return quickly. Register the handler before begin().
+     * @param handler Handler to call, nullptr to remove it.
+     */
+    void onEdge(EdgeHandler handler);
+
+    /**
+     * @brief Enables delta encoding of the slave uplink (slave mode).
+     *
+     * When enabled, a change only sends the words that differ from the last
+     * keyframe. A full keyframe is sent after @p keyframeIntervalMs, after a
+     * send failure, or when a delta would not be much smaller.
+     * @param enabled true to send deltas, false to always send full frames.
+     * @param keyframeIntervalMs Interval for full keyframes.
+     */
+    void setCompactUplink(bool enabled, unsigned long keyframeIntervalMs = ESPNOW_KEYFRAME_INTERVAL_MS);
+
+    /**
+     * @brief Enables redundant transmission of button edges (slave mode).
+     *
+     * Every frame with a new button edge goes out @p copies times,
+     * @p spacingUs apart and under one sequence number, so a lost frame no
+     * longer waits for a retry; the master drops the extra copies as
+     * duplicates. Every data frame also carries the latest edges with their
+     * timestamps, so the master sees a short tap even if both of its frames
+     * were lost, see onEdge(). The master needs no configuration.
+     * @param enabled true to send copies and edges.
+     * @param copies Transmissions of every frame with a new edge, including the first.
+     * @param spacingUs Time between two copies.
+     */
+    void setRedundantEdges(bool enabled, uint8_t copies = ESPNOW_EDGE_COPIES, unsigned long spacingUs = ESPNOW_EDGE_SPACING_US);
+
+    /**
+     * @brief Configures resending of unacknowledged frames and eviction of peers.
+     * @param maxRetries Resends of one frame before it is given up.
+     * @param backoffUs Delay before the first resend, doubled for every further one.
+     * @param evictFailures Consecutive frames given up after all resends after which a peer is removed.
+     * @param timeoutMs Time without an acknowledged frame after which a failing peer is removed.
+     */
+    void setRetryPolicy(uint8_t maxRetries, unsigned long backoffUs, uint16_t evictFailures, unsigned long timeoutMs);
+
+    /**
+     * @brief Enables automatic channel selection. Call before begin().
+     *
+     * A master surveys all channels at begin(), picks the quietest one and
+     * moves all slaves to another channel when the loss on its channel exceeds
+     * @p lossThreshold. A slave searches all channels during discovery.
+     * @param enabled true to select the channel automatically.
+     * @param lossThreshold Share of failed frames that triggers a channel change (master).
+     */
+    void setAutoChannel(bool enabled, float lossThreshold = ESPNOW_HOP_LOSS_THRESHOLD);
+
+    /**
+     * @brief Returns the WiFi channel currently used.
+     */
+    uint8_t getChannel() const { return channel; }
+
+    /**
+     * @brief Selects the WiFi channel.
+     *
+     * Before begin() this sets the channel to start on. A running master
+     * announces the change to its slaves and switches ESPNOW_HOP_DELAY_MS
+     * later, like an automatic channel change.
+     * @param newChannel Channel from ESPNOW_CHANNEL_MIN to ESPNOW_CHANNEL_MAX.
+     * @return false if the channel is invalid, a switch is already scheduled or a running slave calls it.
+     */
+    bool setChannel(uint8_t newChannel);
+
+    /**
+     * @brief Configures the master command transmit policy.
+     * @param keepAliveMs Interval for repeating an unchanged command.
+     * @param maxFrameRate Maximum command frames per second and slave, 0 for no limit.
+     */
+    void setCommandRate(unsigned long keepAliveMs, unsigned long maxFrameRate);
+
+    /**
+     * @brief Enables WiFi modem sleep for ESP-NOW.
+     *
+     * The radio is only powered for @p wakeWindowMs in every @p wakeIntervalMs,
+     * frames sent by the peer outside of the window are lost or retried.
+     * @param enabled true to let the radio sleep.
+     * @param wakeIntervalMs Interval in which the radio wakes up.
+     * @param wakeWindowMs Time the radio stays awake per interval.
+     */
+    void setPowerSave(bool enabled, uint16_t wakeIntervalMs = ESPNOW_PS_WAKE_INTERVAL_MS,
+                      uint16_t wakeWindowMs = ESPNOW_PS_WAKE_WINDOW_MS);
+
+    /**
+     * @brief Enables the scheduled (TDMA) mode (master mode).
+     *
+     * The master broadcasts a sync at the start of every cycle. Slot n of the
+     * cycle belongs to the slave with peer ID n, slot 0 to the master's
+     * command frames, so slaves no longer transmit at the same time and the
+     * uplink latency is bounded by one cycle. Slaves follow the syncs without
+     * any configuration; run them with startTask(), so they meet their slot.
+     * @param enabled true to send syncs, false to let the slaves transmit freely again.
+     * @param slotUs Length of one slot.
+     * @param guardUs Time at the end of a slot in which no frame starts.
+     * @return false if @p guardUs leaves no time to start a frame.
+     */
+    bool setScheduled(bool enabled, uint16_t slotUs = ESPNOW_TDMA_SLOT_US, uint16_t guardUs = ESPNOW_TDMA_GUARD_US);
+
+    /**
+     * @brief Checks whether transmissions follow the schedule.
+     *
+     * On a master this is the setting of setScheduled(), on a slave whether
+     * it has a slot in the syncs of its master.
+     */
+    bool isScheduled() const;
+
     /**
      * @brief Callback function for handling received data.
      * @param recv_info Information about the received data.
@@ -140,18 +769,69 @@ public:
      */
     void resetData();
 
+    /**
+     * @brief Copies the master's current command, its masterCmdData (slave mode).
+     *
+     * Safe to call from loop() while the WiFi task is receiving; the copy is
+     * never torn. Returns false if the current command did not change since
+     * the last call; keep-alive repeats do not count as a change. Queued
+     * commands are passed to popCommand() and onCommand() instead.
+     * @param out Destination for the command.
+     * @return true if @p out holds a command that was not returned before.
+     */
+    bool tryGetLatest(master_cmd_t &out);
+
+    /**
+     * @brief Merges the latest data of all slaves into one frame (master mode).
+     *
+     * The button bits of every slot are OR'ed together and the analog data is
+     * taken from the slave with the lowest peer ID. Returns false if no slave
+     * sent anything new since the last call.
+     * @param out Destination for the merged slave data.
+     * @return true if at least one slot changed since the last call.
+     */
+    bool tryGetLatest(slave_data_t &out);
+
+    /**
+     * @brief Copies the latest data received from one slave (master mode).
+     * @param peerID Peer ID of the slave.
+     * @param out Destination for the slave data.
+     * @param recvMicros Optional destination for the receive timestamp.
+     * @return true if the slot received new data since the last call.
+     */
+    bool tryGetLatest(uint8_t peerID, slave_data_t &out, unsigned long *recvMicros = nullptr);
+
+    /**
+     * @brief Checks whether a slave slot received data that was not read yet.
+     * @param peerID Peer ID of the slave.
+     * @return true if tryGetLatest() for this slot would return new data.
+     */
+    bool isUpdated(uint8_t peerID) const;
+
     slave_data_t slaveSendData;         ///< Data to be sent by the slave
-    slave_data_t masterRecvData;        ///< Data received by the master
 
-    master_cmd_t masterCmdData;         ///< Current command data from the master
-    master_cmd_t lastmasterCmdData;     ///< Last command data from the master
+    master_cmd_t masterCmdData;         ///< Command data to be sent by the master
+    master_cmd_t lastmasterCmdData;     ///< Last command data sent by the master
 
-    std::vector<peers_t> peers;         ///< List of peers in the network
+    EmcPeerTable peers;                 ///< Peers in the network, indexed by peer ID, changed under peerLock
 
 private:
     slave_data_t lastSlaveSendData;     ///< Last data sent by the slave
 
     unsigned long broadcastMillis = 0;  ///< Timer for broadcast messages
+    unsigned long discoveryIntervalMs = ESPNOW_DISCOVERY_MIN_MS; ///< Current slave discovery interval, grows with backoff
+    volatile bool discoveryReplyPending = false; ///< The master has discovery broadcasts to answer
+
+    unsigned long cmdKeepAliveMs = ESPNOW_CMD_KEEPALIVE_MS;                ///< Interval for repeating an unchanged command
+    unsigned long cmdMinIntervalUs = 1000000UL / ESPNOW_CMD_MAX_RATE;      ///< Minimum time between command frames to one slave
+    unsigned long cmdSentMicros[ESPNOW_MAX_PEERS] = {0};                   ///< Last command frame sent to each slave
+    bool cmdPending[ESPNOW_MAX_PEERS] = {false};                           ///< Slaves that still need the current command
+    master_cmd_t cmdLog[ESPNOW_CMD_QUEUE_SIZE];                            ///< Commands taken from cmdQueue, kept until every slave acknowledged them
+    uint16_t cmdLogHead = 0;                                               ///< Number the next command in cmdLog gets
+    volatile uint16_t cmdAcked[ESPNOW_MAX_PEERS] = {0};                    ///< Number of the first command each slave did not acknowledge
+    volatile uint16_t cmdInFlight[ESPNOW_MAX_PEERS] = {0};                 ///< Number after the last command in each slave's transmit slot
+    uint16_t cmdRecvNext = 0;                                              ///< Number of the next command the slave expects
+    bool cmdRecvValid = false;                                             ///< cmdRecvNext was set by a command frame
 
     const char *BROADCAST_SLAVE_MESSAGE = "EMCFFBV2 Slave!";  ///< Broadcast message for slaves
     const char *BROADCAST_MASTER_MESSAGE = "EMCFFBV2 Master!"; ///< Broadcast message for master
@@ -159,11 +839,344 @@ private:
     const uint8_t BROADCAST_MAC_SLAVE[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFD}; ///< Broadcast MAC for slaves
     const uint8_t BROADCAST_MAC_MASTER[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFE}; ///< Broadcast MAC for master
 
+    EmcSeqLock<slave_slot_t> masterRecvData[ESPNOW_MAX_PEERS]; ///< Per-slave data received by the master, indexed by peer ID
+    uint32_t masterRecvSeen[ESPNOW_MAX_PEERS] = {0};            ///< Last slot sequence handed to the per-slave reader
+    uint32_t masterMergedSeen[ESPNOW_MAX_PEERS] = {0};          ///< Last slot sequence consumed by the merged reader
+
+    EmcSeqLock<master_cmd_t> slaveRecvCmd;   ///< Command received by the slave, written by the WiFi task
+    uint32_t slaveRecvCmdSeen = 0;           ///< Last slaveRecvCmd sequence handed to the reader
+
+    bool compactUplink = false;                                        ///< Slave sends deltas instead of full frames
+    unsigned long keyframeIntervalMs = ESPNOW_KEYFRAME_INTERVAL_MS;    ///< Interval for full keyframes
+    unsigned long keyframeMillis = 0;                                  ///< Time the last keyframe was sent
+    slave_data_t keyframeData;                                         ///< Last keyframe sent by the slave
+    uint16_t keyframeSeq = 0;                                          ///< Sequence number of the last keyframe sent
+    bool lastWasDelta = false;                                         ///< The last uplink frame was a delta
+    volatile bool forceKeyframe = true;                                ///< Next uplink frame must be a keyframe
+
+    bool redundantEdges = false;                                       ///< Slave sends copies and the edge history
+    uint8_t edgeCopies = ESPNOW_EDGE_COPIES;                           ///< Transmissions of every frame with a new edge
+    unsigned long edgeSpacingUs = ESPNOW_EDGE_SPACING_US;              ///< Time between two copies
+    uint8_t edgeButtons[sizeof(slave_data_t::button_data)] = {0};      ///< Buttons the edge detector saw last, owned by the producer
+    EmcRingBuffer<edge_event_t, ESPNOW_EDGE_QUEUE_SIZE> edgeQueue;     ///< Edges handed from update() or submit() to the transmit path
+    edge_event_t edgeHistory[ESPNOW_EDGE_HISTORY];                     ///< Latest edges, oldest first, repeated in every data frame
+    uint8_t edgeHistoryCount = 0;                                      ///< Edges in edgeHistory
+    uint16_t edgeNext = 0;                                             ///< Number of the next edge taken into the history
+
+    uint16_t rxEdgeNext[ESPNOW_MAX_PEERS] = {0};                       ///< Number of the next edge expected from each slave
+    bool rxEdgeValid[ESPNOW_MAX_PEERS] = {false};                      ///< rxEdgeNext holds a number from this slave
+
+    slave_data_t rxKeyframe[ESPNOW_MAX_PEERS];                         ///< Last keyframe received from each slave
+    uint16_t rxKeyframeSeq[ESPNOW_MAX_PEERS] = {0};                    ///< Sequence number of each slave's keyframe
+    bool rxKeyframeValid[ESPNOW_MAX_PEERS] = {false};                  ///< rxKeyframe holds a keyframe of this slave
+
+    peer_stats_t peerStats[ESPNOW_MAX_PEERS] = {};  ///< Link statistics, indexed by peer ID
+    uint16_t txSeq[ESPNOW_MAX_PEERS] = {0};         ///< Next sequence number to each peer, indexed by peer ID
+
+    EmcHistogram histograms[HIST_COUNT];                    ///< Duration histograms, indexed by StatsHistogram
+    EmcSeqLock<link_stats_t> remoteStats[ESPNOW_MAX_PEERS]; ///< Last statistics reported by each slave (master mode)
+    uint32_t remoteStatsSeen[ESPNOW_MAX_PEERS] = {0};       ///< Last report sequence handed to the reader
+    volatile bool statsRequested = false;                   ///< The master asked for a statistics report (slave mode)
+    volatile bool statsResetRequested = false;              ///< Clear the statistics after the report
+
+    /**
+     * @struct tdma_beacon_t
+     * @brief Payload of the FRAME_SYNC frames of the master, with room for every slot.
+     */
+    typedef struct
+    {
+        tdma_sync_t sync;                       ///< Slot timing
+        uint8_t macs[ESPNOW_MAX_PEERS - 1][6];  ///< Slave of each slot from 1, zero if free
+    } __attribute__((packed)) tdma_beacon_t;
+
+    /**
+     * @struct tdma_slot_t
+     * @brief Own transmit slot of a slave, taken from the last sync.
+     */
+    typedef struct
+    {
+        uint32_t syncMicros; ///< esp_timer_get_time() when the sync arrived, truncated to 32 bits
+        uint32_t cycleUs;    ///< Length of the cycle
+        uint32_t offsetUs;   ///< Start of the own slot after the sync, 0 if the sync has no slot for us
+        uint32_t windowUs;   ///< Time from the start of the slot in which a frame may start
+    } tdma_slot_t;
+
+    bool scheduled = false;                      ///< The master sends syncs and assigns slots
+    uint16_t tdmaSlotUs = ESPNOW_TDMA_SLOT_US;   ///< Length of one slot (master mode)
+    uint16_t tdmaGuardUs = ESPNOW_TDMA_GUARD_US; ///< End of a slot in which no frame starts (master mode)
+    unsigned long tdmaCycleUs = 0;               ///< Period of the running sync timer, 0 if it is stopped (master mode)
+    EmcSeqLock<tdma_beacon_t> tdmaBeacon;        ///< Sync payload built by process(), sent by the timer (master mode)
+    uint16_t tdmaSyncSeq = 0;                    ///< Sequence number of the next sync, only used by the timer
+    volatile uint32_t tdmaSyncMicros = 0;        ///< esp_timer_get_time() of the last sync sent (master mode)
+    EmcSeqLock<tdma_slot_t> tdmaSlot;            ///< Own slot, written by the WiFi task (slave mode)
+    esp_timer_handle_t tdmaTimer = nullptr;      ///< Sync timer on a master, slot timer on a slave
+    uint8_t ownMac[6] = {0};                     ///< Station MAC address of this device
+
+    /**
+     * @struct tx_slot_t
+     * @brief Last frame sent to a peer, kept for resending it.
+     */
+    typedef struct
+    {
+        uint8_t frame[ESP_NOW_MAX_DATA_LEN]; ///< Header and payload as sent
+        uint8_t len;                         ///< Length of frame
+        uint8_t attempts;                    ///< Resends of this frame so far
+        unsigned long retryAtMicros;         ///< Time the resend is due
+        unsigned long sentMillis;            ///< Time the frame was sent
+        uint32_t sentMicros;                 ///< esp_timer_get_time() of the last transmission, for HIST_ACK
+        volatile bool retryPending;          ///< The frame failed and waits for a resend
+        volatile uint8_t copiesLeft;         ///< Redundant copies still to send
+        unsigned long copyAtMicros;          ///< Time the next copy is due
+        volatile bool acked;                 ///< A transmission of the frame was acknowledged
+        uint32_t txCount;                    ///< Transmissions accepted by the driver, each gets one send status
+        volatile uint32_t frameTxCount;      ///< txCount at the first transmission of this frame
+        uint32_t statusCount;                ///< Send statuses received, written by the WiFi task
+    } tx_slot_t;
+
+    LinkState linkStates[ESPNOW_MAX_PEERS] = {};        ///< Link state of each peer, indexed by peer ID
+    LinkState linkState = LINK_DISCOVERING;             ///< State while no peer is connected
+    unsigned long heartbeatMs = ESPNOW_HEARTBEAT_MS;    ///< Time without a frame to a peer before a heartbeat
+    unsigned long degradedMs = ESPNOW_DEGRADED_MS;      ///< Time without a frame from a peer before it is degraded
+    unsigned long lostMs = ESPNOW_LOST_MS;              ///< Time without a frame from a peer before it is lost
+
+    tx_slot_t txSlots[ESPNOW_MAX_PEERS];                ///< Last frame sent to each peer, indexed by peer ID
+    uint8_t maxRetries = ESPNOW_MAX_RETRIES;            ///< Resends of one frame before it is given up
+    unsigned long retryBackoffUs = ESPNOW_RETRY_BACKOFF_US; ///< Delay before the first resend
+    uint16_t evictFailures = ESPNOW_EVICT_FAILURES;     ///< Consecutive failures that remove a peer
+    unsigned long peerTimeoutMs = ESPNOW_PEER_TIMEOUT_MS; ///< Time without acknowledge that removes a failing peer
+
+    EmcSeqLock<slave_data_t> slaveTxData;    ///< slaveSendData handed from update() or submit() to the task
+    volatile bool slaveSubmitted = false;    ///< Slave data comes from submit(), not from slaveSendData
+    EmcSeqLock<master_cmd_t> masterTxCmd;    ///< masterCmdData handed from update() to the task
+    TaskHandle_t volatile taskHandle = nullptr; ///< ESP-NOW task, nullptr if update() transmits directly
+    volatile bool taskRunning = false;       ///< Cleared to ask the task to exit
+
+    CommandHandler commandHandler;           ///< User handler for received commands
+    SlaveDataHandler slaveDataHandler;       ///< User handler for changed slave data
+    UserFrameHandler userFrameHandler;       ///< User handler for FRAME_USER frames
+    EdgeHandler edgeHandler;                 ///< User handler for received button edges
+    bool commandDeferred = false;            ///< commandHandler runs from dispatch()
+    bool slaveDataDeferred = false;          ///< slaveDataHandler runs from dispatch()
+    EmcRingBuffer<master_cmd_t, ESPNOW_CMD_QUEUE_SIZE> cmdDispatchQueue; ///< Commands waiting for the deferred handler
+    uint32_t dispatchSeen[ESPNOW_MAX_PEERS] = {0};                      ///< Last slot sequence passed to the deferred handler
+
+    EmcRingBuffer<master_cmd_t, ESPNOW_CMD_QUEUE_SIZE> cmdQueue;     ///< Commands waiting to be sent by the master
+    EmcRingBuffer<master_cmd_t, ESPNOW_CMD_QUEUE_SIZE> cmdRecvQueue; ///< Commands received by the slave, in order
+
     bool isMaster = false;              ///< Indicates if the device is in master mode
-    bool masterHasCommand = false;      ///< Indicates if the master has a command to process
+    uint8_t channel = ESPNOW_WIFI_CHANNEL; ///< WiFi channel used for ESP-NOW
+    bool autoChannel = false;           ///< Select the channel automatically
+    float hopLossThreshold = ESPNOW_HOP_LOSS_THRESHOLD; ///< Share of failed frames that triggers a channel change
+    uint32_t channelScore[ESPNOW_CHANNEL_MAX + 1] = {0}; ///< Interference score per channel from the survey, lower is better
+    unsigned long hopCheckMillis = 0;   ///< Start of the current loss evaluation window
+    uint32_t hopTxOk = 0;               ///< Acknowledged frames at the start of the window
+    uint32_t hopTxFail = 0;             ///< Failed frames at the start of the window
+    volatile uint8_t pendingChannel = 0; ///< Channel to switch to, 0 if no switch is scheduled
+    unsigned long channelSwitchMillis = 0; ///< Time the scheduled switch happens
+    unsigned long channelAnnounceMillis = 0; ///< Last announcement of the scheduled switch
+    uint8_t discoveryStartChannel = 0;  ///< Channel a slave discovery cycle started on
+    unsigned long discoveryBackoffMs = ESPNOW_DISCOVERY_MIN_MS; ///< Pause between discovery cycles over all channels
+    bool masterRestored = false;        ///< The master was restored from RTC memory and has not answered yet
 
     static EmcEspNow *instance;         ///< Singleton instance of the class
 
+    portMUX_TYPE peerLock = portMUX_INITIALIZER_UNLOCKED; ///< Guards the peer table and the receive slots, shared by the WiFi task and the transmit context
+
+#ifdef ESPNOW_SIMULATION
+    friend class EmcSimNode;            ///< Points instance at the simulated device that runs, see test/mock
+#endif
+
+    /**
+     * @brief Sends a frame with a header to a peer.
+     * @param peer_mac MAC address of the target.
+     * @param peerID Peer ID of the target, selects the sequence counter.
+     * @param type Frame type written into the header.
+     * @param data Payload.
+     * @param len Length of the payload.
+     * @return Sequence number written into the header.
+     */
+    uint16_t sendFrame(const uint8_t *peer_mac, uint8_t peerID, FrameType type, const void *data, size_t len);
+
+    /**
+     * @brief Looks up a peer ID under peerLock, safe from the WiFi task and the transmit context.
+     * @param peer_mac MAC address of the peer.
+     * @return Peer ID, or -1 if the peer is unknown.
+     */
+    int findPeer(const uint8_t *peer_mac);
+
+    /**
+     * @brief Runs one transmit cycle.
+     * @param tx Slave data to send (slave mode).
+     * @param cmd Current command to send (master mode).
+     */
+    void process(const slave_data_t &tx, const master_cmd_t &cmd);
+
+    /**
+     * @brief Sends slave data to the master as a keyframe or a delta.
+     * @param tx Slave data to send.
+     * @param changed @p tx differs from the last frame sent or new edges are waiting.
+     * @param newEdges The frame carries edges that were not sent before, it goes out as copies.
+     */
+    void sendSlaveData(const slave_data_t &tx, bool changed, bool newEdges);
+
+    /**
+     * @brief Checks whether a forced keyframe without a change may replace the last frame (slave mode).
+     * @return true once the last frame was acknowledged or given up.
+     */
+    bool keyframeRepairDue() const;
+
+    /**
+     * @brief Checks whether the transmit slot of a slave holds a command batch that is not settled (master mode).
+     * @param peerID The peer ID of the slave.
+     * @return true while the batch waits for its send status or a resend.
+     */
+    bool cmdBatchOpen(uint8_t peerID) const;
+
+    /**
+     * @brief Queues the button edges between the last data and @p data (slave mode).
+     * @param data Slave data just handed to the transmit path.
+     */
+    void recordEdges(const slave_data_t &data);
+
+    /**
+     * @brief Moves queued edges into the history and drops edges older than ESPNOW_EDGE_HOLD_MS.
+     * @return true if a new edge was taken into the history.
+     */
+    bool takeEdges();
+
+    /**
+     * @brief Writes the edge block of a data frame.
+     * @param out Destination, room for a full edge history.
+     * @return Length of the block.
+     */
+    size_t writeEdges(uint8_t *out) const;
+
+    /**
+     * @brief Sends the last frame to the master again, as often as setRedundantEdges() asks (slave mode).
+     */
+    void scheduleCopies();
+
+    /**
+     * @brief Wakes the ESP-NOW task when the next copy is due, unless the slot timer does (slave mode).
+     */
+    void armCopyTimer();
+
+    /**
+     * @brief Hands the edges of a received edge block to the edge handler (master mode).
+     * @param peerID Peer ID of the slave.
+     * @param block The edge block.
+     * @param len Length of the block.
+     */
+    void receiveEdges(uint8_t peerID, const uint8_t *block, int len);
+
+    /**
+     * @brief Calls the deferred handlers for everything received since the last call.
+     */
+    void dispatch();
+
+    /**
+     * @brief Resends frames whose retry backoff elapsed.
+     */
+    void processRetries();
+
+    /**
+     * @brief Updates the link states, removes lost peers and sends heartbeats.
+     */
+    void updateLinks();
+
+    /**
+     * @brief Scans all channels for access points and scores their interference.
+     * @return The quietest channel.
+     */
+    uint8_t surveyChannels();
+
+    /**
+     * @brief Moves WiFi and all peers to another channel.
+     * @param newChannel Channel to switch to.
+     */
+    void switchChannel(uint8_t newChannel);
+
+    /**
+     * @brief Evaluates the loss on the current channel and runs a scheduled channel switch.
+     */
+    void updateChannel();
+
+    /**
+     * @brief Schedules an announced switch of master and slaves to another channel.
+     * @param newChannel Channel to switch to.
+     */
+    void scheduleChannel(uint8_t newChannel);
+
+    /**
+     * @brief Records the send status of a frame and schedules a retry or evicts the peer.
+     * @param mac_addr MAC address of the destination.
+     * @param status Status of the send operation.
+     */
+    void handleSendStatus(const uint8_t *mac_addr, esp_now_send_status_t status);
+
+    /**
+     * @brief Returns how long the ESP-NOW task may sleep.
+     * @return Sleep time in ticks.
+     */
+    TickType_t nextWakeTicks() const;
+
+    /**
+     * @brief Publishes data received from a slave into its receive slot.
+     * @param peerID Peer ID of the slave.
+     * @param data Received slave data.
+     */
+    void storeSlaveData(uint8_t peerID, const slave_data_t &data);
+
+    /**
+     * @brief Checks the sequence number of a received frame and updates the peer statistics.
+     * @param peerID Peer ID of the sender.
+     * @param header Header of the received frame.
+     * @return false if the frame is a duplicate or stale and must be dropped.
+     */
+    bool acceptSequence(uint8_t peerID, const frame_header_t *header);
+
+    /**
+     * @brief Sends the local statistics to the master if it asked for them (slave mode).
+     */
+    void sendStatsReport();
+
+    /**
+     * @brief Rebuilds the slot table and runs the sync timer at the cycle length (master mode).
+     */
+    void updateSchedule();
+
+    /**
+     * @brief Broadcasts the sync that starts a cycle, runs in the esp_timer task (master mode).
+     */
+    void sendSync();
+
+    /**
+     * @brief Takes the own slot from a received sync and arms the slot timer (slave mode).
+     * @param payload Payload of the FRAME_SYNC frame.
+     * @param len Length of the payload.
+     */
+    void followSync(const uint8_t *payload, int len);
+
+    /**
+     * @brief Copies the own slot if the syncs of the master are current (slave mode).
+     * @param out Destination for the slot.
+     * @return false if the slave transmits freely.
+     */
+    bool currentSlot(tdma_slot_t &out) const;
+
+    /**
+     * @brief Checks whether the schedule lets this device transmit now.
+     *
+     * Always true without a schedule.
+     */
+    bool slotOpen() const;
+
+    /**
+     * @brief esp_timer callback, sends the sync on a master and wakes the task for the slot or the next copy on a slave.
+     * @param arg The EmcEspNow instance.
+     */
+    static void onScheduleTimer(void *arg);
+
     /**
      * @brief Callback function for handling send status.
      * @param mac_addr MAC address of the target peer.
@@ -173,7 +1186,7 @@ private:
 
     /**
      * @brief Task function for processing ESP-NOW events.
-     * @param pvParameters Parameters for the task function.
+     * @param pvParameters The EmcEspNow instance.
      */
     static void espNowTask(void *pvParameters);
 };
@@ -0,0 +1,73 @@
+/*
+ * EmcGpioSampler.cpp
+ *
+ *  Created on: 14.10.2026
+ *      Author: daenzell
+ */
+
+#include "EmcGpioSampler.h"
+
+/**
+ * @brief Precomputes register, bit and inversion masks for a group of pins.
+ *
+ * The pins must already be configured as inputs with pinMode(). If the pins
+ * are consecutive GPIOs within one input register, extract() takes them with
+ * one shift and mask instead of one per pin.
+ *
+ * @param[in] pins The GPIO numbers of the group.
+ * @param[in] count The number of pins.
+ * @param[in] activeLow true if the inputs read low while pressed (pull-up wiring).
+ * @return false if a pin does not exist or the group is larger than MAX_PINS.
+ */
+bool EmcGpioSampler::begin(const uint8_t *pins, uint8_t count, bool activeLow)
+{
+    this->count = 0;
+    if (count > MAX_PINS)
+    {
+        return false;
+    }
+
+    contiguous = count > 0;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (pins[i] >= SOC_GPIO_PIN_COUNT)
+        {
+            return false;
+        }
+        bank[i] = pins[i] / 32;
+        shift[i] = pins[i] % 32;
+        if (i > 0 && (bank[i] != bank[0] || shift[i] != shift[0] + i))
+        {
+            contiguous = false;
+        }
+    }
+
+    this->count = count;
+    lowMask = count >= 32 ? 0xFFFFFFFFUL : (1UL << count) - 1;
+    invertMask = activeLow ? lowMask : 0;
+    firstBank = count ? bank[0] : 0;
+    firstShift = count ? shift[0] : 0;
+    return true;
+}
+
+/**
+ * @brief Writes a group of bits into a packed bitmap, byte by byte.
+ *
+ * @param[out] bitmap The bitmap to write into, bit 0 of byte 0 first.
+ * @param[in] pos The bit position of the first bit.
+ * @param[in] value The bits to write, LSB first.
+ * @param[in] bits The number of bits to write.
+ */
+void EmcGpioSampler::pack(uint8_t *bitmap, uint16_t pos, uint32_t value, uint8_t bits)
+{
+    while (bits)
+    {
+        uint8_t offset = pos % 8;
+        uint8_t take = 8 - offset < bits ? 8 - offset : bits;
+        uint8_t mask = ((1 << take) - 1) << offset;
+        bitmap[pos / 8] = (bitmap[pos / 8] & ~mask) | ((value << offset) & mask);
+        value >>= take;
+        pos += take;
+        bits -= take;
+    }
+}
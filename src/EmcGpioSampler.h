@@ -0,0 +1,139 @@
+/*
+ * EmcGpioSampler.h
+ *
+ *  Created on: 14.10.2026
+ *      Author: daenzell
+ */
+
+#pragma once
+
+/**
+ * @file EmcGpioSampler.h
+ * @brief Samples groups of GPIO inputs straight from the GPIO input registers
+ *
+ * digitalRead() is a function call with pin checks per input. A sampler
+ * instead precomputes, for each pin of a group, which input register and bit
+ * it lives in. A scan step reads GPIO_IN_REG and GPIO_IN1_REG once and
+ * extracts all pins of the group with shifts and masks; active-low inputs are
+ * inverted with one XOR. Groups of consecutive GPIOs are extracted with a
+ * single shift. Matrix rows are driven through the write-1-to-set/clear
+ * registers, which are single stores.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "soc/soc.h"
+#include "soc/gpio_reg.h"
+#include "soc/soc_caps.h"
+
+/**
+ * @class EmcGpioSampler
+ * @brief Extracts a group of up to 32 GPIO inputs from the input registers.
+ */
+class EmcGpioSampler
+{
+public:
+    static const uint8_t MAX_PINS = 32; ///< Pins per group, the result is one word
+
+    /**
+     * @brief Raw snapshot of both GPIO input registers.
+     */
+    typedef struct
+    {
+        uint32_t in[2]; ///< GPIO_IN_REG (GPIO 0..31) and GPIO_IN1_REG (GPIO 32..)
+    } snapshot_t;
+
+    /**
+     * @brief Precomputes the masks for a group of pins. Call from setup().
+     * @param pins GPIO numbers, the first pin ends up in bit 0.
+     * @param count Number of pins, at most MAX_PINS.
+     * @param activeLow true if a pressed input reads low.
+     * @return false if a pin is invalid or there are too many pins.
+     */
+    bool begin(const uint8_t *pins, uint8_t count, bool activeLow);
+
+    /**
+     * @brief Reads both input registers once.
+     */
+    static inline snapshot_t read()
+    {
+        snapshot_t s;
+        s.in[0] = REG_READ(GPIO_IN_REG);
+        s.in[1] = REG_READ(GPIO_IN1_REG);
+        return s;
+    }
+
+    /**
+     * @brief Extracts the group from a register snapshot.
+     * @param s Snapshot from read().
+     * @return One bit per pin in configuration order, 1 = active.
+     */
+    inline uint32_t extract(const snapshot_t &s) const
+    {
+        uint32_t out;
+        if (contiguous)
+        {
+            out = (s.in[firstBank] >> firstShift) & lowMask;
+        }
+        else
+        {
+            out = 0;
+            for (uint8_t i = 0; i < count; i++)
+                out |= ((s.in[bank[i]] >> shift[i]) & 1UL) << i;
+        }
+        return out ^ invertMask;
+    }
+
+    /**
+     * @brief Reads the registers and extracts the group.
+     */
+    inline uint32_t sample() const { return extract(read()); }
+
+    /**
+     * @brief Returns the number of pins in the group.
+     */
+    uint8_t size() const { return count; }
+
+    /**
+     * @brief Drives an output low with a single register store.
+     * @param pin GPIO number, must be configured as output.
+     */
+    static inline void driveLow(uint8_t pin)
+    {
+        if (pin < 32)
+            REG_WRITE(GPIO_OUT_W1TC_REG, 1UL << pin);
+        else
+            REG_WRITE(GPIO_OUT1_W1TC_REG, 1UL << (pin - 32));
+    }
+
+    /**
+     * @brief Drives an output high with a single register store.
+     * @param pin GPIO number, must be configured as output.
+     */
+    static inline void driveHigh(uint8_t pin)
+    {
+        if (pin < 32)
+            REG_WRITE(GPIO_OUT_W1TS_REG, 1UL << pin);
+        else
+            REG_WRITE(GPIO_OUT1_W1TS_REG, 1UL << (pin - 32));
+    }
+
+    /**
+     * @brief Writes the low @p bits bits of a word into a packed bitmap.
+     * @param bitmap Bitmap to write into, LSB first.
+     * @param pos Bit position of the first bit.
+     * @param value Bits to write.
+     * @param bits Number of bits, at most 32.
+     */
+    static void pack(uint8_t *bitmap, uint16_t pos, uint32_t value, uint8_t bits);
+
+private:
+    uint8_t count = 0;           ///< Number of pins in the group
+    uint8_t bank[MAX_PINS];      ///< Input register of each pin
+    uint8_t shift[MAX_PINS];     ///< Bit of each pin in its register
+    uint32_t invertMask = 0;     ///< XOR mask applied to the result
+    bool contiguous = false;     ///< Pins are consecutive GPIOs in one register
+    uint8_t firstBank = 0;       ///< Register of the first pin
+    uint8_t firstShift = 0;      ///< Bit of the first pin
+    uint32_t lowMask = 0;        ///< Mask of count low bits
+};
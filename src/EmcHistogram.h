@@ -0,0 +1,117 @@
+/*
+ * EmcHistogram.h
+ *
+ *  Created on: 14.10.2026
+ *      Author: daenzell
+ */
+
+#pragma once
+
+/**
+ * @file EmcHistogram.h
+ * @brief Allocation-free duration histogram with power-of-two buckets
+ *
+ * Bucket 0 counts zero durations and bucket n counts durations from 2^(n-1)
+ * up to 2^n - 1 microseconds; the last bucket is open-ended. Recording is a
+ * count-leading-zeros and a few increments, so it can be used on every loop
+ * and scan. One context records, any context may read; a reader running
+ * concurrently may see one sample counted in the total but not yet in a bucket.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * @struct histogram_summary_t
+ * @brief Compact summary of a histogram, as reported to the master.
+ */
+typedef struct
+{
+    uint32_t count; ///< Number of samples
+    uint32_t p50;   ///< Median in microseconds, upper bound of its bucket
+    uint32_t p99;   ///< 99th percentile in microseconds, upper bound of its bucket
+    uint32_t max;   ///< Largest sample in microseconds
+} __attribute__((packed)) histogram_summary_t;
+
+class EmcHistogram
+{
+public:
+    static const uint8_t BUCKETS = 16; ///< The last bucket holds everything from 2^14 us on
+
+    /**
+     * @brief Adds a sample. Must only be called from one context.
+     * @param micros Duration in microseconds.
+     */
+    void record(uint32_t micros)
+    {
+        uint8_t bucket = micros ? 32 - __builtin_clz(micros) : 0;
+        bins[bucket < BUCKETS ? bucket : BUCKETS - 1]++;
+        total++;
+        sum += micros;
+        if (micros > maxValue)
+            maxValue = micros;
+    }
+
+    /**
+     * @brief Returns the value below which @p percent of the samples fall.
+     *
+     * The result is the upper bound of the bucket holding that sample, but
+     * never more than the largest sample.
+     * @param percent Percentile, 0 to 100.
+     * @return Duration in microseconds, 0 without samples.
+     */
+    uint32_t percentile(uint8_t percent) const
+    {
+        uint32_t n = total;
+        if (n == 0)
+            return 0;
+
+        // Rank of the sample, rounded up so p99 of 100 samples is the 99th
+        uint64_t rank = ((uint64_t)n * percent + 99) / 100;
+        uint32_t seen = 0;
+        for (uint8_t b = 0; b < BUCKETS - 1; b++)
+        {
+            seen += bins[b];
+            if (seen >= rank)
+            {
+                uint32_t upper = b ? (1UL << b) - 1 : 0;
+                return upper < maxValue ? upper : maxValue;
+            }
+        }
+        return maxValue;
+    }
+
+    /**
+     * @brief Fills a summary of the histogram.
+     * @param out Destination for the summary.
+     */
+    void summarize(histogram_summary_t &out) const
+    {
+        out.count = total;
+        out.p50 = percentile(50);
+        out.p99 = percentile(99);
+        out.max = maxValue;
+    }
+
+    /**
+     * @brief Drops all samples. Samples recorded at the same time may be lost.
+     */
+    void reset()
+    {
+        memset((void *)bins, 0, sizeof(bins));
+        total = 0;
+        sum = 0;
+        maxValue = 0;
+    }
+
+    uint32_t count() const { return total; }             ///< Number of samples
+    uint32_t max() const { return maxValue; }             ///< Largest sample in microseconds
+    uint32_t mean() const { return total ? (uint32_t)(sum / total) : 0; } ///< Average sample in microseconds
+    uint32_t bucket(uint8_t b) const { return b < BUCKETS ? bins[b] : 0; } ///< Samples in one bucket
+
+private:
+    volatile uint32_t bins[BUCKETS] = {0}; ///< Samples per bucket
+    volatile uint32_t total = 0;           ///< Number of samples
+    volatile uint64_t sum = 0;             ///< Sum of all samples, for the mean
+    volatile uint32_t maxValue = 0;        ///< Largest sample
+};
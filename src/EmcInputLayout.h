@@ -0,0 +1,123 @@
+/*
+ * EmcInputLayout.h
+ *
+ *  Created on: 14.10.2026
+ *      Author: daenzell
+ */
+
+#pragma once
+
+/**
+ * @file EmcInputLayout.h
+ * @brief Compile-time description of the input pins and their bit positions
+ *
+ * The pins of each input group are template arguments, so pin counts, bit
+ * offsets and register masks are constants. Extracting a group from a
+ * register snapshot unrolls into one shift and mask per pin with constant
+ * operands, and writing it into the bitmap works at constant positions.
+ * static_assert checks at compile time that the layout fits the bitmap and
+ * the reserved LED pin is not used, so the scan itself needs no bounds checks
+ * and no heap.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "EmcGpioSampler.h"
+
+/**
+ * @struct EmcPins
+ * @brief A group of GPIO pins given as template arguments.
+ */
+template <uint8_t... Pins>
+struct EmcPins
+{
+    static constexpr uint8_t count = sizeof...(Pins);               ///< Number of pins
+    static constexpr uint8_t pins[count ? count : 1] = {Pins...};   ///< Pin numbers, for the setup code
+    static constexpr uint64_t mask = ((uint64_t)0 | ... | (1ULL << Pins)); ///< Bit mask of the GPIOs
+
+    static_assert(count <= 32, "A pin group is extracted into one 32-bit word");
+    static_assert(((Pins < SOC_GPIO_PIN_COUNT) && ...), "Pin does not exist");
+
+    /**
+     * @brief Returns true if the group contains a pin.
+     */
+    static constexpr bool contains(uint8_t pin) { return ((Pins == pin) || ... || false); }
+
+    /**
+     * @brief Extracts the group from a register snapshot, one bit per pin in order.
+     * @tparam ActiveLow true to invert, for inputs that read low while pressed.
+     */
+    template <bool ActiveLow>
+    static inline uint32_t extract(const EmcGpioSampler::snapshot_t &s)
+    {
+        uint32_t out = 0;
+        uint8_t bit = 0;
+        ((out |= ((s.in[Pins / 32] >> (Pins % 32)) & 1UL) << bit++), ...);
+        return ActiveLow ? out ^ (uint32_t)((1ULL << count) - 1) : out;
+    }
+};
+
+/**
+ * @struct EmcInputLayout
+ * @brief Bit positions of all input groups in the packed button bitmap.
+ *
+ * The groups are packed in this order: touch pads, GND buttons, VCC buttons,
+ * matrix keys row by row, then two pulse bits per encoder. Encoder pins are
+ * given as A, B pairs.
+ */
+template <typename Touch, typename Gnd, typename Vcc, typename Rows, typename Cols, typename Encoder, size_t Capacity>
+struct EmcInputLayout
+{
+    static constexpr uint8_t ENCODERS = Encoder::count / 2;                   ///< Number of encoders
+    static constexpr uint16_t TOUCH_BIT = 0;                                  ///< First touch pad bit
+    static constexpr uint16_t GND_BIT = TOUCH_BIT + Touch::count;             ///< First GND button bit
+    static constexpr uint16_t VCC_BIT = GND_BIT + Gnd::count;                 ///< First VCC button bit
+    static constexpr uint16_t MATRIX_BIT = VCC_BIT + Vcc::count;              ///< First matrix key bit
+    static constexpr uint16_t MATRIX_BITS = Rows::count * Cols::count;        ///< Number of matrix keys
+    static constexpr uint16_t ENCODER_BIT = MATRIX_BIT + MATRIX_BITS;         ///< First encoder pulse bit
+    static constexpr uint16_t ENCODER_BITS = ENCODERS * 2;                    ///< Number of encoder pulse bits
+    static constexpr uint16_t TOTAL_BITS = ENCODER_BIT + ENCODER_BITS;        ///< Bits in use
+
+    static_assert(TOTAL_BITS <= Capacity * 8, "Input layout does not fit into button_data");
+    static_assert(Encoder::count % 2 == 0, "Encoder pins must be A, B pairs");
+    static_assert(__builtin_popcountll(Touch::mask | Gnd::mask | Vcc::mask | Rows::mask | Cols::mask | Encoder::mask) ==
+                      Touch::count + Gnd::count + Vcc::count + Rows::count + Cols::count + Encoder::count,
+                  "A pin is used twice");
+
+    /**
+     * @brief Writes @p Bits bits of a group at a constant position.
+     */
+    template <uint16_t Pos, uint8_t Bits>
+    static inline void put(uint8_t *bitmap, uint32_t value)
+    {
+        static_assert(Pos + Bits <= Capacity * 8, "Group outside of button_data");
+        write(bitmap, Pos, value, Bits);
+    }
+
+    /**
+     * @brief Writes the keys of one matrix row.
+     * @param row Row index, below Rows::count.
+     */
+    static inline void putRow(uint8_t *bitmap, uint8_t row, uint32_t keys)
+    {
+        write(bitmap, MATRIX_BIT + row * Cols::count, keys, Cols::count);
+    }
+
+private:
+    /**
+     * @brief Writes bits into the bitmap byte by byte; constant arguments unroll completely.
+     */
+    static inline __attribute__((always_inline)) void write(uint8_t *bitmap, uint16_t pos, uint32_t value, uint8_t bits)
+    {
+        while (bits)
+        {
+            uint8_t offset = pos % 8;
+            uint8_t take = 8 - offset < bits ? 8 - offset : bits;
+            uint8_t mask = ((1 << take) - 1) << offset;
+            bitmap[pos / 8] = (bitmap[pos / 8] & ~mask) | ((value << offset) & mask);
+            value >>= take;
+            pos += take;
+            bits -= take;
+        }
+    }
+};
@@ -0,0 +1,138 @@
+/*
+ * EmcInputScanner.cpp
+ *
+ *  Created on: 14.10.2026
+ *      Author: daenzell
+ */
+
+#include "EmcInputScanner.h"
+
+/**
+ * @brief Starts sampling the inputs at a fixed rate.
+ *
+ * The scan function runs from the esp_timer task, so it is not delayed by
+ * loop() and runs at a steady interval. It gets a zeroed frame to fill. The
+ * first scan always publishes, so the receiver starts with a valid frame.
+ *
+ * @param[in] scan Function that samples the inputs into the frame.
+ * @param[in] onChange Handler called with each changed frame, e.g. to hand it to EmcEspNow::submit().
+ * @param[in] rateHz The sampling rate.
+ * @return true if the timer was started.
+ */
+bool EmcInputScanner::begin(ScanFunction scan, ChangeHandler onChange, uint32_t rateHz)
+{
+    if (timer || !scan || rateHz == 0)
+    {
+        return false;
+    }
+
+    scanFunction = scan;
+    changeHandler = onChange;
+    rate = rateHz;
+    scanCount = 0;
+    maxScanMicros = 0;
+
+    esp_timer_create_args_t args;
+    memset(&args, 0, sizeof(args));
+    args.callback = onTimer;
+    args.arg = this;
+    args.dispatch_method = ESP_TIMER_TASK;
+    args.name = "emc_scan";
+    args.skip_unhandled_events = true; // A late scan is not repeated, the next one is current anyway
+
+    if (esp_timer_create(&args, &timer) != ESP_OK)
+    {
+        log_e("Scan timer create failed\n");
+        timer = nullptr;
+        return false;
+    }
+    if (esp_timer_start_periodic(timer, 1000000ULL / rate) != ESP_OK)
+    {
+        log_e("Scan timer start failed\n");
+        esp_timer_delete(timer);
+        timer = nullptr;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Stops and deletes the sampling timer.
+ */
+void EmcInputScanner::end()
+{
+    if (timer)
+    {
+        esp_timer_stop(timer);
+        esp_timer_delete(timer);
+        timer = nullptr;
+    }
+}
+
+/**
+ * @brief Restarts the sampling timer with a new period.
+ *
+ * @param[in] rateHz The sampling rate, 0 is ignored.
+ */
+void EmcInputScanner::setRate(uint32_t rateHz)
+{
+    if (rateHz == 0)
+    {
+        return;
+    }
+    rate = rateHz;
+    if (timer)
+    {
+        esp_timer_stop(timer);
+        esp_timer_start_periodic(timer, 1000000ULL / rate);
+    }
+}
+
+/**
+ * @brief Copies the last published frame.
+ *
+ * @param[out] out The last frame that differed from its predecessor.
+ * @return false if no frame was published since the program started.
+ */
+bool EmcInputScanner::read(slave_data_t &out) const
+{
+    return published.load(out) != 0;
+}
+
+/**
+ * @brief Trampoline from the esp_timer callback to the scanner instance.
+ *
+ * @param[in] arg The EmcInputScanner that started the timer.
+ */
+void EmcInputScanner::onTimer(void *arg)
+{
+    static_cast<EmcInputScanner *>(arg)->scan();
+}
+
+/**
+ * @brief Runs one scan and publishes the frame if it changed.
+ */
+void EmcInputScanner::scan()
+{
+    int64_t start = esp_timer_get_time();
+
+    memset(&working, 0, sizeof(slave_data_t));
+    scanFunction(working);
+
+    // The timer is the only writer, so the writer view is the last published frame
+    if (published.sequence() == 0 || memcmp(&working, &published.writerView(), sizeof(slave_data_t)) != 0)
+    {
+        published.store(working);
+        if (changeHandler)
+        {
+            changeHandler(working);
+        }
+    }
+
+    uint32_t took = esp_timer_get_time() - start;
+    if (took > maxScanMicros)
+    {
+        maxScanMicros = took;
+    }
+    scanCount = scanCount + 1;
+}
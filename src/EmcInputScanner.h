@@ -0,0 +1,102 @@
+/*
+ * EmcInputScanner.h
+ *
+ *  Created on: 14.10.2026
+ *      Author: daenzell
+ */
+
+#pragma once
+
+/**
+ * @file EmcInputScanner.h
+ * @brief Timer driven input sampling at a fixed rate
+ *
+ * An esp_timer calls the scan function at a fixed rate, independent of how
+ * long loop() takes. The scan function fills a private working frame; only
+ * when it differs from the last published frame it is published through a
+ * sequence lock and the change handler is called. loop() reads the published
+ * frame without locking and never sees a half-scanned one.
+ */
+
+#include <functional>
+#include "esp_timer.h"
+#include "EmcEspNow.h"
+#include "EmcSeqLock.h"
+
+#ifndef INPUT_SCAN_RATE_HZ
+#define INPUT_SCAN_RATE_HZ 1000 ///< Default input sampling rate
+#endif
+
+/**
+ * @class EmcInputScanner
+ * @brief Samples the inputs from an esp_timer and publishes changed frames.
+ */
+class EmcInputScanner
+{
+public:
+    typedef std::function<void(slave_data_t &frame)> ScanFunction;        ///< Fills a zeroed frame with the current inputs
+    typedef std::function<void(const slave_data_t &frame)> ChangeHandler; ///< Called with every changed frame
+
+    /**
+     * @brief Starts sampling.
+     * @param scan Function that samples the inputs, runs in the esp_timer task.
+     * @param onChange Handler called from the esp_timer task when the frame changed, may be empty.
+     * @param rateHz Sampling rate.
+     * @return true if the timer was started.
+     */
+    bool begin(ScanFunction scan, ChangeHandler onChange, uint32_t rateHz = INPUT_SCAN_RATE_HZ);
+
+    /**
+     * @brief Stops sampling. The last published frame stays readable.
+     */
+    void end();
+
+    /**
+     * @brief Changes the sampling rate while running.
+     * @param rateHz Sampling rate.
+     */
+    void setRate(uint32_t rateHz);
+
+    /**
+     * @brief Returns the sampling rate.
+     */
+    uint32_t getRate() const { return rate; }
+
+    /**
+     * @brief Copies the last published frame.
+     * @param out Destination for the frame.
+     * @return false if nothing was published yet.
+     */
+    bool read(slave_data_t &out) const;
+
+    /**
+     * @brief Returns the number of scans since begin().
+     */
+    uint32_t getScanCount() const { return scanCount; }
+
+    /**
+     * @brief Returns the duration of the slowest scan since begin() in microseconds.
+     */
+    uint32_t getMaxScanMicros() const { return maxScanMicros; }
+
+private:
+    /**
+     * @brief esp_timer callback, runs one scan.
+     */
+    static void onTimer(void *arg);
+
+    /**
+     * @brief Samples the inputs and publishes the frame if it changed.
+     */
+    void scan();
+
+    esp_timer_handle_t timer = nullptr; ///< Periodic sampling timer
+    uint32_t rate = INPUT_SCAN_RATE_HZ; ///< Sampling rate in Hz
+    ScanFunction scanFunction;          ///< Samples the inputs
+    ChangeHandler changeHandler;        ///< Called on a changed frame
+
+    slave_data_t working;               ///< Frame being scanned, only touched by the timer
+    EmcSeqLock<slave_data_t> published; ///< Last changed frame, read by loop()
+    volatile uint32_t scanCount = 0;    ///< Scans since begin()
+    volatile uint32_t maxScanMicros = 0; ///< Slowest scan since begin()
+};
@@ -0,0 +1,200 @@
+/*
+ * EmcLog.cpp
+ *
+ *  Created on: 14.10.2026
+ *      Author: daenzell
+ */
+
+#include "EmcLog.h"
+
+/**
+ * @struct log_cell_t
+ * @brief Slot of the ring buffer.
+ *
+ * The sequence tells producers and the consumer who owns the slot: it equals
+ * the write position while the slot is free, the write position + 1 once the
+ * record is complete, and moves on by the buffer size when it was read. It is
+ * stored relative to the slot index, so the zero-initialised buffer starts
+ * out with every slot free for the first round.
+ */
+typedef struct
+{
+    std::atomic<uint32_t> seq; ///< Ownership of the slot minus the slot index
+    log_record_t record;       ///< The record
+} log_cell_t;
+
+static log_cell_t cells[EMC_LOG_BUFFER_SIZE];         ///< Ring buffer storage
+static std::atomic<uint32_t> head{0};                 ///< Next write position, shared by all producers
+static uint32_t tail = 0;                             ///< Next read position, owned by the consumer
+static uint32_t droppedReported = 0;                  ///< Dropped count at the last report
+static TaskHandle_t volatile logTaskHandle = nullptr; ///< Log task, nullptr if not running
+static volatile bool logTaskRunning = false;          ///< Cleared to ask the task to exit
+
+std::atomic<uint32_t> EmcLog::droppedCount{0};
+
+/**
+ * @brief Starts the task that prints the records.
+ *
+ * @param[in] priority The FreeRTOS priority of the task.
+ * @param[in] stackSize The stack size of the task in bytes.
+ * @return true if the task is running.
+ */
+bool EmcLog::begin(UBaseType_t priority, uint32_t stackSize)
+{
+    if (logTaskHandle)
+    {
+        return true;
+    }
+
+    logTaskRunning = true;
+    TaskHandle_t handle = nullptr;
+    if (xTaskCreate(logTask, "emcLog", stackSize, nullptr, priority, &handle) != pdPASS)
+    {
+        logTaskRunning = false;
+        return false;
+    }
+    logTaskHandle = handle;
+    return true;
+}
+
+/**
+ * @brief Stops the log task and waits until it has exited.
+ */
+void EmcLog::end()
+{
+    if (!logTaskHandle)
+    {
+        return;
+    }
+
+    logTaskRunning = false;
+    while (logTaskHandle)
+    {
+        vTaskDelay(1);
+    }
+}
+
+/**
+ * @brief Claims a free cell and copies a message into it.
+ *
+ * Any number of tasks may write at the same time: a producer claims a
+ * position with a compare-and-swap on the head and owns that cell until it
+ * publishes it through the cell sequence. Nothing blocks; if the oldest
+ * record was not printed yet, the buffer is full and the message is dropped.
+ *
+ * @param[in] level The level of the message.
+ * @param[in] fmt The format string literal.
+ * @param[in] args The EMC_LOG_MAX_ARGS arguments.
+ */
+void EmcLog::write(uint8_t level, const char *fmt, const uint32_t *args)
+{
+    uint32_t pos = head.load(std::memory_order_relaxed);
+    uint32_t index;
+    log_cell_t *cell;
+    while (true)
+    {
+        index = pos & (EMC_LOG_BUFFER_SIZE - 1);
+        cell = &cells[index];
+        int32_t diff = (int32_t)(cell->seq.load(std::memory_order_acquire) + index - pos);
+        if (diff == 0)
+        {
+            if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                break; // The cell is ours
+            }
+        }
+        else if (diff < 0)
+        {
+            droppedCount.fetch_add(1, std::memory_order_relaxed);
+            return; // Full
+        }
+        else
+        {
+            pos = head.load(std::memory_order_relaxed); // Another producer took it, try the next one
+        }
+    }
+
+    cell->record.fmt = fmt;
+    memcpy(cell->record.args, args, sizeof(cell->record.args));
+    cell->record.millis = millis();
+    cell->record.level = level;
+    cell->seq.store(pos + 1 - index, std::memory_order_release);
+}
+
+/**
+ * @brief Prints all complete records in the order they were claimed.
+ *
+ * A record that is still being written stops the flush; it is printed with
+ * the next one.
+ */
+void EmcLog::flush()
+{
+    while (true)
+    {
+        uint32_t index = tail & (EMC_LOG_BUFFER_SIZE - 1);
+        log_cell_t &cell = cells[index];
+        if (cell.seq.load(std::memory_order_acquire) + index != tail + 1)
+        {
+            break;
+        }
+
+        log_record_t record = cell.record;
+        cell.seq.store(tail + EMC_LOG_BUFFER_SIZE - index, std::memory_order_release);
+        tail++;
+        print(record);
+    }
+
+    uint32_t dropped = droppedCount.load(std::memory_order_relaxed);
+    if (dropped != droppedReported)
+    {
+        log_printf("[EmcLog] %u messages dropped\n", (unsigned)(dropped - droppedReported));
+        droppedReported = dropped;
+    }
+}
+
+/**
+ * @brief Formats a record and prints it to the log output.
+ *
+ * The line has the time and level of the moment the message was recorded,
+ * in the style of the core's log output.
+ *
+ * @param[in] record The record.
+ */
+void EmcLog::print(const log_record_t &record)
+{
+    static const char levels[] = "NEWIDV";
+    const uint32_t *a = record.args;
+
+    char line[160];
+    int len = snprintf(line, sizeof(line), record.fmt, a[0], a[1], a[2], a[3], a[4], a[5]);
+    if (len < 0)
+    {
+        return;
+    }
+
+    // Messages written for log_x() often end in a newline of their own
+    len = len < (int)sizeof(line) ? len : sizeof(line) - 1;
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+    {
+        line[--len] = '\0';
+    }
+
+    log_printf("[%6u][%c] %s\n", (unsigned)record.millis, levels[record.level <= EMC_LOG_VERBOSE ? record.level : 0], line);
+}
+
+/**
+ * @brief Task that prints the waiting records at a low priority.
+ *
+ * @param[in] pvParameters Unused.
+ */
+void EmcLog::logTask(void *pvParameters)
+{
+    while (logTaskRunning)
+    {
+        flush();
+        vTaskDelay(pdMS_TO_TICKS(EMC_LOG_FLUSH_MS));
+    }
+
+    logTaskHandle = nullptr;
+    vTaskDelete(NULL);
+}
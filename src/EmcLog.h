@@ -0,0 +1,192 @@
+/*
+ * EmcLog.h
+ *
+ *  Created on: 14.10.2026
+ *      Author: daenzell
+ */
+
+#pragma once
+
+/**
+ * @file EmcLog.h
+ * @brief Deferred logging for the radio callbacks
+ *
+ * EMC_LOGE() to EMC_LOGV() take a format string literal and up to
+ * EMC_LOG_MAX_ARGS integer arguments, like log_e() to log_v(). Instead of
+ * formatting on the spot, they copy the format pointer and the raw arguments
+ * into a lock-free ring buffer, which is safe from any task and never blocks.
+ * A low-priority task formats and prints the records later, so a burst of
+ * messages in the WiFi task no longer waits for the UART. A record that does
+ * not fit is dropped and counted.
+ *
+ * Levels above EMC_LOG_LEVEL compile to nothing, arguments included. By
+ * default EMC_LOG_LEVEL follows CORE_DEBUG_LEVEL, so release builds do not
+ * log at all. With EMC_LOG_DIRECT defined, the macros call log_e() to log_v()
+ * directly instead, e.g. to see the last message before a crash.
+ *
+ * Only integer and enum arguments are supported (%d, %u, %x, %c); the format
+ * string must stay valid until it is printed, which a literal always does.
+ */
+
+#include <Arduino.h>
+#include <atomic>
+#include <type_traits>
+
+#define EMC_LOG_NONE 0    ///< No logging
+#define EMC_LOG_ERROR 1   ///< Errors only
+#define EMC_LOG_WARN 2    ///< Warnings and above
+#define EMC_LOG_INFO 3    ///< Information and above
+#define EMC_LOG_DEBUG 4   ///< Debug messages and above
+#define EMC_LOG_VERBOSE 5 ///< Everything
+
+#ifndef EMC_LOG_LEVEL
+#ifdef CORE_DEBUG_LEVEL
+#define EMC_LOG_LEVEL CORE_DEBUG_LEVEL ///< Highest level that is compiled in
+#else
+#define EMC_LOG_LEVEL EMC_LOG_NONE
+#endif
+#endif
+
+#ifndef EMC_LOG_BUFFER_SIZE
+#define EMC_LOG_BUFFER_SIZE 64 ///< Records the ring buffer holds, power of two
+#endif
+
+#ifndef EMC_LOG_MAX_ARGS
+#define EMC_LOG_MAX_ARGS 6 ///< Arguments per record, enough for a MAC address
+#endif
+
+#ifndef EMC_LOG_FLUSH_MS
+#define EMC_LOG_FLUSH_MS 20 ///< Interval in which the log task prints waiting records
+#endif
+
+#ifndef EMC_LOG_TASK_PRIORITY
+#define EMC_LOG_TASK_PRIORITY 1 ///< Default priority of the log task, with loop()
+#endif
+
+#ifndef EMC_LOG_TASK_STACK_SIZE
+#define EMC_LOG_TASK_STACK_SIZE 3072 ///< Default stack size of the log task in bytes
+#endif
+
+static_assert(EMC_LOG_BUFFER_SIZE > 1 && (EMC_LOG_BUFFER_SIZE & (EMC_LOG_BUFFER_SIZE - 1)) == 0,
+              "Log buffer size must be a power of two");
+
+/**
+ * @struct log_record_t
+ * @brief One deferred log message.
+ */
+typedef struct
+{
+    const char *fmt;                 ///< Format string literal
+    uint32_t args[EMC_LOG_MAX_ARGS]; ///< Raw arguments
+    uint32_t millis;                 ///< Time of the message
+    uint8_t level;                   ///< EMC_LOG_ERROR to EMC_LOG_VERBOSE
+} log_record_t;
+
+/**
+ * @class EmcLog
+ * @brief Lock-free multi-producer log buffer with a printing task.
+ */
+class EmcLog
+{
+public:
+    /**
+     * @brief Starts the task that prints the records.
+     * @param priority FreeRTOS priority of the task, keep it below the ESP-NOW task.
+     * @param stackSize Stack size of the task in bytes.
+     * @return true if the task is running.
+     */
+    static bool begin(UBaseType_t priority = EMC_LOG_TASK_PRIORITY, uint32_t stackSize = EMC_LOG_TASK_STACK_SIZE);
+
+    /**
+     * @brief Prints all waiting records from the caller.
+     *
+     * Only call this while the task is not running, e.g. before deep sleep
+     * after end().
+     */
+    static void flush();
+
+    /**
+     * @brief Stops the task; waiting records stay in the buffer.
+     */
+    static void end();
+
+    /**
+     * @brief Returns the number of records dropped because the buffer was full.
+     */
+    static uint32_t dropped() { return droppedCount.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Records a message. Use the EMC_LOGx() macros instead.
+     * @param level Level of the message.
+     * @param fmt Format string literal.
+     * @param args Integer arguments.
+     */
+    template <typename... Args>
+    static void push(uint8_t level, const char *fmt, Args... args)
+    {
+        static_assert(sizeof...(Args) <= EMC_LOG_MAX_ARGS, "Too many log arguments");
+        static_assert(((std::is_integral<Args>::value || std::is_enum<Args>::value) && ...),
+                      "Deferred log arguments must be integers");
+        const uint32_t values[EMC_LOG_MAX_ARGS + 1] = {(uint32_t)args...};
+        write(level, fmt, values);
+    }
+
+private:
+    /**
+     * @brief Copies a message into the ring buffer.
+     * @param level Level of the message.
+     * @param fmt Format string literal.
+     * @param args EMC_LOG_MAX_ARGS arguments.
+     */
+    static void write(uint8_t level, const char *fmt, const uint32_t *args);
+
+    /**
+     * @brief Formats and prints one record.
+     * @param record The record.
+     */
+    static void print(const log_record_t &record);
+
+    /**
+     * @brief Task that flushes the buffer every EMC_LOG_FLUSH_MS.
+     * @param pvParameters Unused.
+     */
+    static void logTask(void *pvParameters);
+
+    static std::atomic<uint32_t> droppedCount; ///< Records dropped because the buffer was full
+};
+
+#ifdef EMC_LOG_DIRECT
+#define EMC_LOG_RECORD(level, letter, fmt, ...) log_##letter(fmt, ##__VA_ARGS__)
+#else
+#define EMC_LOG_RECORD(level, letter, fmt, ...) EmcLog::push(level, fmt, ##__VA_ARGS__)
+#endif
+
+#if EMC_LOG_LEVEL >= EMC_LOG_ERROR
+#define EMC_LOGE(fmt, ...) EMC_LOG_RECORD(EMC_LOG_ERROR, e, fmt, ##__VA_ARGS__)
+#else
+#define EMC_LOGE(...) ((void)0)
+#endif
+
+#if EMC_LOG_LEVEL >= EMC_LOG_WARN
+#define EMC_LOGW(fmt, ...) EMC_LOG_RECORD(EMC_LOG_WARN, w, fmt, ##__VA_ARGS__)
+#else
+#define EMC_LOGW(...) ((void)0)
+#endif
+
+#if EMC_LOG_LEVEL >= EMC_LOG_INFO
+#define EMC_LOGI(fmt, ...) EMC_LOG_RECORD(EMC_LOG_INFO, i, fmt, ##__VA_ARGS__)
+#else
+#define EMC_LOGI(...) ((void)0)
+#endif
+
+#if EMC_LOG_LEVEL >= EMC_LOG_DEBUG
+#define EMC_LOGD(fmt, ...) EMC_LOG_RECORD(EMC_LOG_DEBUG, d, fmt, ##__VA_ARGS__)
+#else
+#define EMC_LOGD(...) ((void)0)
+#endif
+
+#if EMC_LOG_LEVEL >= EMC_LOG_VERBOSE
+#define EMC_LOGV(fmt, ...) EMC_LOG_RECORD(EMC_LOG_VERBOSE, v, fmt, ##__VA_ARGS__)
+#else
+#define EMC_LOGV(...) ((void)0)
+#endif
@@ -0,0 +1,233 @@
+/*
+ * EmcMatrixScanner.cpp
+ *
+ *  Created on: 14.10.2026
+ *      Author: daenzell
+ */
+
+#include "EmcMatrixScanner.h"
+
+/**
+ * @brief Configures the row outputs, the column inputs and their interrupts.
+ *
+ * The column interrupts are attached once and only enabled while the matrix
+ * is idle, so the row switching during a scan does not trigger them.
+ *
+ * @param[in] rows The row GPIOs.
+ * @param[in] rowCount The number of rows.
+ * @param[in] cols The column GPIOs.
+ * @param[in] colCount The number of columns.
+ * @param[in] diodes true if every key has a diode.
+ * @param[in] settleMicros The settle time per row in microseconds.
+ * @return false if the matrix is larger than MAX_ROWS x MAX_COLS or a pin is invalid.
+ */
+bool EmcMatrixScanner::begin(const uint8_t *rows, uint8_t rowCount, const uint8_t *cols, uint8_t colCount,
+                             bool diodes, uint32_t settleMicros)
+{
+    this->rowCount = 0;
+    if (rowCount > MAX_ROWS || colCount > MAX_COLS || !colSampler.begin(cols, colCount, true))
+    {
+        return false;
+    }
+
+    memcpy(rowPins, rows, rowCount);
+    memcpy(colPins, cols, colCount);
+    memset(keys, 0, sizeof(keys));
+    hasDiodes = diodes;
+    settleUs = settleMicros;
+
+    for (uint8_t r = 0; r < rowCount; r++)
+    {
+        gpio_hold_dis((gpio_num_t)rowPins[r]); // Rows may still be held from sleep
+        pinMode(rowPins[r], OUTPUT);
+        digitalWrite(rowPins[r], HIGH);
+    }
+    for (uint8_t c = 0; c < colCount; c++)
+    {
+        pinMode(colPins[c], INPUT_PULLUP);
+        attachInterruptArg(digitalPinToInterrupt(colPins[c]), onColumn, this, FALLING);
+        gpio_intr_disable((gpio_num_t)colPins[c]);
+    }
+
+    this->rowCount = rowCount;
+    idle = false;
+    return true;
+}
+
+/**
+ * @brief Scans all rows, or only checks the activity flag while idle.
+ *
+ * After a scan without any pressed key the matrix goes idle. A column
+ * interrupt, or a key that was already pressed when the interrupts were
+ * enabled, brings it back to full scans.
+ *
+ * @return true if any key is pressed.
+ */
+bool EmcMatrixScanner::scan()
+{
+    if (idle)
+    {
+        if (!activity)
+        {
+            return false;
+        }
+        leaveIdle();
+    }
+
+    uint32_t previous[MAX_ROWS];
+    memcpy(previous, keys, sizeof(keys));
+
+    uint32_t any = 0;
+    for (uint8_t r = 0; r < rowCount; r++)
+    {
+        EmcGpioSampler::driveLow(rowPins[r]);
+        if (settleUs)
+        {
+            delayMicroseconds(settleUs);
+        }
+        keys[r] = colSampler.sample();
+        EmcGpioSampler::driveHigh(rowPins[r]);
+        any |= keys[r];
+    }
+
+    if (!hasDiodes)
+    {
+        maskGhosts(previous);
+    }
+
+    if (!any)
+    {
+        enterIdle();
+    }
+    return any != 0;
+}
+
+/**
+ * @brief Keeps the previous state of all keys that might be ghosts.
+ *
+ * Without diodes, two rows that share two or more pressed columns form a
+ * rectangle in which any one key can be a ghost of the other three. Keys in
+ * such a rectangle keep the state of the previous scan, so keys that were
+ * pressed before stay pressed and a ghost never appears as a new press.
+ *
+ * @param[in] previous The keys of the previous scan, one word per row.
+ */
+void EmcMatrixScanner::maskGhosts(const uint32_t *previous)
+{
+    uint32_t ambiguous[MAX_ROWS] = {0};
+    for (uint8_t r1 = 0; r1 < rowCount; r1++)
+    {
+        for (uint8_t r2 = r1 + 1; r2 < rowCount; r2++)
+        {
+            uint32_t shared = keys[r1] & keys[r2];
+            if (shared & (shared - 1)) // At least two columns in common
+            {
+                ambiguous[r1] |= shared;
+                ambiguous[r2] |= shared;
+            }
+        }
+    }
+    for (uint8_t r = 0; r < rowCount; r++)
+    {
+        keys[r] = (keys[r] & ~ambiguous[r]) | (previous[r] & ambiguous[r]);
+    }
+}
+
+/**
+ * @brief Drives all rows low and holds them, so a key press pulls its column low in sleep.
+ *
+ * @return The bit mask of the column GPIOs, e.g. for esp_sleep_enable_ext1_wakeup().
+ */
+uint64_t EmcMatrixScanner::prepareSleep()
+{
+    uint64_t mask = 0;
+    for (uint8_t c = 0; c < colSampler.size(); c++)
+    {
+        gpio_intr_disable((gpio_num_t)colPins[c]);
+        mask |= 1ULL << colPins[c];
+    }
+    for (uint8_t r = 0; r < rowCount; r++)
+    {
+        digitalWrite(rowPins[r], LOW);
+        gpio_hold_en((gpio_num_t)rowPins[r]);
+    }
+    gpio_deep_sleep_hold_en(); // Keep the holds of digital-only GPIOs through deep sleep
+    idle = false;
+    return mask;
+}
+
+/**
+ * @brief Restores the falling-edge interrupts of the columns.
+ *
+ * A light sleep wake-up on the column pins replaces their interrupt type with
+ * a level, so the interrupts are set up again afterwards and only enabled if
+ * the matrix is idle.
+ */
+void EmcMatrixScanner::rearm()
+{
+    for (uint8_t c = 0; c < colSampler.size(); c++)
+    {
+        gpio_set_intr_type((gpio_num_t)colPins[c], GPIO_INTR_NEGEDGE);
+        if (idle)
+            gpio_intr_enable((gpio_num_t)colPins[c]);
+        else
+            gpio_intr_disable((gpio_num_t)colPins[c]);
+    }
+    if (idle && colSampler.sample())
+    {
+        activity = true;
+    }
+}
+
+/**
+ * @brief Flags activity when a column falls while idle.
+ *
+ * @param[in] arg The EmcMatrixScanner that attached the interrupt.
+ */
+void IRAM_ATTR EmcMatrixScanner::onColumn(void *arg)
+{
+    static_cast<EmcMatrixScanner *>(arg)->activity = true;
+}
+
+/**
+ * @brief Selects all rows and waits for a column interrupt.
+ */
+void EmcMatrixScanner::enterIdle()
+{
+    activity = false;
+    for (uint8_t r = 0; r < rowCount; r++)
+    {
+        EmcGpioSampler::driveLow(rowPins[r]);
+    }
+    for (uint8_t c = 0; c < colSampler.size(); c++)
+    {
+        gpio_intr_enable((gpio_num_t)colPins[c]);
+    }
+    idle = true;
+
+    // A key pressed before the interrupts were enabled gives no edge, catch it here
+    if (settleUs)
+    {
+        delayMicroseconds(settleUs);
+    }
+    if (colSampler.sample())
+    {
+        activity = true;
+    }
+}
+
+/**
+ * @brief Disables the column interrupts and deselects all rows for scanning.
+ */
+void EmcMatrixScanner::leaveIdle()
+{
+    for (uint8_t c = 0; c < colSampler.size(); c++)
+    {
+        gpio_intr_disable((gpio_num_t)colPins[c]);
+    }
+    for (uint8_t r = 0; r < rowCount; r++)
+    {
+        EmcGpioSampler::driveHigh(rowPins[r]);
+    }
+    idle = false;
+}
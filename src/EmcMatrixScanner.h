@@ -0,0 +1,130 @@
+/*
+ * EmcMatrixScanner.h
+ *
+ *  Created on: 14.10.2026
+ *      Author: daenzell
+ */
+
+#pragma once
+
+/**
+ * @file EmcMatrixScanner.h
+ * @brief Key matrix scanning with settle time, ghost masking and idle interrupts
+ *
+ * Rows are driven low one at a time and the columns, pulled up, are read
+ * after a configurable settle time, so long cables have charged before they
+ * are sampled. Every key has its own bit, so with diodes any combination of
+ * keys is reported (N-key rollover). Without diodes, three keys on the
+ * corners of a rectangle make the fourth corner read as pressed; such
+ * ambiguous keys keep their previous state until the rectangle resolves.
+ *
+ * Once no key is pressed the matrix goes idle: all rows are driven low and
+ * the columns get a falling-edge interrupt. scan() then costs one flag check
+ * until a key is pressed, and the same wiring serves as a wake source.
+ */
+
+#include <Arduino.h>
+#include "driver/gpio.h"
+#include "EmcGpioSampler.h"
+
+#ifndef MATRIX_SETTLE_US
+#define MATRIX_SETTLE_US 5 ///< Default time between driving a row and reading the columns
+#endif
+
+/**
+ * @class EmcMatrixScanner
+ * @brief Scans a row/column key matrix into one bitmap word per row.
+ */
+class EmcMatrixScanner
+{
+public:
+    static const uint8_t MAX_ROWS = 16; ///< Largest number of rows
+    static const uint8_t MAX_COLS = 32; ///< Largest number of columns, one word per row
+
+    /**
+     * @brief Configures the matrix pins. Call from setup().
+     * @param rows Row GPIOs, driven low to select a row.
+     * @param rowCount Number of rows, at most MAX_ROWS.
+     * @param cols Column GPIOs, read with pull-ups.
+     * @param colCount Number of columns, at most MAX_COLS.
+     * @param diodes true if every key has a diode, which disables ghost masking.
+     * @param settleMicros Time between selecting a row and reading the columns.
+     * @return false if the layout is too large or a pin is invalid.
+     */
+    bool begin(const uint8_t *rows, uint8_t rowCount, const uint8_t *cols, uint8_t colCount,
+               bool diodes, uint32_t settleMicros = MATRIX_SETTLE_US);
+
+    /**
+     * @brief Scans the matrix, or only checks for activity while idle.
+     * @return true if any key is pressed.
+     */
+    bool scan();
+
+    /**
+     * @brief Returns the keys of a row from the last scan, bit n = column n.
+     */
+    uint32_t getRow(uint8_t row) const { return row < rowCount ? keys[row] : 0; }
+
+    /**
+     * @brief Returns the number of rows.
+     */
+    uint8_t rows() const { return rowCount; }
+
+    /**
+     * @brief Returns the number of columns.
+     */
+    uint8_t cols() const { return colSampler.size(); }
+
+    /**
+     * @brief Returns true while the matrix waits for a key press by interrupt.
+     */
+    bool isIdle() const { return idle; }
+
+    /**
+     * @brief Drives all rows low and holds them through sleep.
+     * @return Bit mask of the column GPIOs, which read low when a key is pressed.
+     */
+    uint64_t prepareSleep();
+
+    /**
+     * @brief Restores the column interrupts after light sleep changed them to wake-up levels.
+     */
+    void rearm();
+
+    /**
+     * @brief Changes the settle time.
+     */
+    void setSettleTime(uint32_t settleMicros) { settleUs = settleMicros; }
+
+private:
+    /**
+     * @brief Column interrupt while idle, flags activity.
+     */
+    static void IRAM_ATTR onColumn(void *arg);
+
+    /**
+     * @brief Selects all rows and enables the column interrupts.
+     */
+    void enterIdle();
+
+    /**
+     * @brief Disables the column interrupts and deselects all rows.
+     */
+    void leaveIdle();
+
+    /**
+     * @brief Keeps the previous state of keys that might be ghosts.
+     * @param previous Keys of the previous scan.
+     */
+    void maskGhosts(const uint32_t *previous);
+
+    uint8_t rowPins[MAX_ROWS];      ///< Row GPIOs
+    uint8_t colPins[MAX_COLS];      ///< Column GPIOs
+    uint8_t rowCount = 0;           ///< Number of rows
+    EmcGpioSampler colSampler;      ///< Reads all columns in one register access
+    bool hasDiodes = false;         ///< Keys have diodes, no ghosting possible
+    uint32_t settleUs = MATRIX_SETTLE_US; ///< Settle time per row
+    uint32_t keys[MAX_ROWS];        ///< Pressed keys per row from the last scan
+    bool idle = false;              ///< All rows selected, waiting for a column interrupt
+    volatile bool activity = false; ///< A column interrupt fired while idle
+};
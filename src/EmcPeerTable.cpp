@@ -0,0 +1,164 @@
+/*
+ * EmcPeerTable.cpp
+ *
+ *  Created on: 14.10.2026
+ *      Author: daenzell
+ */
+
+#include "EmcPeerTable.h"
+
+/**
+ * @brief Adds a peer to the table.
+ *
+ * The peer gets the lowest free ID. If the peer is already present, its
+ * existing ID is returned and the table is left unchanged.
+ *
+ * @param[in] peer_mac The MAC address of the peer.
+ * @return The peer ID, or -1 if all slots are in use.
+ */
+int EmcPeerTable::add(const uint8_t *peer_mac)
+{
+    int existing = find(peer_mac);
+    if (existing >= 0)
+    {
+        return existing;
+    }
+
+    // Take the lowest free ID
+    uint8_t id = 0;
+    while (id < ESPNOW_MAX_PEERS && used[id])
+    {
+        id++;
+    }
+    if (id == ESPNOW_MAX_PEERS)
+    {
+        return -1;
+    }
+
+    entries[id].peerID = id;
+    memcpy(entries[id].peer_mac, peer_mac, 6);
+    used[id] = true;
+    count++;
+
+    // Insert into the hash index with linear probing
+    uint8_t pos = hash(peer_mac);
+    while (index[pos] != INDEX_EMPTY)
+    {
+        pos = (pos + 1) & (INDEX_SIZE - 1);
+    }
+    index[pos] = id;
+
+    return id;
+}
+
+/**
+ * @brief Removes a peer from the table.
+ *
+ * The freed ID can be handed out again by a later add(). The hash index is
+ * repaired with backward-shift deletion, so no tombstones accumulate.
+ *
+ * @param[in] peer_mac The MAC address of the peer.
+ * @return true if the peer was present and has been removed.
+ */
+bool EmcPeerTable::remove(const uint8_t *peer_mac)
+{
+    int slot = findSlot(peer_mac);
+    if (slot < 0)
+    {
+        return false;
+    }
+
+    used[index[slot]] = false;
+    count--;
+
+    // Shift following entries of the probe chain back into the hole
+    uint8_t hole = slot;
+    uint8_t pos = (hole + 1) & (INDEX_SIZE - 1);
+    while (index[pos] != INDEX_EMPTY)
+    {
+        uint8_t home = hash(entries[index[pos]].peer_mac);
+        // Move the entry if its home slot is not between the hole and its position
+        if (((pos - home) & (INDEX_SIZE - 1)) >= ((pos - hole) & (INDEX_SIZE - 1)))
+        {
+            index[hole] = index[pos];
+            hole = pos;
+        }
+        pos = (pos + 1) & (INDEX_SIZE - 1);
+    }
+    index[hole] = INDEX_EMPTY;
+
+    return true;
+}
+
+/**
+ * @brief Looks up the ID of a peer.
+ *
+ * @param[in] peer_mac The MAC address of the peer.
+ * @return The peer ID, or -1 if the peer is not in the table.
+ */
+int EmcPeerTable::find(const uint8_t *peer_mac) const
+{
+    int slot = findSlot(peer_mac);
+    return slot < 0 ? -1 : index[slot];
+}
+
+/**
+ * @brief Returns the peer stored under an ID.
+ *
+ * @param[in] peerID The peer ID.
+ * @return Pointer to the peer, or nullptr if the ID is not in use.
+ */
+const peers_t *EmcPeerTable::get(uint8_t peerID) const
+{
+    if (peerID >= ESPNOW_MAX_PEERS || !used[peerID])
+    {
+        return nullptr;
+    }
+    return &entries[peerID];
+}
+
+/**
+ * @brief Removes all peers and empties the hash index.
+ */
+void EmcPeerTable::clear()
+{
+    memset(used, 0, sizeof(used));
+    memset(index, INDEX_EMPTY, sizeof(index));
+    count = 0;
+}
+
+/**
+ * @brief Hashes a MAC address (FNV-1a) to a slot of the hash index.
+ *
+ * @param[in] peer_mac The MAC address to hash.
+ * @return The home slot of the MAC address.
+ */
+uint8_t EmcPeerTable::hash(const uint8_t *peer_mac)
+{
+    uint32_t h = 2166136261u;
+    for (uint8_t i = 0; i < 6; i++)
+    {
+        h = (h ^ peer_mac[i]) * 16777619u;
+    }
+    return (h ^ (h >> 16)) & (INDEX_SIZE - 1);
+}
+
+/**
+ * @brief Finds the hash index slot that refers to a MAC address.
+ *
+ * @param[in] peer_mac The MAC address to look up.
+ * @return The slot position, or -1 if the MAC address is not indexed.
+ */
+int EmcPeerTable::findSlot(const uint8_t *peer_mac) const
+{
+    uint8_t pos = hash(peer_mac);
+    while (index[pos] != INDEX_EMPTY)
+    {
+        if (memcmp(entries[index[pos]].peer_mac, peer_mac, 6) == 0)
+        {
+            return pos;
+        }
+        pos = (pos + 1) & (INDEX_SIZE - 1);
+    }
+    return -1;
+}
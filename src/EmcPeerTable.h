@@ -0,0 +1,141 @@
+/*
+ * EmcPeerTable.h
+ *
+ *  Created on: 14.10.2026
+ *      Author: daenzell
+ */
+
+#pragma once
+
+/**
+ * @file EmcPeerTable.h
+ * @brief Fixed-capacity peer table with stable IDs and a MAC hash index
+ *
+ * Peers are stored in a statically sized array; the array index is the peer
+ * ID, so an ID never changes while the peer is present and is only handed out
+ * again after the peer was removed. A small open-addressing hash index maps
+ * MAC addresses to IDs, so lookups and inserts on the receive path are
+ * constant-time and never allocate.
+ *
+ * The table does no locking of its own. A user that changes it from more
+ * than one task must serialise add(), remove() and find(), as EmcEspNow
+ * does with a critical section.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#ifndef ESPNOW_MAX_PEERS
+#define ESPNOW_MAX_PEERS 20 ///< Number of peer slots, including the broadcast peer
+#endif
+
+static_assert(ESPNOW_MAX_PEERS > 1 && ESPNOW_MAX_PEERS <= 20, "ESP-NOW supports at most 20 peers");
+
+/**
+ * @struct peers_t
+ * @brief Represents a peer device in the ESP-NOW network.
+ */
+typedef struct
+{
+    uint8_t peerID;        ///< Unique identifier for the peer
+    uint8_t peer_mac[6];   ///< MAC address of the peer
+} __attribute__((packed)) peers_t;
+
+/**
+ * @class EmcPeerTable
+ * @brief Allocation-free peer table indexed by peer ID and MAC address.
+ */
+class EmcPeerTable
+{
+public:
+    EmcPeerTable() { clear(); }
+
+    /**
+     * @brief Iterates over the peers that are present, in ID order.
+     */
+    class iterator
+    {
+    public:
+        iterator(const EmcPeerTable *table, uint8_t id) : table(table), id(id) { skip(); }
+        const peers_t &operator*() const { return table->entries[id]; }
+        const peers_t *operator->() const { return &table->entries[id]; }
+        iterator &operator++()
+        {
+            id++;
+            skip();
+            return *this;
+        }
+        bool operator!=(const iterator &other) const { return id != other.id; }
+
+    private:
+        void skip()
+        {
+            while (id < ESPNOW_MAX_PEERS && !table->used[id])
+                id++;
+        }
+
+        const EmcPeerTable *table;
+        uint8_t id;
+    };
+
+    /**
+     * @brief Adds a peer, or returns the ID it already has.
+     * @param peer_mac MAC address of the peer.
+     * @return Peer ID, or -1 if the table is full.
+     */
+    int add(const uint8_t *peer_mac);
+
+    /**
+     * @brief Removes a peer.
+     * @param peer_mac MAC address of the peer.
+     * @return true if the peer was present.
+     */
+    bool remove(const uint8_t *peer_mac);
+
+    /**
+     * @brief Looks up the ID of a peer.
+     * @param peer_mac MAC address of the peer.
+     * @return Peer ID, or -1 if the peer is unknown.
+     */
+    int find(const uint8_t *peer_mac) const;
+
+    /**
+     * @brief Returns the peer with the given ID.
+     * @param peerID Peer ID.
+     * @return Pointer to the peer, or nullptr if the ID is free.
+     */
+    const peers_t *get(uint8_t peerID) const;
+
+    /**
+     * @brief Removes all peers.
+     */
+    void clear();
+
+    /**
+     * @brief Returns the number of peers present.
+     */
+    uint8_t size() const { return count; }
+
+    iterator begin() const { return iterator(this, 0); }
+    iterator end() const { return iterator(this, ESPNOW_MAX_PEERS); }
+
+private:
+    static const uint8_t INDEX_SIZE = 32; ///< Hash index slots, power of two above ESPNOW_MAX_PEERS
+    static const uint8_t INDEX_EMPTY = 0xFF; ///< Marks an unused hash index slot
+
+    /**
+     * @brief Hashes a MAC address to its home slot in the hash index.
+     */
+    static uint8_t hash(const uint8_t *peer_mac);
+
+    /**
+     * @brief Finds the hash index slot holding a MAC address.
+     * @return Slot position, or -1 if not present.
+     */
+    int findSlot(const uint8_t *peer_mac) const;
+
+    peers_t entries[ESPNOW_MAX_PEERS];  ///< Peer storage, indexed by peer ID
+    bool used[ESPNOW_MAX_PEERS];        ///< Marks IDs that are in use
+    uint8_t index[INDEX_SIZE];          ///< MAC hash index holding peer IDs
+    uint8_t count;                      ///< Number of peers present
+};
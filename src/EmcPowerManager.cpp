@@ -0,0 +1,269 @@
+/*
+ * EmcPowerManager.cpp
+ *
+ *  Created on: 14.10.2026
+ *      Author: daenzell
+ */
+
+#include "EmcPowerManager.h"
+
+/**
+ * @brief Starts in the active tier and counts inactivity from now.
+ *
+ * @param[in] onTier The handler that applies a tier. It is called for every
+ *                   change except POWER_SLEEP, for which deepSleep() is called
+ *                   after the handler returned.
+ */
+void EmcPowerManager::begin(TierHandler onTier)
+{
+    tierHandler = onTier;
+    tier = POWER_ACTIVE;
+    lastActivityMillis = millis();
+}
+
+/**
+ * @brief Sets when the tiers are entered.
+ *
+ * @param[in] idleMs The inactivity until the scan rate is lowered.
+ * @param[in] dozeMs The inactivity until modem and light sleep.
+ * @param[in] sleepMs The inactivity until deep sleep.
+ */
+void EmcPowerManager::setTimeouts(unsigned long idleMs, unsigned long dozeMs, unsigned long sleepMs)
+{
+    this->idleMs = idleMs;
+    this->dozeMs = dozeMs;
+    this->sleepMs = sleepMs;
+}
+
+/**
+ * @brief Sets the duty cycle while dozing.
+ *
+ * @param[in] sleepMs The light sleep time per cycle, which is also the worst-case latency for inputs without a wake pin.
+ * @param[in] awakeMs The time awake per cycle, long enough for one scan and a heartbeat.
+ */
+void EmcPowerManager::setDozeCycle(unsigned long sleepMs, unsigned long awakeMs)
+{
+    dozeSleepMs = sleepMs;
+    dozeAwakeMs = awakeMs;
+}
+
+/**
+ * @brief Registers a wake pin.
+ *
+ * Every pin wakes from light sleep. Deep sleep uses ext1, which is limited to
+ * RTC GPIOs and to one polarity; active-low pins are preferred, as buttons to
+ * GND are the common wiring. The ext1 of the classic ESP32 cannot wake on any
+ * low pin, so there only the first active-low pin wakes from deep sleep,
+ * through ext0.
+ *
+ * @param[in] pin The GPIO number.
+ * @param[in] activeLow true if the pin reads low while pressed.
+ * @return false if the pin is not an RTC GPIO, or no wake-up is left for it, and cannot wake from deep sleep.
+ */
+bool EmcPowerManager::addWakePin(uint8_t pin, bool activeLow)
+{
+    uint64_t bit = 1ULL << pin;
+    (activeLow ? lightLowMask : lightHighMask) |= bit;
+
+    if (!rtc_gpio_is_valid_gpio((gpio_num_t)pin))
+    {
+        log_w("GPIO %d cannot wake from deep sleep\n", pin);
+        return false;
+    }
+#if CONFIG_IDF_TARGET_ESP32
+    if (activeLow && (deepLowMask & ~bit))
+    {
+        log_w("GPIO %d cannot wake from deep sleep, ext0 is taken by the first active-low pin\n", pin);
+        return false;
+    }
+#endif
+    (activeLow ? deepLowMask : deepHighMask) |= bit;
+    return true;
+}
+
+/**
+ * @brief Registers a group of wake pins with the same polarity.
+ *
+ * @param[in] pins The GPIO numbers.
+ * @param[in] count The number of pins.
+ * @param[in] activeLow true if the pins read low while pressed.
+ * @return false if any of the pins cannot wake from deep sleep.
+ */
+bool EmcPowerManager::addWakePins(const uint8_t *pins, uint8_t count, bool activeLow)
+{
+    bool ok = true;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        ok &= addWakePin(pins[i], activeLow);
+    }
+    return ok;
+}
+
+/**
+ * @brief Selects the tier from the time since the last activity.
+ *
+ * Activity while in a lower tier returns to POWER_ACTIVE right away. While
+ * dozing, this alternates between light sleep and a short wake phase in
+ * which the scan timer and the ESP-NOW task can run. Reaching POWER_SLEEP
+ * enters deep sleep and does not return.
+ *
+ * @param[in] busy true while an input is held; a held input would wake the device
+ *                 immediately, so the tier does not go below POWER_IDLE.
+ * @return The current tier.
+ */
+PowerTier EmcPowerManager::update(bool busy)
+{
+    unsigned long inactive = millis() - lastActivityMillis;
+
+    PowerTier target = POWER_ACTIVE;
+    if (inactive >= sleepMs)
+        target = POWER_SLEEP;
+    else if (inactive >= dozeMs)
+        target = POWER_DOZE;
+    else if (inactive >= idleMs)
+        target = POWER_IDLE;
+
+    if (busy && target > POWER_IDLE)
+    {
+        target = POWER_IDLE;
+    }
+
+    if (target != tier)
+    {
+        setTier(target);
+        awakeMillis = millis();
+    }
+
+    if (tier == POWER_SLEEP)
+    {
+        deepSleep();
+    }
+    else if (tier == POWER_DOZE && millis() - awakeMillis >= dozeAwakeMs)
+    {
+        lightSleep();
+        awakeMillis = millis();
+    }
+    return tier;
+}
+
+/**
+ * @brief Enables the ext1 wake-up for the registered pins and enters deep sleep.
+ *
+ * ext1 takes one polarity for all pins. The active-low pins use it; the
+ * active-high pins only get it if there are no active-low pins, otherwise a
+ * single active-high pin falls back to ext0. On the classic ESP32, whose ext1
+ * cannot wake on any low pin, ext1 takes the active-high pins and ext0 the
+ * one active-low pin. The RTC pulls are enabled, because the digital pulls
+ * are off in deep sleep.
+ */
+void EmcPowerManager::deepSleep()
+{
+    // The doze cycle's timer and GPIO wake-ups must not end the deep sleep
+    esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_TIMER);
+    esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_GPIO);
+
+    bool needPulls = false;
+    for (uint8_t pin = 0; pin < 64; pin++)
+    {
+        if (deepLowMask & (1ULL << pin))
+        {
+            rtc_gpio_pulldown_dis((gpio_num_t)pin);
+            rtc_gpio_pullup_en((gpio_num_t)pin);
+            needPulls = true;
+        }
+        else if (deepHighMask & (1ULL << pin))
+        {
+            rtc_gpio_pullup_dis((gpio_num_t)pin);
+            rtc_gpio_pulldown_en((gpio_num_t)pin);
+            needPulls = true;
+        }
+    }
+    if (needPulls)
+    {
+        esp_sleep_pd_config(ESP_PD_DOMAIN_RTC_PERIPH, ESP_PD_OPTION_ON);
+    }
+
+#if CONFIG_IDF_TARGET_ESP32
+    if (deepHighMask)
+    {
+        esp_sleep_enable_ext1_wakeup(deepHighMask, ESP_EXT1_WAKEUP_ANY_HIGH);
+    }
+    if (deepLowMask)
+    {
+        // addWakePin() kept a single active-low pin, ext0 can take it unless touch wake-up is in use
+        if (esp_sleep_enable_ext0_wakeup((gpio_num_t)__builtin_ctzll(deepLowMask), LOW) != ESP_OK)
+            log_w("Active-low wake pin not available in deep sleep\n");
+    }
+#else
+    if (deepLowMask)
+    {
+        esp_sleep_enable_ext1_wakeup(deepLowMask, ESP_EXT1_WAKEUP_ANY_LOW);
+        if (deepHighMask && (deepHighMask & (deepHighMask - 1)) == 0)
+        {
+            // One active-high pin left, ext0 can take it unless touch wake-up is in use
+            if (esp_sleep_enable_ext0_wakeup((gpio_num_t)__builtin_ctzll(deepHighMask), HIGH) != ESP_OK)
+                log_w("Active-high wake pin not available in deep sleep\n");
+        }
+        else if (deepHighMask)
+        {
+            log_w("Active-high wake pins not available in deep sleep\n");
+        }
+    }
+    else if (deepHighMask)
+    {
+        esp_sleep_enable_ext1_wakeup(deepHighMask, ESP_EXT1_WAKEUP_ANY_HIGH);
+    }
+#endif
+
+    esp_deep_sleep_start();
+}
+
+/**
+ * @brief Changes the tier and lets the application apply it.
+ *
+ * @param[in] newTier The tier to enter.
+ */
+void EmcPowerManager::setTier(PowerTier newTier)
+{
+    log_d("Power tier %d -> %d\n", tier, newTier);
+    tier = newTier;
+    if (tierHandler)
+    {
+        tierHandler(newTier);
+    }
+}
+
+/**
+ * @brief Light sleeps for one doze cycle.
+ *
+ * Wakes early when any wake pin becomes active. The level wake-up replaces
+ * the interrupt type of the pins, so it is removed again afterwards and the
+ * wake handler can restore the application's interrupts.
+ */
+void EmcPowerManager::lightSleep()
+{
+    for (uint8_t pin = 0; pin < 64; pin++)
+    {
+        if (lightLowMask & (1ULL << pin))
+            gpio_wakeup_enable((gpio_num_t)pin, GPIO_INTR_LOW_LEVEL);
+        else if (lightHighMask & (1ULL << pin))
+            gpio_wakeup_enable((gpio_num_t)pin, GPIO_INTR_HIGH_LEVEL);
+    }
+    if (lightLowMask | lightHighMask)
+    {
+        esp_sleep_enable_gpio_wakeup();
+    }
+    esp_sleep_enable_timer_wakeup(dozeSleepMs * 1000ULL);
+
+    esp_light_sleep_start();
+
+    for (uint8_t pin = 0; pin < 64; pin++)
+    {
+        if ((lightLowMask | lightHighMask) & (1ULL << pin))
+            gpio_wakeup_disable((gpio_num_t)pin);
+    }
+    if (wakeHandler)
+    {
+        wakeHandler();
+    }
+}
@@ -0,0 +1,160 @@
+/*
+ * EmcPowerManager.h
+ *
+ *  Created on: 14.10.2026
+ *      Author: daenzell
+ */
+
+#pragma once
+
+/**
+ * @file EmcPowerManager.h
+ * @brief Inactivity driven power tiers from full speed down to deep sleep
+ *
+ * Instead of going from full power straight to deep sleep, the device steps
+ * down in tiers the longer it is inactive: a lower scan rate first, then
+ * radio modem sleep with light sleep between short wake phases, and deep
+ * sleep only at the end. Any input activity returns to full speed; a short
+ * pause therefore never pays for a cold boot.
+ *
+ * All registered wake pins wake the device from light sleep by level and
+ * from deep sleep through one ext1 mask, so every direct button can wake it.
+ *
+ * The classic ESP32 is the exception: its ext1 only knows ALL_LOW and
+ * ANY_HIGH, so "any of these buttons to GND" cannot wake it from deep sleep.
+ * There ext1 takes the active-high pins, and only the first active-low pin
+ * wakes it, through ext0. Wire the buttons that must wake an ESP32 to VCC.
+ */
+
+#include <Arduino.h>
+#include <functional>
+#include "esp_sleep.h"
+#include "driver/gpio.h"
+#include "driver/rtc_io.h"
+
+#ifndef POWER_IDLE_MS
+#define POWER_IDLE_MS 2000 ///< Default inactivity until the scan rate is lowered
+#endif
+
+#ifndef POWER_DOZE_MS
+#define POWER_DOZE_MS 10000 ///< Default inactivity until modem and light sleep
+#endif
+
+#ifndef POWER_SLEEP_MS
+#define POWER_SLEEP_MS 30000 ///< Default inactivity until deep sleep
+#endif
+
+#ifndef POWER_DOZE_SLEEP_MS
+#define POWER_DOZE_SLEEP_MS 50 ///< Default light sleep time per doze cycle
+#endif
+
+#ifndef POWER_DOZE_AWAKE_MS
+#define POWER_DOZE_AWAKE_MS 5 ///< Default awake time per doze cycle, for scanning and sending
+#endif
+
+/**
+ * @enum PowerTier
+ * @brief Power tiers, from full speed to deep sleep.
+ */
+enum PowerTier : uint8_t
+{
+    POWER_ACTIVE, ///< Full scan rate, radio always on
+    POWER_IDLE,   ///< Reduced scan rate
+    POWER_DOZE,   ///< Radio modem sleep, light sleep between short wake phases
+    POWER_SLEEP   ///< Deep sleep, left through a reset
+};
+
+/**
+ * @class EmcPowerManager
+ * @brief Steps through the power tiers based on input activity.
+ */
+class EmcPowerManager
+{
+public:
+    typedef std::function<void(PowerTier tier)> TierHandler; ///< Called from update() when the tier changes
+    typedef std::function<void()> WakeHandler;               ///< Called from update() after each light sleep
+
+    /**
+     * @brief Starts in the active tier.
+     * @param onTier Handler that applies a tier, e.g. scan rate and radio power save.
+     */
+    void begin(TierHandler onTier);
+
+    /**
+     * @brief Sets the inactivity times of the tiers, each counted from the last activity.
+     */
+    void setTimeouts(unsigned long idleMs, unsigned long dozeMs, unsigned long sleepMs);
+
+    /**
+     * @brief Sets the light sleep and awake times of a doze cycle.
+     */
+    void setDozeCycle(unsigned long sleepMs, unsigned long awakeMs);
+
+    /**
+     * @brief Sets a handler that runs after each light sleep, e.g. to restore interrupts.
+     */
+    void onWake(WakeHandler handler) { wakeHandler = handler; }
+
+    /**
+     * @brief Registers a pin that wakes the device.
+     * @param pin GPIO number, must be an RTC GPIO to also wake from deep sleep.
+     * @param activeLow true if the pin reads low while pressed.
+     * @return false if the pin cannot wake from deep sleep, e.g. a second active-low pin on the
+     *         classic ESP32; it still wakes from light sleep.
+     */
+    bool addWakePin(uint8_t pin, bool activeLow);
+
+    /**
+     * @brief Registers several pins with the same polarity.
+     * @return false if any pin cannot wake from deep sleep.
+     */
+    bool addWakePins(const uint8_t *pins, uint8_t count, bool activeLow);
+
+    /**
+     * @brief Reports input activity. Safe to call from the scan timer.
+     */
+    void activity() { lastActivityMillis = millis(); }
+
+    /**
+     * @brief Moves between the tiers and runs the doze cycle. Call from loop().
+     * @param busy true while an input is held, which keeps the device out of doze and sleep.
+     * @return The current tier.
+     */
+    PowerTier update(bool busy);
+
+    /**
+     * @brief Returns the current tier.
+     */
+    PowerTier getTier() const { return tier; }
+
+    /**
+     * @brief Configures the ext1 wake-up from all wake pins and enters deep sleep.
+     */
+    void deepSleep();
+
+private:
+    /**
+     * @brief Changes the tier and calls the tier handler.
+     */
+    void setTier(PowerTier newTier);
+
+    /**
+     * @brief Light sleeps until a wake pin becomes active or the doze sleep time elapsed.
+     */
+    void lightSleep();
+
+    TierHandler tierHandler;       ///< Applies a tier
+    WakeHandler wakeHandler;       ///< Runs after each light sleep
+    PowerTier tier = POWER_ACTIVE; ///< Current tier
+    volatile unsigned long lastActivityMillis = 0; ///< Time of the last input activity
+    unsigned long idleMs = POWER_IDLE_MS;           ///< Inactivity until POWER_IDLE
+    unsigned long dozeMs = POWER_DOZE_MS;           ///< Inactivity until POWER_DOZE
+    unsigned long sleepMs = POWER_SLEEP_MS;         ///< Inactivity until POWER_SLEEP
+    unsigned long dozeSleepMs = POWER_DOZE_SLEEP_MS; ///< Light sleep per doze cycle
+    unsigned long dozeAwakeMs = POWER_DOZE_AWAKE_MS; ///< Awake time per doze cycle
+    unsigned long awakeMillis = 0;  ///< Start of the current doze wake phase
+    uint64_t lightLowMask = 0;      ///< Wake pins that are active low
+    uint64_t lightHighMask = 0;     ///< Wake pins that are active high
+    uint64_t deepLowMask = 0;       ///< Active-low wake pins that are RTC GPIOs, at most one on the classic ESP32
+    uint64_t deepHighMask = 0;      ///< Active-high wake pins that are RTC GPIOs
+};
@@ -0,0 +1,81 @@
+/*
+ * EmcRingBuffer.h
+ *
+ *  Created on: 14.10.2026
+ *      Author: daenzell
+ */
+
+#pragma once
+
+/**
+ * @file EmcRingBuffer.h
+ * @brief Bounded single-producer/single-consumer ring buffer
+ *
+ * One context pushes, one context pops, and neither blocks. The buffer is
+ * statically sized, so it can be used from the ESP-NOW callbacks without
+ * allocating. A push into a full buffer fails and leaves the buffer unchanged.
+ */
+
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+
+template <typename T, uint16_t N>
+class EmcRingBuffer
+{
+    static_assert(N > 1 && (N & (N - 1)) == 0, "Ring buffer size must be a power of two");
+
+public:
+    /**
+     * @brief Appends an element. Must only be called from the producer context.
+     * @param value Element to append.
+     * @return false if the buffer is full.
+     */
+    bool push(const T &value)
+    {
+        uint16_t h = head.load(std::memory_order_relaxed);
+        if ((uint16_t)(h - tail.load(std::memory_order_acquire)) >= N)
+            return false;
+
+        memcpy(&items[h & (N - 1)], &value, sizeof(T));
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Removes the oldest element. Must only be called from the consumer context.
+     * @param out Destination for the element.
+     * @return false if the buffer is empty.
+     */
+    bool pop(T &out)
+    {
+        uint16_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire))
+            return false;
+
+        memcpy(&out, &items[t & (N - 1)], sizeof(T));
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Returns the number of elements waiting.
+     */
+    uint16_t size() const
+    {
+        return (uint16_t)(head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire));
+    }
+
+    /**
+     * @brief Drops all elements. Must only be called from the consumer context.
+     */
+    void clear()
+    {
+        tail.store(head.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+private:
+    std::atomic<uint16_t> head{0}; ///< Next position to write, owned by the producer
+    std::atomic<uint16_t> tail{0}; ///< Next position to read, owned by the consumer
+    T items[N];                    ///< Element storage
+};
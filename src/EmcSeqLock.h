@@ -0,0 +1,114 @@
+/*
+ * EmcSeqLock.h
+ *
+ *  Created on: 14.10.2026
+ *      Author: daenzell
+ */
+
+#pragma once
+
+/**
+ * @file EmcSeqLock.h
+ * @brief Single-writer sequence lock used to hand frames from the WiFi task to loop()
+ *
+ * The writer (ESP-NOW receive callback) bumps the sequence counter to an odd
+ * value, copies the payload and bumps it again to an even value. A reader takes
+ * a snapshot only if the counter was even and unchanged across its copy, so it
+ * never observes a half-written frame. Neither side blocks or disables interrupts.
+ */
+
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+
+template <typename T>
+class EmcSeqLock
+{
+public:
+    /**
+     * @brief Publishes a new value. Writers in more than one context must take turns, e.g. under a critical section.
+     * @param value Value to publish.
+     */
+    void store(const T &value)
+    {
+        uint32_t s = seq.load(std::memory_order_relaxed);
+        seq.store(s + 1, std::memory_order_relaxed); // Odd: write in progress
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy(&data, &value, sizeof(T));
+        seq.store(s + 2, std::memory_order_release); // Even: write complete
+    }
+
+    /**
+     * @brief Takes a consistent snapshot if one newer than @p seenSeq is available.
+     * @param out Destination for the snapshot.
+     * @param seenSeq Sequence of the last snapshot taken by this reader, updated on success.
+     * @return true if a new, untorn value was copied to @p out.
+     */
+    bool tryLoad(T &out, uint32_t &seenSeq) const
+    {
+        uint32_t s1 = seq.load(std::memory_order_acquire);
+        if ((s1 & 1) || s1 == seenSeq)
+            return false; // Write in progress or nothing new
+
+        memcpy(&out, &data, sizeof(T));
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if (seq.load(std::memory_order_relaxed) != s1)
+            return false; // Overwritten during the copy, retry next time
+
+        seenSeq = s1;
+        return true;
+    }
+
+    /**
+     * @brief Takes a consistent snapshot, retrying while a write is in progress.
+     *
+     * The writer only holds the sequence odd for the duration of one memcpy,
+     * so the retry loop is short.
+     * @param out Destination for the snapshot.
+     * @return Sequence of the snapshot, 0 if nothing was ever stored.
+     */
+    uint32_t load(T &out) const
+    {
+        while (true)
+        {
+            uint32_t s1 = seq.load(std::memory_order_acquire);
+            if (s1 & 1)
+                continue;
+
+            memcpy(&out, &data, sizeof(T));
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            if (seq.load(std::memory_order_relaxed) == s1)
+                return s1;
+        }
+    }
+
+    /**
+     * @brief Returns the current sequence, which changes on every store().
+     */
+    uint32_t sequence() const { return seq.load(std::memory_order_acquire) & ~1u; }
+
+    /**
+     * @brief Returns the value last written. Only safe to call from the writer context.
+     */
+    const T &writerView() const { return data; }
+
+    /**
+     * @brief Publishes a zeroed value. The sequence keeps counting so readers stay in step.
+     *
+     * It writes like store() and follows the same rule for writers in several contexts.
+     * Readers see the zeroed value as new; a reader that should not can take
+     * sequence() afterwards as its seen sequence.
+     */
+    void reset()
+    {
+        T zero;
+        memset(&zero, 0, sizeof(T));
+        store(zero);
+    }
+
+private:
+    std::atomic<uint32_t> seq{0}; ///< Even when stable, odd while a write is in progress
+    T data;                       ///< Payload guarded by seq
+};
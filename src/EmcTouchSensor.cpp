@@ -0,0 +1,177 @@
+/*
+ * EmcTouchSensor.cpp
+ *
+ *  Created on: 14.10.2026
+ *      Author: daenzell
+ */
+
+#include "EmcTouchSensor.h"
+
+/**
+ * @brief Configures the touch channels and lets the FSM measure them continuously.
+ *
+ * On the ESP32-S2 the hardware IIR filter and smoother are enabled as well,
+ * so sample() reads denoised values. The baselines are taken from the first
+ * measurements, so the pads should not be touched right after begin().
+ *
+ * @param[in] pins The GPIO numbers of the touch pads.
+ * @param[in] count The number of pins.
+ * @param[in] threshold The relative deviation from the baseline that counts as a touch, e.g. 0.2 for 20 %.
+ * @return false if a pin is not a touch pin, there are too many pins, or the driver failed.
+ */
+bool EmcTouchSensor::begin(const uint8_t *pins, uint8_t count, float threshold)
+{
+    this->count = 0;
+    if (count > MAX_PADS)
+    {
+        return false;
+    }
+    for (uint8_t i = 0; i < count; i++)
+    {
+        int8_t channel = digitalPinToTouchChannel(pins[i]);
+        if (channel < 0)
+        {
+            log_e("GPIO %d is not a touch pin\n", pins[i]);
+            return false;
+        }
+        pads[i] = (touch_pad_t)channel;
+        value[i] = 0;
+        baseline[i] = 0;
+    }
+
+    if (touch_pad_init() != ESP_OK)
+    {
+        log_e("Touch init failed\n");
+        return false;
+    }
+
+#if SOC_TOUCH_VERSION_2
+    for (uint8_t i = 0; i < count; i++)
+    {
+        touch_pad_config(pads[i]);
+    }
+
+    touch_filter_config_t filter;
+    memset(&filter, 0, sizeof(filter));
+    filter.mode = TOUCH_PAD_FILTER_IIR_16;
+    filter.debounce_cnt = 1;
+    filter.noise_thr = 0;
+    filter.jitter_step = 4;
+    filter.smh_lvl = TOUCH_PAD_SMOOTH_IIR_2;
+    touch_pad_filter_set_config(&filter);
+    touch_pad_filter_enable();
+
+    touch_pad_set_fsm_mode(TOUCH_FSM_MODE_TIMER);
+    touch_pad_fsm_start();
+#else
+    touch_pad_set_fsm_mode(TOUCH_FSM_MODE_TIMER);
+    for (uint8_t i = 0; i < count; i++)
+    {
+        touch_pad_config(pads[i], 0);
+    }
+    touch_pad_filter_start(10);
+#endif
+
+    this->count = count;
+    touched = 0;
+    thresholdQ8 = threshold * 256;
+    return true;
+}
+
+/**
+ * @brief Stops the touch FSM and releases the driver.
+ */
+void EmcTouchSensor::end()
+{
+    if (count == 0)
+    {
+        return;
+    }
+#if SOC_TOUCH_VERSION_2
+    touch_pad_fsm_stop();
+#else
+    touch_pad_filter_stop();
+#endif
+    touch_pad_deinit();
+    count = 0;
+}
+
+/**
+ * @brief Reads the latest filtered value of every pad and updates the touch states.
+ *
+ * The values come from the result registers of the free-running FSM, so this
+ * never waits for a conversion. A pad is touched when it deviates from its
+ * baseline by more than the threshold, and released when the deviation drops
+ * below half the threshold. The baseline follows the value only while the pad
+ * is released, so a long touch is not learned as the new baseline.
+ *
+ * @return One bit per pad in configuration order, 1 = touched.
+ */
+uint32_t EmcTouchSensor::sample()
+{
+    for (uint8_t i = 0; i < count; i++)
+    {
+#if SOC_TOUCH_VERSION_2
+        uint32_t v = 0;
+        touch_pad_filter_read_smooth(pads[i], &v);
+#else
+        uint16_t v16 = 0;
+        touch_pad_read_filtered(pads[i], &v16);
+        uint32_t v = v16;
+#endif
+        if (v == 0)
+        {
+            continue; // No measurement yet
+        }
+        value[i] = v;
+
+        if (baseline[i] == 0)
+        {
+            baseline[i] = v << 8;
+            continue;
+        }
+
+        // A touch raises the count on the ESP32-S2 and lowers it on the ESP32
+        int32_t base = baseline[i] >> 8;
+#if SOC_TOUCH_VERSION_2
+        int32_t deviation = (int32_t)v - base;
+#else
+        int32_t deviation = base - (int32_t)v;
+#endif
+        int32_t limit = (base * thresholdQ8) >> 8;
+        uint32_t bit = 1UL << i;
+
+        if (touched & bit)
+        {
+            if (deviation < limit / 2)
+                touched &= ~bit;
+        }
+        else if (deviation > limit)
+        {
+            touched |= bit;
+        }
+        else
+        {
+            // Track slow drift while released
+            baseline[i] += (((int32_t)v << 8) - (int32_t)baseline[i]) >> TOUCH_BASELINE_SHIFT;
+        }
+    }
+    return touched;
+}
+
+/**
+ * @brief Returns the absolute value at which a pad counts as touched.
+ *
+ * @param[in] index The pad index in configuration order.
+ * @return The absolute threshold for the current baseline, 0 if the pad has no baseline yet.
+ */
+uint32_t EmcTouchSensor::getThreshold(uint8_t index) const
+{
+    uint32_t base = getBaseline(index);
+    uint32_t limit = (base * thresholdQ8) >> 8;
+#if SOC_TOUCH_VERSION_2
+    return base + limit;
+#else
+    return base > limit ? base - limit : 0;
+#endif
+}
@@ -0,0 +1,93 @@
+/*
+ * EmcTouchSensor.h
+ *
+ *  Created on: 14.10.2026
+ *      Author: daenzell
+ */
+
+#pragma once
+
+/**
+ * @file EmcTouchSensor.h
+ * @brief Non-blocking touch pad sampling with tracked baselines
+ *
+ * touchRead() starts a conversion and waits for it. Here the touch FSM runs
+ * continuously in timer mode instead, measuring all configured pads in
+ * hardware, and sample() only reads the latest filtered values from the
+ * registers. Each pad keeps a slowly tracked baseline of its untouched value,
+ * and a pad counts as touched when it deviates from its baseline by a
+ * relative threshold, so temperature and humidity drift do not need a fixed
+ * threshold to be retuned.
+ */
+
+#include <Arduino.h>
+#include "driver/touch_sensor.h"
+#include "soc/soc_caps.h"
+
+#ifndef TOUCH_RELATIVE_THRESHOLD
+#define TOUCH_RELATIVE_THRESHOLD 0.2f ///< Default deviation from the baseline that counts as a touch
+#endif
+
+#ifndef TOUCH_BASELINE_SHIFT
+#define TOUCH_BASELINE_SHIFT 10 ///< Baseline filter constant, the baseline follows 1/2^n of the deviation per sample
+#endif
+
+/**
+ * @class EmcTouchSensor
+ * @brief Reads touch pads from the free-running touch FSM without blocking.
+ */
+class EmcTouchSensor
+{
+public:
+    static const uint8_t MAX_PADS = 14; ///< Touch channels of the ESP32-S2
+
+    /**
+     * @brief Configures the pads and starts the touch FSM.
+     * @param pins GPIO numbers of the touch pads, the first pin ends up in bit 0.
+     * @param count Number of pins, at most MAX_PADS.
+     * @param threshold Relative deviation from the baseline that counts as a touch.
+     * @return false if a pin has no touch channel or the driver failed.
+     */
+    bool begin(const uint8_t *pins, uint8_t count, float threshold = TOUCH_RELATIVE_THRESHOLD);
+
+    /**
+     * @brief Stops the touch FSM.
+     */
+    void end();
+
+    /**
+     * @brief Reads the latest values and updates the touch states, never blocks.
+     * @return One bit per pad in configuration order, 1 = touched.
+     */
+    uint32_t sample();
+
+    /**
+     * @brief Returns the last filtered value of a pad.
+     */
+    uint32_t getValue(uint8_t index) const { return index < count ? value[index] : 0; }
+
+    /**
+     * @brief Returns the tracked untouched value of a pad, 0 until the first measurement.
+     */
+    uint32_t getBaseline(uint8_t index) const { return index < count ? baseline[index] >> 8 : 0; }
+
+    /**
+     * @brief Returns the absolute touch threshold of a pad for the current baseline.
+     *
+     * Useful for drivers that need an absolute value, e.g. touchAttachInterrupt().
+     */
+    uint32_t getThreshold(uint8_t index) const;
+
+    /**
+     * @brief Returns the number of pads.
+     */
+    uint8_t size() const { return count; }
+
+private:
+    uint8_t count = 0;                ///< Number of pads
+    touch_pad_t pads[MAX_PADS];       ///< Touch channel of each pad
+    uint32_t value[MAX_PADS];         ///< Last filtered value of each pad
+    uint32_t baseline[MAX_PADS];      ///< Untouched value of each pad, 24.8 fixed point
+    uint32_t touched = 0;             ///< Touch state of each pad
+    uint16_t thresholdQ8 = 0;         ///< Relative threshold, 8.8 fixed point
+};
@@ -1,11 +1,33 @@
 
 #include "EmcEspNow.h"
+#include "EmcLog.h"
+#include "EmcInputScanner.h"
+#include "EmcDebouncer.h"
+#include "EmcGpioSampler.h"
+#include "EmcTouchSensor.h"
+#include "EmcMatrixScanner.h"
+#include "EmcPowerManager.h"
+#include "EmcAnalogInput.h"
+#include "EmcEncoder.h"
+#include "EmcInputLayout.h"
 #include "driver/temperature_sensor.h"
 #include "esp_sleep.h"
 
 // Instance of the ESP-NOW communication handler (slave mode)
 EmcEspNow espNow;
 
+// Samples the buttons at a fixed rate, independent of loop()
+EmcInputScanner scanner;
+
+// Debounces the packed button bits, so contact bounce does not cause frames
+EmcDebouncer debouncer;
+static_assert(sizeof(slave_data_t::button_data) * 8 == DEBOUNCE_BITS, "Debouncer must cover all button bits");
+
+// Debounce times in scans (1 ms each at the default scan rate)
+const uint8_t touchDebounceSamples = 2;  // Touch pads are filtered in hardware already
+const uint8_t buttonDebounceSamples = 5; // Mechanical buttons
+const uint8_t matrixDebounceSamples = 5; // Matrix keys, one full matrix scan per sample
+
 // Temperature sensor handle and configuration
 temperature_sensor_handle_t tempHandle = NULL;
 temperature_sensor_config_t tempSensor = {
@@ -13,73 +35,121 @@ temperature_sensor_config_t tempSensor = {
     .range_max = 50  // Maximum temperature range in Celsius
 };
 
-// Touch Sensor Treshold (tested on ESP32-S2)
-const uint16_t touchThreshold = 8000; // change to higher value if too sensitive
+// Touch Sensor Treshold, relative to the tracked untouched value of each pad (tested on ESP32-S2)
+const float touchThreshold = 0.2f; // change to higher value if too sensitive
 
 // Timing variables for status LED and periodic tasks
 unsigned long slaveMillis = 0;
 unsigned long ledMillis = 0;
-unsigned long lastActivityMillis = 0; // Track last button activity
 
 // Temperature reading (in Celsius) from internal sensor
 float tempOut = 0.0f;
 
-// Power management settings
-const unsigned long INACTIVITY_TIMEOUT = 30000; // 30 seconds of inactivity before sleep
-bool lowPowerMode = false;
-
-// === Button Pin Configuration Vectors ===
-// IMPORTANT: Do NOT include LED_BUILTIN in any of these vectors.
+// Power management settings, each counted from the last button activity
+EmcPowerManager power;
+const unsigned long IDLE_TIMEOUT = 2000;        // 2 seconds of inactivity before scanning slower
+const unsigned long DOZE_TIMEOUT = 10000;       // 10 seconds of inactivity before modem and light sleep
+const unsigned long INACTIVITY_TIMEOUT = 30000; // 30 seconds of inactivity before deep sleep
+const uint32_t idleScanRate = 250;              // Scan rate in Hz once idle, debounce times scale with it
+
+// === Button Pin Configuration ===
+// The pins are compile-time constants: bit positions and register masks are computed by the
+// compiler, and a layout that does not fit into button_data fails to build.
+// IMPORTANT: Do NOT include LED_BUILTIN in any of these groups (checked below).
 // It is reserved for status indication and must not be repurposed as an input or output pin.
 
 // Touch sensor pins
-std::vector<uint8_t> buttonsTouchpins = {1, 2, 3, 4};
+using ButtonsTouchpins = EmcPins<1, 2, 3, 4>;
 
 // Digital buttons connected to GND, use INPUT_PULLUP
-std::vector<uint8_t> buttonsGndpins = {5, 6, 7, 8};
+using ButtonsGndpins = EmcPins<5, 6, 7, 8>;
 
 // Digital buttons connected to VCC, use INPUT_PULLDOWN
-std::vector<uint8_t> buttonsVCCpins = {9, 10, 11, 12};
+using ButtonsVCCpins = EmcPins<9, 10, 11, 12>;
 
 // Column pins for matrix buttons, read as inputs with pull-ups
-std::vector<uint8_t> buttonsColpins = {13, 14, 16, 17};
+using ButtonsColpins = EmcPins<13, 14, 16, 17>;
 
 // Row pins for matrix buttons, driven low during scan
-std::vector<uint8_t> buttonsRowpins = {18, 21, 33, 34};
+using ButtonsRowpins = EmcPins<18, 21, 33, 34>;
+
+// Rotary encoders as A, B pin pairs, counted by the PCNT peripheral
+// Each encoder sends its detents as clockwise/counter-clockwise button pulses after the matrix bits
+using EncoderPins = EmcPins<35, 36, 37, 38>;
+
+// Analog axes (clutch paddles, pots), packed with 12 bits each into slave_data_t::data
+// Only ADC1 pins work while WiFi is on (GPIO 1-10 on the ESP32-S2), free them from the groups above to use them
+using AnalogPins = EmcPins<>;
+
+// Bit positions of all groups in slave_data_t::button_data
+using Layout = EmcInputLayout<ButtonsTouchpins, ButtonsGndpins, ButtonsVCCpins, ButtonsRowpins, ButtonsColpins,
+                              EncoderPins, sizeof(slave_data_t::button_data)>;
+static_assert(!ButtonsTouchpins::contains(LED_BUILTIN) && !ButtonsGndpins::contains(LED_BUILTIN) &&
+                  !ButtonsVCCpins::contains(LED_BUILTIN) && !ButtonsColpins::contains(LED_BUILTIN) &&
+                  !ButtonsRowpins::contains(LED_BUILTIN) && !EncoderPins::contains(LED_BUILTIN) &&
+                  !AnalogPins::contains(LED_BUILTIN),
+              "LED_BUILTIN is reserved for the status LED");
+
+// Touch pads, measured continuously by the touch FSM
+EmcTouchSensor touch;
+
+// Analog axes, converted continuously by the ADC DMA
+EmcAnalogInput analog;
+
+// Rotary encoders, counted in hardware so no step is lost
+EmcEncoder encoders;
+
+// Button matrix, idles on column interrupts while no key is pressed
+EmcMatrixScanner matrix;
+const bool matrixDiodes = false;      // true if every key has a diode, disables ghost masking
+const uint32_t matrixSettleUs = 10;   // Increase for long cables between the rows and the keys
+
+// Example processing data from master
+// Called from the ESP-NOW task for every command the master queued, and from loop()
+// when its current command changes (its keep-alive repeats are not passed on)
+void onMasterCommand(const master_cmd_t &cmd)
+{
+  Serial.printf("Main Id: %d | Sub Id: %d | Index1: %d | Index2: %d | Float: %f | Int: %d \n",
+                cmd.mainId, cmd.subId, cmd.index1, cmd.index2, cmd.value, cmd.valueInt);
+
+  // Example action based on master data
+  // digitalWrite(LED_PIN, cmd.valueInt);
+}
 
 // Function to prepare wakeup sources
 void prepareWakeupSources()
 {
-  // Configure touch pins as wakeup sources
-  for (uint8_t pin : buttonsTouchpins)
+  // Configure touch pins as wakeup sources, at the threshold of their current baseline
+  for (uint8_t i = 0; i < ButtonsTouchpins::count; i++)
   {
+    uint32_t threshold = touch.getThreshold(i);
+    if (threshold == 0)
+      continue; // Pad never measured, would wake immediately
     esp_sleep_enable_touchpad_wakeup();
-    touchAttachInterrupt(pin, []() {}, touchThreshold);
-  }
-
-  // Configure digital buttons as wakeup sources
-  for (uint8_t pin : buttonsGndpins)
-  {
-    esp_sleep_enable_ext0_wakeup((gpio_num_t)pin, LOW);
-  }
-
-  for (uint8_t pin : buttonsVCCpins)
-  {
-    esp_sleep_enable_ext0_wakeup((gpio_num_t)pin, HIGH);
+    touchAttachInterrupt(ButtonsTouchpins::pins[i], []() {}, threshold);
   }
 
-  // Note: Matrix buttons are more complex to wake from - consider using only direct buttons for wakeup
+  // Digital buttons and matrix columns are registered with the power manager in setup(),
+  // which wakes on all of them through one ext1 mask. Hold all rows low during sleep,
+  // so any matrix key pulls its column low.
+  matrix.prepareSleep();
 }
 
-// Function to enter low power mode
+// Function to enter low power mode, the power manager enters deep sleep afterwards
 void enterLowPowerMode()
 {
-  Serial.println("Entering low power mode...");
+  Serial.println("Entering deep sleep...");
   digitalWrite(LED_BUILTIN, LOW); // Turn off LED
 
+  // Stop sampling first, the scan would drive the matrix rows again
+  scanner.end();
+
   // Prepare wakeup sources
   prepareWakeupSources();
 
+  // Stop the ADC DMA
+  analog.end();
+
   // Disable temperature sensor
   if (tempHandle)
   {
@@ -88,192 +158,218 @@ void enterLowPowerMode()
 
   // Disable WiFi and ESP-NOW
   espNow.end();
+}
+
+// Applies a power tier, called by the power manager from loop()
+void applyPowerTier(PowerTier tier)
+{
+  switch (tier)
+  {
+  case POWER_ACTIVE:
+    Serial.println("Exiting low power mode");
+    scanner.setRate(INPUT_SCAN_RATE_HZ);
+    espNow.setPowerSave(false);
+    espNow.setLinkTimeouts(ESPNOW_HEARTBEAT_MS, ESPNOW_DEGRADED_MS, ESPNOW_LOST_MS);
+    break;
+
+  case POWER_IDLE:
+    scanner.setRate(idleScanRate);
+    espNow.setPowerSave(false);
+    espNow.setLinkTimeouts(ESPNOW_HEARTBEAT_MS, ESPNOW_DEGRADED_MS, ESPNOW_LOST_MS);
+    break;
+
+  case POWER_DOZE:
+    // The radio sleeps between wake windows, give the master more time before it counts as lost
+    Serial.println("Entering low power mode...");
+    scanner.setRate(idleScanRate);
+    espNow.setPowerSave(true);
+    espNow.setLinkTimeouts(ESPNOW_HEARTBEAT_MS, ESPNOW_LOST_MS, ESPNOW_LOST_MS * 5);
+    break;
+
+  case POWER_SLEEP:
+    enterLowPowerMode();
+    break;
+  }
+}
+
+// Samples all buttons into the bit-packed frame
+// Called by the scanner from the esp_timer task with a zeroed frame, at INPUT_SCAN_RATE_HZ
+// All positions are constants of the layout, which is checked to fit at compile time
+void scanInputs(slave_data_t &frame)
+{
+  int64_t scanStart = esp_timer_get_time();
 
-  // Configure deep sleep
-  esp_deep_sleep_start();
+  // Read TOUCH sensor, the FSM measures in the background so this never waits
+  Layout::put<Layout::TOUCH_BIT, ButtonsTouchpins::count>(frame.button_data, touch.sample());
+
+  // Read GND-referenced (active-low) and VCC-referenced (active-high) buttons from one register snapshot
+  EmcGpioSampler::snapshot_t inputs = EmcGpioSampler::read();
+  Layout::put<Layout::GND_BIT, ButtonsGndpins::count>(frame.button_data, ButtonsGndpins::extract<true>(inputs));
+  Layout::put<Layout::VCC_BIT, ButtonsVCCpins::count>(frame.button_data, ButtonsVCCpins::extract<false>(inputs));
+
+  // Matrix scan: one word per row, ghosts masked, nothing to do while idle
+  matrix.scan();
+  for (uint8_t row = 0; row < ButtonsRowpins::count; row++)
+  {
+    Layout::putRow(frame.button_data, row, matrix.getRow(row));
+  }
+
+  // Encoder detents as fixed-width button pulses, two bits per encoder
+  Layout::put<Layout::ENCODER_BIT, Layout::ENCODER_BITS>(frame.button_data, encoders.pulseBits());
+
+  // Only stable changes reach the frame, bounces never change it
+  debouncer.update(frame.button_data);
+
+  // Analog axes, the deadband keeps ADC noise from changing the frame
+  analog.poll();
+  analog.pack(frame.data, sizeof(frame.data));
+
+  // Scan duration histogram, reported to the master on an ESPNOW_CMD_STATS query
+  espNow.getHistogram(HIST_SCAN).record(esp_timer_get_time() - scanStart);
 }
 
 void setup()
 {
   Serial.begin(115200);
 
+  // ESP-NOW messages are recorded by the radio callbacks and printed by this low-priority task
+  EmcLog::begin();
+
   // Check wakeup reason
   esp_sleep_wakeup_cause_t wakeupReason = esp_sleep_get_wakeup_cause();
   if (wakeupReason != ESP_SLEEP_WAKEUP_UNDEFINED)
   {
-    // We woke from sleep - quick initialization
-    lowPowerMode = false;
-    lastActivityMillis = millis();
-
-    // Minimal reinitialization
-    pinMode(LED_BUILTIN, OUTPUT);
-
-    // Reinitialize ESP-NOW in Slave mode
-    espNow.begin(false); // false = Slave
-
-    return;
+    // We woke from sleep - ESP-NOW reconnects to the paired master from RTC memory,
+    // so the button that woke us is sent by the first scan without discovery
+    Serial.println("Woke from sleep");
   }
 
   // Configure built-in LED for status indication
   pinMode(LED_BUILTIN, OUTPUT);
 
-  // Initialize ESP-NOW in Slave mode
-  espNow.begin(false); // false = Slave
-
-  // Initialize internal temperature sensor
-  ESP_ERROR_CHECK(temperature_sensor_install(&tempSensor, &tempHandle));
-  ESP_ERROR_CHECK(temperature_sensor_enable(tempHandle));
-
+  // Configure the inputs first, so the first scan after a wake is valid
   // Configure input pins for GND-driven buttons
-  for (uint8_t pin : buttonsGndpins)
+  for (uint8_t i = 0; i < ButtonsGndpins::count; i++)
   {
-    // WARNING: Do NOT include LED_BUILTIN in this vector to avoid LED malfunction.
+    uint8_t pin = ButtonsGndpins::pins[i];
+    // LED_BUILTIN is rejected at compile time, see the layout above
     pinMode(pin, INPUT_PULLUP);
   }
 
   // Configure input pins for VCC-driven buttons
-  for (uint8_t pin : buttonsVCCpins)
+  for (uint8_t i = 0; i < ButtonsVCCpins::count; i++)
   {
-    // WARNING: Do NOT include LED_BUILTIN in this vector to avoid LED malfunction.
+    uint8_t pin = ButtonsVCCpins::pins[i];
+    // LED_BUILTIN is rejected at compile time, see the layout above
     pinMode(pin, INPUT_PULLDOWN);
   }
 
-  // Configure row pins as outputs for button matrix scanning
-  for (uint8_t pin : buttonsRowpins)
-  {
-    // WARNING: Do NOT include LED_BUILTIN in this vector to avoid LED malfunction.
-    pinMode(pin, OUTPUT);
-  }
+  // Configure row outputs and column inputs with pull-up for the button matrix
+  matrix.begin(ButtonsRowpins::pins, ButtonsRowpins::count, ButtonsColpins::pins, ButtonsColpins::count,
+               matrixDiodes, matrixSettleUs);
 
-  // Configure column pins as inputs with pull-up for button matrix
-  for (uint8_t pin : buttonsColpins)
-  {
-    // WARNING: Do NOT include LED_BUILTIN in this vector to avoid LED malfunction.
-    pinMode(pin, INPUT_PULLUP);
-  }
+  // Start the touch FSM, the baselines are learned from the first measurements
+  touch.begin(ButtonsTouchpins::pins, ButtonsTouchpins::count, touchThreshold);
 
-  lastActivityMillis = millis();
-}
+  // Start the continuous ADC for the analog axes
+  // Calibrate end stops with analog.setCalibration(axis, rawMin, rawMax), see analog.getRaw(axis)
+  if (AnalogPins::count)
+    analog.begin(AnalogPins::pins, AnalogPins::count);
 
-void checkButtonActivity()
-{
-  static uint8_t lastButtonState[sizeof(espNow.slaveSendData.button_data)] = {0};
+  // Start counting the encoders
+  for (uint8_t i = 0; i < Layout::ENCODERS; i++)
+    encoders.add(EncoderPins::pins[i * 2], EncoderPins::pins[i * 2 + 1]);
 
-  if (memcmp(lastButtonState, espNow.slaveSendData.button_data, sizeof(lastButtonState)))
-  {
-    // Button state changed - update last activity time
-    lastActivityMillis = millis();
-    memcpy(lastButtonState, espNow.slaveSendData.button_data, sizeof(lastButtonState));
+  // Debounce settings per input group, in the order scanInputs() packs them
+  debouncer.setSamples(Layout::TOUCH_BIT, ButtonsTouchpins::count, touchDebounceSamples);
+  debouncer.setSamples(Layout::GND_BIT, ButtonsGndpins::count + ButtonsVCCpins::count, buttonDebounceSamples);
+  debouncer.setSamples(Layout::MATRIX_BIT, Layout::MATRIX_BITS, matrixDebounceSamples);
+  debouncer.setSamples(Layout::ENCODER_BIT, Layout::ENCODER_BITS, 1); // Encoder pulses are clean, filtered in hardware
 
-    if (lowPowerMode)
-    {
-      // Exiting low power mode
-      lowPowerMode = false;
-      Serial.println("Exiting low power mode");
-    }
-  }
-}
+  // Initialize ESP-NOW in Slave mode, commands are handled by onMasterCommand()
+  espNow.onCommand(onMasterCommand, true); // true = deferred, outside of the WiFi task
+  espNow.setAutoChannel(true);             // Follow the master to whichever channel it picked
+  espNow.begin(false); // false = Slave
 
-void loop()
-{
-  // Check if we should enter low power mode
-  if (!lowPowerMode && (millis() - lastActivityMillis > INACTIVITY_TIMEOUT))
-  {
-    lowPowerMode = true;
-    enterLowPowerMode();
-    return; // This line won't be reached if deep sleep is entered
-  }
+  // Send only the changed button words, with a full keyframe every 250 ms
+  espNow.setCompactUplink(true);
 
-  // ============ Temperature Reading ============
-  // Read the internal temperature sensor in Celsius
-  // Only read temperature if not in low power mode
-  if (!lowPowerMode)
-    ESP_ERROR_CHECK(temperature_sensor_get_celsius(tempHandle, &tempOut));
+  // Button changes go out as redundant copies and carry the latest edges, so a lost frame costs no retry
+  espNow.setRedundantEdges(true);
 
-  // ============ Prepare Button Data ============
-  // Clear previous button states
-  memset(espNow.slaveSendData.button_data, 0, sizeof(espNow.slaveSendData.button_data));
+  // Transmit from a dedicated task, woken by the scanner on every change
+  espNow.startTask();
 
-  uint16_t totalBits = 0;
+  // Every direct button and matrix column wakes the box, from light sleep and deep sleep
+  // (on the classic ESP32 only the VCC buttons and the first GND button wake it from deep sleep)
+  power.addWakePins(ButtonsGndpins::pins, ButtonsGndpins::count, true);
+  power.addWakePins(ButtonsVCCpins::pins, ButtonsVCCpins::count, false);
+  power.addWakePins(ButtonsColpins::pins, ButtonsColpins::count, true);
+  power.setTimeouts(IDLE_TIMEOUT, DOZE_TIMEOUT, INACTIVITY_TIMEOUT);
+  power.onWake([]()
+               { matrix.rearm(); });
+  power.begin(applyPowerTier);
 
-  // Lambda function to encode button states into bit-packed array
-  auto writeBits = [&](const std::vector<uint8_t> &pins, bool invert)
-  {
-    for (uint8_t pin : pins)
-    {
-      if (totalBits >= sizeof(espNow.slaveSendData.button_data) * 8)
-        return; // Prevent overflow
-
-      uint8_t byteIndex = totalBits / 8;
-      uint8_t bitIndex = totalBits % 8;
-      bool state = invert ? !digitalRead(pin) : digitalRead(pin);
-      bitWrite(espNow.slaveSendData.button_data[byteIndex], bitIndex, state);
-      totalBits++;
-    }
-  };
+  // Sample the buttons at a fixed rate, changed frames go straight to the ESP-NOW task
+  scanner.begin(scanInputs, [](const slave_data_t &frame)
+                {
+                  espNow.submit(frame);
+                  power.activity(); // Button state changed - back to full speed
+                });
+
+  // Initialize internal temperature sensor
+  ESP_ERROR_CHECK(temperature_sensor_install(&tempSensor, &tempHandle));
+  ESP_ERROR_CHECK(temperature_sensor_enable(tempHandle));
+}
 
-  // Read TOUCH sensor
-  for (uint8_t pin : buttonsTouchpins)
+// Returns true while any button is held
+bool anyButtonHeld(const slave_data_t &inputs)
+{
+  for (uint8_t b : inputs.button_data)
   {
-    bool touched = (touchRead(pin) > touchThreshold);
-    uint8_t byteIndex = totalBits / 8;
-    uint8_t bitIndex = totalBits % 8;
-    bitWrite(espNow.slaveSendData.button_data[byteIndex], bitIndex, touched);
-    totalBits++;
+    if (b)
+      return true;
   }
+  return false;
+}
 
-  // // Read TOUCH sensor
-  // for (uint8_t pin : buttonsTouchpins)
-  // {
-  //   bool touched = (touchRead(pin) > touchThreshold);
-  //   if (touched)
-  //   {
-  //     uint8_t byteIndex = totalBits / 8;
-  //     uint8_t bitIndex = totalBits % 8;
-  //     bitWrite(espNow.slaveSendData.button_data[byteIndex], bitIndex, 1);
-  //     totalBits++;
-  //   }
-  //   else
-  //   {
-  //     // Optional: Explicitly set bit to 0 if needed
-  //     uint8_t byteIndex = totalBits / 8;
-  //     uint8_t bitIndex = totalBits % 8;
-  //     bitWrite(espNow.slaveSendData.button_data[byteIndex], bitIndex, 0);
-  //     totalBits++;
-  //   }
-  // }
-
-  // Read GND-referenced buttons (active-low)
-  writeBits(buttonsGndpins, true);
-
-  // Read VCC-referenced buttons (active-high)
-  writeBits(buttonsVCCpins, false);
-
-  // Matrix scan: iterate through row pins and read columns
-  for (uint8_t rowPin : buttonsRowpins)
-  {
-    digitalWrite(rowPin, LOW);       // Enable current row
-    writeBits(buttonsColpins, true); // Read columns (active-low)
-    digitalWrite(rowPin, HIGH);      // Disable row again
+void loop()
+{
+  int64_t loopStart = esp_timer_get_time();
 
-    if (totalBits >= sizeof(espNow.slaveSendData.button_data) * 8)
-      break; // Stop if buffer is full
-  }
+  // ============ Button Data ============
+  // The scanner samples in the background, loop() only looks at the latest frame
+  slave_data_t inputs = {};
+  scanner.read(inputs);
 
-  // Check for button activity
-  checkButtonActivity();
+  // ============ Power Management ============
+  // Steps down to slower scanning, light sleep and finally deep sleep while inactive.
+  // A held button keeps the box awake, it would wake it right away anyway.
+  PowerTier tier = power.update(anyButtonHeld(inputs));
+
+  // ============ Temperature Reading ============
+  // Read the internal temperature sensor in Celsius
+  // Only read temperature if not in low power mode
+  if (tier <= POWER_IDLE)
+    ESP_ERROR_CHECK(temperature_sensor_get_celsius(tempHandle, &tempOut));
 
   // ============ ESP-NOW Transmission ============
-  // Send updated button data if changed
+  // Button changes are submitted by the scanner, this only runs the master-side bookkeeping
   espNow.update();
 
+  // The master's current command is state, only its changes are reported
+  master_cmd_t currentCmd;
+  if (espNow.tryGetLatest(currentCmd))
+    onMasterCommand(currentCmd);
+
   // ============ Status LED Behavior ============
   // LED_BUILTIN usage:
-  // - ON  : Successfully connected to master (peer list size ≥ 2)
+  // - ON  : Successfully connected to master
   // - BLINK FAST : Over-temperature warning (≥ 80°C)
-  // - OFF : Not connected
+  // - BLINK SLOW : Searching for master
 
-  if (espNow.peers.size() >= 2)
+  LinkState link = espNow.getLinkState();
+  if (link == LINK_CONNECTED || link == LINK_DEGRADED)
   {
     if (tempOut >= 80.0)
     {
@@ -308,22 +404,6 @@ void loop()
     }
   }
 
-  // Example processing data from master
-  if (memcmp(&espNow.masterCmdData, &espNow.lastmasterCmdData, sizeof(espNow.masterCmdData)) != 0)
-  { // new data
-
-    Serial.printf("Main Id: %d | Sub Id: %d | Index1: %d | Index2: %d | Float: %f | Int: %d \n",
-                  espNow.masterCmdData.mainId, espNow.masterCmdData.subId, espNow.masterCmdData.index1, espNow.masterCmdData.index2, espNow.masterCmdData.value, espNow.masterCmdData.valueInt);
-
-    memcpy(&espNow.lastmasterCmdData, &espNow.masterCmdData, sizeof(espNow.masterCmdData));
-
-    // Example action based on master data
-    // digitalWrite(LED_PIN, espNow.espnowRecvData.button_data[0]);
-
-    // Reset received data after processing
-    // memset(&espNow.espnowRecvData, 0, sizeof(espNow.espnowRecvData));
-  }
-
   // ============ Debugging Output (Serial Monitor) ============
   // Print temperature and button bit data every second
   static unsigned long debugMillis = 0;
@@ -332,17 +412,35 @@ void loop()
     debugMillis = millis();
 
     // Touch sensor debugging
-    // for (uint8_t pin : buttonsTouchpins)
+    // for (uint8_t i = 0; i < touch.size(); i++)
     // {
-    //   Serial.printf("Touch pin %d: %d\n", pin, touchRead(pin));
+    //   Serial.printf("Touch pin %d: %u / %u\n", ButtonsTouchpins::pins[i], touch.getValue(i), touch.getBaseline(i));
     // }
 
-    Serial.printf("Temp: %.2f C | Peers: %d\n", tempOut, espNow.peers.size());
+    Serial.printf("Temp: %.2f C | Peers: %d | Link: %d\n", tempOut, espNow.peers.size(), espNow.getLinkState());
+    Serial.printf("Scans: %u | Max scan: %u us\n", (unsigned)scanner.getScanCount(), (unsigned)scanner.getMaxScanMicros());
+
+    // Link statistics, the master reads the same report remotely
+    link_stats_t stats;
+    if (espNow.getLinkStats(1, stats))
+    {
+      Serial.printf("TX ok/fail/retry: %u/%u/%u | RX: %u lost %u dup %u | RSSI: %d dBm\n",
+                    (unsigned)stats.txOk, (unsigned)stats.txFail, (unsigned)stats.txRetries,
+                    (unsigned)stats.rxFrames, (unsigned)stats.rxLost, (unsigned)stats.rxDropped, stats.rssi);
+      Serial.printf("Loop p99: %u us | Scan p99: %u us | Ack p99: %u us\n",
+                    (unsigned)stats.histograms[HIST_LOOP].p99, (unsigned)stats.histograms[HIST_SCAN].p99,
+                    (unsigned)stats.histograms[HIST_ACK].p99);
+    }
+
     Serial.print("Button bits: ");
-    for (int i = 0; i < sizeof(espNow.slaveSendData.button_data); i++)
+    for (int i = 0; i < sizeof(inputs.button_data); i++)
     {
-      Serial.printf("%02X ", espNow.slaveSendData.button_data[i]);
+      Serial.printf("%02X ", inputs.button_data[i]);
     }
     Serial.println();
   }
+
+  // Loop duration histogram, without the light sleeps of the doze tier
+  if (tier < POWER_DOZE)
+    espNow.getHistogram(HIST_LOOP).record(esp_timer_get_time() - loopStart);
 }
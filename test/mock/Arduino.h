@@ -0,0 +1,50 @@
+/*
+ * Arduino.h
+ *
+ *  Created on: 14.10.2026
+ *      Author: daenzell
+ */
+
+#pragma once
+
+/**
+ * @file Arduino.h
+ * @brief Host stand-in for the parts of the Arduino core used by EmcEspNow
+ *
+ * Time comes from the simulation clock, see EmcSimRadio.h. Log output is
+ * dropped unless ESPNOW_SIM_LOG is defined.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define RTC_DATA_ATTR
+#define IRAM_ATTR
+
+#define MACSTR "%02x:%02x:%02x:%02x:%02x:%02x"
+#define MAC2STR(a) (a)[0], (a)[1], (a)[2], (a)[3], (a)[4], (a)[5]
+
+#ifdef ESPNOW_SIM_LOG
+#define log_e(fmt, ...) printf("[%8lld] E " fmt "\n", (long long)esp_timer_get_time(), ##__VA_ARGS__)
+#define log_w(fmt, ...) printf("[%8lld] W " fmt "\n", (long long)esp_timer_get_time(), ##__VA_ARGS__)
+#define log_i(fmt, ...) printf("[%8lld] I " fmt "\n", (long long)esp_timer_get_time(), ##__VA_ARGS__)
+#define log_d(fmt, ...) printf("[%8lld] D " fmt "\n", (long long)esp_timer_get_time(), ##__VA_ARGS__)
+#define log_v(fmt, ...) printf("[%8lld] V " fmt "\n", (long long)esp_timer_get_time(), ##__VA_ARGS__)
+#else
+#define log_e(...) ((void)0)
+#define log_w(...) ((void)0)
+#define log_i(...) ((void)0)
+#define log_d(...) ((void)0)
+#define log_v(...) ((void)0)
+#endif
+
+unsigned long millis();
+unsigned long micros();
+long random(long max);
+long random(long min, long max);
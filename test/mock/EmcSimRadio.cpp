@@ -0,0 +1,706 @@
+/*
+ * EmcSimRadio.cpp
+ *
+ *  Created on: 14.10.2026
+ *      Author: daenzell
+ */
+
+#include "EmcSimRadio.h"
+#include <algorithm>
+#include "esp_sleep.h"
+
+WiFiClass WiFi;
+
+/**
+ * @struct sim_pending_t
+ * @brief A frame on the air with its sender.
+ */
+typedef struct
+{
+    sim_frame_t frame;  ///< The frame
+    EmcSimNode *sender; ///< Device that sent it
+    uint64_t order;     ///< Send order, breaks ties between frames due at the same time
+} sim_pending_t;
+
+/**
+ * @brief A simulated esp_timer, owned by the device that created it.
+ */
+struct esp_timer
+{
+    esp_timer_cb_t callback; ///< Function to call
+    void *arg;               ///< Argument of the callback
+    EmcSimNode *owner;       ///< Device the callback runs on
+    int64_t dueUs;           ///< Simulation time of the next call
+    uint64_t periodUs;       ///< Period of a periodic timer, 0 for a one-shot timer
+    bool armed;              ///< The timer is started
+};
+
+static int64_t simNow = 0;                                  ///< Simulation clock in microseconds
+static uint32_t rngState = 1;                               ///< State of the xorshift generator
+static uint64_t sendOrder = 0;                              ///< Frames sent since the reset
+static sim_link_t simLink;                                  ///< Behaviour of the channel
+static std::vector<EmcSimNode *> nodes;                     ///< Registered devices
+static EmcSimNode *active = nullptr;                        ///< Device whose code is running
+static std::vector<sim_pending_t> air;                      ///< Frames not delivered yet
+static std::function<void(const sim_frame_t &)> sniffer;    ///< Observer of every frame sent
+static std::vector<esp_timer *> timers;                     ///< Timers of all devices
+
+/**
+ * @brief Returns a uniformly distributed number in [0, 1).
+ */
+static float randomUnit()
+{
+    return (EmcSimRadio::random(0x1000000) & 0xFFFFFF) / 16777216.0f;
+}
+
+/**
+ * @brief Checks whether a MAC address is a group address that every device receives.
+ */
+static bool isGroup(const uint8_t *mac)
+{
+    return mac[0] & 0x01;
+}
+
+/**
+ * @brief Creates a device and registers it with the radio.
+ *
+ * @param[in] mac The MAC address of the device.
+ */
+EmcSimNode::EmcSimNode(const uint8_t *mac)
+{
+    memcpy(this->mac, mac, 6);
+    EmcSimRadio::attach(this);
+}
+
+/**
+ * @brief Removes the device and its frames from the radio.
+ */
+EmcSimNode::~EmcSimNode()
+{
+    EmcSimRadio::detach(this);
+}
+
+/**
+ * @brief Makes this device the one all WiFi and esp_now calls act on.
+ *
+ * The EmcEspNow callbacks reach their instance through a static pointer, so
+ * it is pointed at this device's instance as well.
+ */
+void EmcSimNode::enter()
+{
+    active = this;
+    EmcEspNow::instance = &espNow;
+}
+
+/**
+ * @brief Runs code in the context of this device.
+ *
+ * @param[in] fn The code to run.
+ */
+void EmcSimNode::run(const std::function<void()> &fn)
+{
+    EmcSimNode *previous = active;
+    enter();
+    fn();
+    if (previous)
+    {
+        previous->enter();
+    }
+}
+
+/**
+ * @brief Resets the clock, the frames on the air and the random generator.
+ *
+ * @param[in] seed The seed of the random generator.
+ */
+void EmcSimRadio::reset(uint32_t seed)
+{
+    simNow = 0;
+    rngState = seed ? seed : 1;
+    sendOrder = 0;
+    simLink = sim_link_t();
+    air.clear();
+    sniffer = nullptr;
+}
+
+/**
+ * @brief Sets the behaviour of the radio channel.
+ *
+ * @param[in] link The loss, latency and reordering of all frames.
+ */
+void EmcSimRadio::setLink(const sim_link_t &link)
+{
+    simLink = link;
+}
+
+/**
+ * @brief Returns the behaviour of the radio channel, for changing single values.
+ *
+ * @return The channel behaviour.
+ */
+sim_link_t &EmcSimRadio::getLink()
+{
+    return simLink;
+}
+
+/**
+ * @brief Registers an observer for every frame sent.
+ *
+ * @param[in] observer The callback, nullptr to remove it.
+ */
+void EmcSimRadio::setSniffer(std::function<void(const sim_frame_t &)> observer)
+{
+    sniffer = observer;
+}
+
+/**
+ * @brief Advances the simulation in steps.
+ *
+ * Every step delivers the frames that are due and then runs every device:
+ * its loop hook first, then EmcEspNow::update() once ESP-NOW is initialised.
+ *
+ * @param[in] durationUs The simulated time to run.
+ * @param[in] stepUs The length of one step.
+ */
+void EmcSimRadio::run(int64_t durationUs, uint32_t stepUs)
+{
+    runUntil([]()
+             { return false; },
+             durationUs, stepUs);
+}
+
+/**
+ * @brief Advances the simulation in steps until a condition holds.
+ *
+ * @param[in] condition The condition, checked after every step.
+ * @param[in] timeoutUs The longest simulated time to run.
+ * @param[in] stepUs The length of one step.
+ * @return The simulated time until the condition held, or -1 on timeout.
+ */
+int64_t EmcSimRadio::runUntil(const std::function<bool()> &condition, int64_t timeoutUs, uint32_t stepUs)
+{
+    int64_t start = simNow;
+    while (simNow - start < timeoutUs)
+    {
+        simNow += stepUs;
+        deliver();
+        fireTimers();
+
+        for (EmcSimNode *node : nodes)
+        {
+            node->enter();
+            if (node->loop)
+            {
+                node->loop();
+            }
+            if (node->espNowInit)
+            {
+                node->espNow.update();
+            }
+        }
+        active = nullptr;
+
+        if (condition())
+        {
+            return simNow - start;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Returns the simulation time.
+ *
+ * @return The time in microseconds since the last reset().
+ */
+int64_t EmcSimRadio::now()
+{
+    return simNow;
+}
+
+/**
+ * @brief Returns a number from the xorshift generator of the simulation.
+ *
+ * @param[in] max The exclusive upper bound.
+ * @return A number below @p max, 0 if @p max is 0.
+ */
+uint32_t EmcSimRadio::random(uint32_t max)
+{
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return max ? rngState % max : 0;
+}
+
+/**
+ * @brief Returns the device whose code is running.
+ *
+ * @return The device, nullptr outside of a device context.
+ */
+EmcSimNode *EmcSimRadio::current()
+{
+    return active;
+}
+
+/**
+ * @brief Puts a frame of the running device on the air.
+ *
+ * Loss, acknowledge loss, latency and reordering are drawn here, so the
+ * sniffer sees the fate of the frame together with the frame.
+ *
+ * @param[in] dst The destination MAC address.
+ * @param[in] data The frame.
+ * @param[in] len The length of the frame.
+ */
+void EmcSimRadio::transmit(const uint8_t *dst, const uint8_t *data, size_t len)
+{
+    sim_pending_t pending;
+    sim_frame_t &frame = pending.frame;
+    memcpy(frame.src, active->mac, 6);
+    memcpy(frame.dst, dst, 6);
+    memcpy(frame.data, data, len);
+    frame.len = len;
+    frame.channel = active->channel;
+    frame.sentUs = simNow;
+    frame.lost = randomUnit() < simLink.loss;
+    frame.ackLost = !isGroup(dst) && randomUnit() < simLink.ackLoss;
+
+    uint32_t latency = simLink.latencyUs + random(simLink.jitterUs + 1);
+    if (randomUnit() < simLink.reorder)
+    {
+        latency += simLink.reorderUs;
+    }
+    frame.deliverUs = simNow + (latency > 0 ? latency : 1);
+
+    // Frames of other devices that started within the collision window are destroyed, and so is this one
+    if (simLink.collisionUs > 0)
+    {
+        for (sim_pending_t &other : air)
+        {
+            if (other.sender != active && other.frame.channel == frame.channel && simNow - other.frame.sentUs < simLink.collisionUs)
+            {
+                other.frame.lost = true;
+                frame.lost = true;
+            }
+        }
+    }
+
+    pending.sender = active;
+    pending.order = sendOrder++;
+    active->txFrames++;
+    air.push_back(pending);
+
+    if (sniffer)
+    {
+        sniffer(frame);
+    }
+}
+
+/**
+ * @brief Delivers every frame that is due, in the order of arrival.
+ *
+ * A frame reaches every listening device on its channel with a matching MAC
+ * address. The sender's send callback then runs: a group frame always
+ * succeeds, a unicast frame only if a device received it and the acknowledge
+ * was not lost.
+ */
+void EmcSimRadio::deliver()
+{
+    while (true)
+    {
+        auto due = air.end();
+        for (auto it = air.begin(); it != air.end(); ++it)
+        {
+            if (it->frame.deliverUs <= simNow &&
+                (due == air.end() || it->frame.deliverUs < due->frame.deliverUs ||
+                 (it->frame.deliverUs == due->frame.deliverUs && it->order < due->order)))
+            {
+                due = it;
+            }
+        }
+        if (due == air.end())
+        {
+            return;
+        }
+
+        sim_pending_t pending = *due;
+        air.erase(due);
+        sim_frame_t &frame = pending.frame;
+
+        bool received = false;
+        if (!frame.lost)
+        {
+            for (EmcSimNode *node : nodes)
+            {
+                if (node == pending.sender || !node->wifiOn || !node->espNowInit || node->channel != frame.channel)
+                    continue;
+                if (!isGroup(frame.dst) && memcmp(frame.dst, node->mac, 6) != 0)
+                    continue;
+
+                received = true;
+                node->rxFrames++;
+                if (node->recvCb)
+                {
+                    wifi_pkt_rx_ctrl_t rxCtrl;
+                    memset(&rxCtrl, 0, sizeof(rxCtrl));
+                    rxCtrl.rssi = simLink.rssi;
+                    rxCtrl.noise_floor = -95;
+                    rxCtrl.channel = frame.channel;
+                    rxCtrl.timestamp = (uint32_t)simNow;
+
+                    esp_now_recv_info_t info;
+                    info.src_addr = frame.src;
+                    info.des_addr = frame.dst;
+                    info.rx_ctrl = &rxCtrl;
+
+                    node->enter();
+                    node->recvCb(&info, frame.data, frame.len);
+                }
+            }
+        }
+
+        EmcSimNode *sender = pending.sender;
+        if (sender->espNowInit && sender->sendCb)
+        {
+            bool ok = isGroup(frame.dst) || (received && !frame.ackLost);
+            sender->enter();
+            sender->sendCb(frame.dst, ok ? ESP_NOW_SEND_SUCCESS : ESP_NOW_SEND_FAIL);
+        }
+        active = nullptr;
+    }
+}
+
+/**
+ * @brief Runs every timer that is due, in the order they are due.
+ *
+ * A callback may start or stop timers, also its own one.
+ */
+void EmcSimRadio::fireTimers()
+{
+    while (true)
+    {
+        esp_timer *due = nullptr;
+        for (esp_timer *timer : timers)
+        {
+            if (timer->armed && timer->dueUs <= simNow && (!due || timer->dueUs < due->dueUs))
+            {
+                due = timer;
+            }
+        }
+        if (!due)
+        {
+            break;
+        }
+
+        if (due->periodUs > 0)
+        {
+            due->dueUs += due->periodUs;
+        }
+        else
+        {
+            due->armed = false;
+        }
+        due->owner->enter();
+        due->callback(due->arg);
+    }
+    active = nullptr;
+}
+
+/**
+ * @brief Registers a device.
+ *
+ * @param[in] node The device.
+ */
+void EmcSimRadio::attach(EmcSimNode *node)
+{
+    nodes.push_back(node);
+}
+
+/**
+ * @brief Unregisters a device and drops the frames it sent.
+ *
+ * @param[in] node The device.
+ */
+void EmcSimRadio::detach(EmcSimNode *node)
+{
+    nodes.erase(std::remove(nodes.begin(), nodes.end(), node), nodes.end());
+    timers.erase(std::remove_if(timers.begin(), timers.end(), [node](esp_timer *timer)
+                                {
+                                    if (timer->owner != node)
+                                        return false;
+                                    delete timer;
+                                    return true;
+                                }),
+                 timers.end());
+    air.erase(std::remove_if(air.begin(), air.end(), [node](const sim_pending_t &pending)
+                             { return pending.sender == node; }),
+              air.end());
+    if (active == node)
+    {
+        active = nullptr;
+    }
+}
+
+// ============ Arduino core ============
+
+unsigned long millis()
+{
+    return simNow / 1000;
+}
+
+unsigned long micros()
+{
+    return simNow;
+}
+
+long random(long max)
+{
+    return max > 0 ? EmcSimRadio::random(max) : 0;
+}
+
+long random(long min, long max)
+{
+    return max > min ? min + EmcSimRadio::random(max - min) : min;
+}
+
+int64_t esp_timer_get_time()
+{
+    return simNow;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *handle)
+{
+    if (!active || !args || !args->callback)
+        return ESP_ERR_INVALID_ARG;
+    esp_timer *timer = new esp_timer();
+    timer->callback = args->callback;
+    timer->arg = args->arg;
+    timer->owner = active;
+    timers.push_back(timer);
+    *handle = timer;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeoutUs)
+{
+    if (timer->armed)
+        return ESP_ERR_INVALID_STATE;
+    timer->dueUs = simNow + timeoutUs;
+    timer->periodUs = 0;
+    timer->armed = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t periodUs)
+{
+    if (timer->armed || periodUs == 0)
+        return timer->armed ? ESP_ERR_INVALID_STATE : ESP_ERR_INVALID_ARG;
+    timer->dueUs = simNow + periodUs;
+    timer->periodUs = periodUs;
+    timer->armed = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    if (!timer->armed)
+        return ESP_ERR_INVALID_STATE;
+    timer->armed = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    if (timer->armed)
+        return ESP_ERR_INVALID_STATE;
+    timers.erase(std::remove(timers.begin(), timers.end(), timer), timers.end());
+    delete timer;
+    return ESP_OK;
+}
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause()
+{
+    return ESP_SLEEP_WAKEUP_UNDEFINED;
+}
+
+// ============ FreeRTOS, the simulation has no tasks ============
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stackSize, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core)
+{
+    return pdFAIL;
+}
+
+void vTaskDelete(TaskHandle_t handle) {}
+
+void vTaskDelay(TickType_t ticks)
+{
+    simNow += (int64_t)ticks * portTICK_PERIOD_MS * 1000;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks)
+{
+    return 0;
+}
+
+void xTaskNotifyGive(TaskHandle_t handle) {}
+
+// ============ WiFi ============
+
+bool WiFiClass::mode(wifi_mode_t mode)
+{
+    if (!active)
+        return false;
+    active->wifiOn = mode != WIFI_OFF;
+    return true;
+}
+
+bool WiFiClass::setChannel(uint8_t channel)
+{
+    if (!active || channel < 1 || channel > 14)
+        return false;
+    active->channel = channel;
+    return true;
+}
+
+uint8_t *WiFiClass::macAddress(uint8_t *mac)
+{
+    if (active)
+        memcpy(mac, active->mac, 6);
+    else
+        memset(mac, 0, 6);
+    return mac;
+}
+
+int16_t WiFiClass::scanNetworks(bool async, bool showHidden, bool passive, uint32_t maxMsPerChannel, uint8_t channel)
+{
+    return 0;
+}
+
+int32_t WiFiClass::channel(uint8_t index)
+{
+    return 0;
+}
+
+int32_t WiFiClass::RSSI(uint8_t index)
+{
+    return 0;
+}
+
+void WiFiClass::scanDelete() {}
+
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_connectionless_module_set_wake_interval(uint16_t intervalMs)
+{
+    return ESP_OK;
+}
+
+// ============ ESP-NOW ============
+
+/**
+ * @brief Finds a registered peer of the running device.
+ */
+static std::vector<esp_now_peer_info_t>::iterator findPeer(const uint8_t *peer_addr)
+{
+    return std::find_if(active->peers.begin(), active->peers.end(), [peer_addr](const esp_now_peer_info_t &peer)
+                        { return memcmp(peer.peer_addr, peer_addr, 6) == 0; });
+}
+
+esp_err_t esp_now_init()
+{
+    if (!active || !active->wifiOn)
+        return ESP_FAIL;
+    active->espNowInit = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_deinit()
+{
+    if (!active)
+        return ESP_FAIL;
+    active->espNowInit = false;
+    active->peers.clear();
+    return ESP_OK;
+}
+
+esp_err_t esp_now_register_send_cb(esp_now_send_cb_t cb)
+{
+    if (!active || !active->espNowInit)
+        return ESP_ERR_ESPNOW_NOT_INIT;
+    active->sendCb = cb;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t cb)
+{
+    if (!active || !active->espNowInit)
+        return ESP_ERR_ESPNOW_NOT_INIT;
+    active->recvCb = cb;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_unregister_send_cb()
+{
+    return esp_now_register_send_cb(nullptr);
+}
+
+esp_err_t esp_now_unregister_recv_cb()
+{
+    return esp_now_register_recv_cb(nullptr);
+}
+
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t *peer)
+{
+    if (!active || !active->espNowInit)
+        return ESP_ERR_ESPNOW_NOT_INIT;
+    if (findPeer(peer->peer_addr) != active->peers.end())
+        return ESP_ERR_ESPNOW_EXIST;
+    if (active->peers.size() >= ESP_NOW_MAX_TOTAL_PEER_NUM)
+        return ESP_ERR_ESPNOW_FULL;
+    active->peers.push_back(*peer);
+    return ESP_OK;
+}
+
+esp_err_t esp_now_del_peer(const uint8_t *peer_addr)
+{
+    if (!active || !active->espNowInit)
+        return ESP_ERR_ESPNOW_NOT_INIT;
+    auto it = findPeer(peer_addr);
+    if (it == active->peers.end())
+        return ESP_ERR_ESPNOW_NOT_FOUND;
+    active->peers.erase(it);
+    return ESP_OK;
+}
+
+esp_err_t esp_now_mod_peer(const esp_now_peer_info_t *peer)
+{
+    if (!active || !active->espNowInit)
+        return ESP_ERR_ESPNOW_NOT_INIT;
+    auto it = findPeer(peer->peer_addr);
+    if (it == active->peers.end())
+        return ESP_ERR_ESPNOW_NOT_FOUND;
+    *it = *peer;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_send(const uint8_t *peer_addr, const uint8_t *data, size_t len)
+{
+    if (!active || !active->espNowInit)
+        return ESP_ERR_ESPNOW_NOT_INIT;
+    if (len == 0 || len > ESP_NOW_MAX_DATA_LEN)
+        return ESP_ERR_INVALID_ARG;
+    if (findPeer(peer_addr) == active->peers.end())
+        return ESP_ERR_ESPNOW_NOT_FOUND;
+
+    EmcSimRadio::transmit(peer_addr, data, len);
+    return ESP_OK;
+}
+
+esp_err_t esp_now_set_wake_window(uint16_t windowMs)
+{
+    return ESP_OK;
+}
@@ -0,0 +1,199 @@
+/*
+ * EmcSimRadio.h
+ *
+ *  Created on: 14.10.2026
+ *      Author: daenzell
+ */
+
+#pragma once
+
+/**
+ * @file EmcSimRadio.h
+ * @brief Simulated ESP-NOW radio for running several EmcEspNow devices in one process
+ *
+ * The mock Arduino, WiFi and esp_now headers next to this file route every
+ * call to the simulated device that is currently running. Time is virtual:
+ * millis(), micros() and esp_timer_get_time() return the simulation clock,
+ * which only advances in EmcSimRadio::run(), so results do not depend on the
+ * speed of the host.
+ *
+ * A frame is delivered to every device on the same channel whose MAC matches
+ * the destination, or to all of them for a group address, after the link
+ * latency plus a random jitter. The link drops frames and acknowledges at a
+ * configurable rate and delays single frames, so they overtake each other.
+ * The sender's send callback runs when the frame arrives, or when it would
+ * have arrived, with the outcome of the acknowledge. With a collision window
+ * set, frames of different devices that start at almost the same time destroy
+ * each other, like two radios whose carrier sense picked the same backoff.
+ */
+
+#include <functional>
+#include <vector>
+#include "EmcEspNow.h"
+
+/**
+ * @struct sim_link_t
+ * @brief Behaviour of the simulated radio channel.
+ */
+typedef struct
+{
+    float loss = 0;            ///< Share of frames that never arrive
+    float ackLoss = 0;         ///< Share of delivered unicast frames whose acknowledge is lost
+    uint32_t latencyUs = 300;  ///< Air time and driver latency of a frame
+    uint32_t jitterUs = 100;   ///< Random extra latency, up to this value
+    float reorder = 0;         ///< Share of frames that are delayed by reorderUs
+    uint32_t reorderUs = 2000; ///< Extra latency of a reordered frame
+    int8_t rssi = -50;         ///< RSSI reported to the receiver in dBm
+    uint32_t collisionUs = 0;  ///< Frames of two devices sent less than this apart on one channel are both lost, 0 for none
+} sim_link_t;
+
+/**
+ * @struct sim_frame_t
+ * @brief A frame on the air, as seen by the sniffer.
+ */
+typedef struct
+{
+    uint8_t src[6];                        ///< MAC address of the sender
+    uint8_t dst[6];                        ///< Destination MAC address
+    uint8_t data[ESP_NOW_MAX_DATA_LEN];    ///< Frame as sent
+    uint8_t len;                           ///< Length of data
+    uint8_t channel;                       ///< Channel the frame was sent on
+    int64_t sentUs;                        ///< Simulation time of the send
+    int64_t deliverUs;                     ///< Simulation time of the arrival
+    bool lost;                             ///< The frame does not arrive
+    bool ackLost;                          ///< The frame arrives but the sender sees a failure
+} sim_frame_t;
+
+/**
+ * @class EmcSimNode
+ * @brief One simulated device with its own radio state and EmcEspNow instance.
+ */
+class EmcSimNode
+{
+public:
+    /**
+     * @brief Creates a device and registers it with the radio.
+     * @param mac MAC address of the device.
+     */
+    explicit EmcSimNode(const uint8_t *mac);
+    ~EmcSimNode();
+
+    /**
+     * @brief Runs code in the context of this device.
+     *
+     * All WiFi and esp_now calls made by @p fn act on this device.
+     * @param fn Code to run.
+     */
+    void run(const std::function<void()> &fn);
+
+    /**
+     * @brief Switches to this device, called before any of its code runs.
+     */
+    void enter();
+
+    EmcEspNow espNow;                           ///< The device under test
+    std::function<void()> loop;                 ///< Called on every simulation step before espNow.update()
+
+    uint8_t mac[6];                             ///< MAC address of the device
+    uint8_t channel = 1;                        ///< WiFi channel the radio listens on
+    bool wifiOn = false;                        ///< WiFi is in station mode
+    bool espNowInit = false;                    ///< esp_now_init() was called
+    esp_now_send_cb_t sendCb = nullptr;         ///< Registered send callback
+    esp_now_recv_cb_t recvCb = nullptr;         ///< Registered receive callback
+    std::vector<esp_now_peer_info_t> peers;     ///< Registered ESP-NOW peers
+    uint32_t txFrames = 0;                      ///< Frames sent by the device
+    uint32_t rxFrames = 0;                      ///< Frames delivered to the device
+};
+
+/**
+ * @class EmcSimRadio
+ * @brief Virtual clock and radio channel shared by all simulated devices.
+ */
+class EmcSimRadio
+{
+public:
+    /**
+     * @brief Resets the clock, the frames on the air and the random generator.
+     *
+     * Devices stay registered.
+     * @param seed Seed of the random generator, for repeatable runs.
+     */
+    static void reset(uint32_t seed = 1);
+
+    /**
+     * @brief Sets the behaviour of the radio channel.
+     * @param link Loss, latency and reordering of all frames.
+     */
+    static void setLink(const sim_link_t &link);
+
+    /**
+     * @brief Returns the behaviour of the radio channel.
+     */
+    static sim_link_t &getLink();
+
+    /**
+     * @brief Registers a callback for every frame sent, e.g. to count frames per type.
+     * @param sniffer Callback, nullptr to remove it.
+     */
+    static void setSniffer(std::function<void(const sim_frame_t &)> sniffer);
+
+    /**
+     * @brief Advances the simulation.
+     *
+     * In every step, frames that are due are delivered and every device runs
+     * its loop hook and EmcEspNow::update().
+     * @param durationUs Simulated time to run.
+     * @param stepUs Length of one step, the resolution of the simulation.
+     */
+    static void run(int64_t durationUs, uint32_t stepUs = 100);
+
+    /**
+     * @brief Advances the simulation until a condition holds.
+     * @param condition Checked after every step.
+     * @param timeoutUs Longest simulated time to run.
+     * @param stepUs Length of one step.
+     * @return Simulated time it took, or -1 on timeout.
+     */
+    static int64_t runUntil(const std::function<bool()> &condition, int64_t timeoutUs, uint32_t stepUs = 100);
+
+    /**
+     * @brief Returns the simulation time in microseconds.
+     */
+    static int64_t now();
+
+    /**
+     * @brief Returns a random number from the simulation generator.
+     * @param max Upper bound, exclusive.
+     */
+    static uint32_t random(uint32_t max);
+
+    /**
+     * @brief Returns the device whose code is running.
+     */
+    static EmcSimNode *current();
+
+    /**
+     * @brief Puts a frame on the air, called by esp_now_send().
+     * @param dst Destination MAC address.
+     * @param data Frame.
+     * @param len Length of the frame.
+     */
+    static void transmit(const uint8_t *dst, const uint8_t *data, size_t len);
+
+    /**
+     * @brief Adds or removes a device, called by EmcSimNode.
+     */
+    static void attach(EmcSimNode *node);
+    static void detach(EmcSimNode *node);
+
+private:
+    /**
+     * @brief Delivers every frame that is due.
+     */
+    static void deliver();
+
+    /**
+     * @brief Runs the callbacks of every esp_timer that is due.
+     */
+    static void fireTimers();
+};
@@ -0,0 +1,39 @@
+/*
+ * WiFi.h
+ *
+ *  Created on: 14.10.2026
+ *      Author: daenzell
+ */
+
+#pragma once
+
+/**
+ * @file WiFi.h
+ * @brief Host stand-in for the Arduino WiFi class, backed by the simulated radio
+ *
+ * The channel survey of automatic channel selection finds no access points.
+ */
+
+#include "Arduino.h"
+#include "esp_wifi.h"
+
+typedef enum
+{
+    WIFI_OFF,
+    WIFI_STA
+} wifi_mode_t;
+
+class WiFiClass
+{
+public:
+    bool mode(wifi_mode_t mode);
+    bool setChannel(uint8_t channel);
+    uint8_t *macAddress(uint8_t *mac);
+    int16_t scanNetworks(bool async = false, bool showHidden = false, bool passive = false,
+                         uint32_t maxMsPerChannel = 300, uint8_t channel = 0);
+    int32_t channel(uint8_t index);
+    int32_t RSSI(uint8_t index);
+    void scanDelete();
+};
+
+extern WiFiClass WiFi;
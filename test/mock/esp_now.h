@@ -0,0 +1,62 @@
+/*
+ * esp_now.h
+ *
+ *  Created on: 14.10.2026
+ *      Author: daenzell
+ */
+
+#pragma once
+
+/**
+ * @file esp_now.h
+ * @brief Host stand-in for the ESP-NOW driver, backed by the simulated radio
+ *
+ * Calls act on the simulated device that is running, see EmcSimRadio.h.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_wifi_types.h"
+
+#define ESP_NOW_ETH_ALEN 6
+#define ESP_NOW_MAX_DATA_LEN 250
+#define ESP_NOW_MAX_TOTAL_PEER_NUM 20
+
+typedef enum
+{
+    ESP_NOW_SEND_SUCCESS = 0,
+    ESP_NOW_SEND_FAIL
+} esp_now_send_status_t;
+
+typedef struct
+{
+    uint8_t peer_addr[ESP_NOW_ETH_ALEN]; ///< MAC address of the peer
+    uint8_t lmk[16];                     ///< Local master key, unused
+    uint8_t channel;                     ///< Channel of the peer
+    int ifidx;                           ///< WiFi interface, unused
+    bool encrypt;                        ///< Encryption, unused
+    void *priv;                          ///< Private data, unused
+} esp_now_peer_info_t;
+
+typedef struct
+{
+    uint8_t *src_addr;          ///< MAC address of the sender
+    uint8_t *des_addr;          ///< Destination MAC address of the frame
+    wifi_pkt_rx_ctrl_t *rx_ctrl; ///< Receive metadata
+} esp_now_recv_info_t;
+
+typedef void (*esp_now_send_cb_t)(const uint8_t *mac_addr, esp_now_send_status_t status);
+typedef void (*esp_now_recv_cb_t)(const esp_now_recv_info_t *recv_info, const uint8_t *data, int len);
+
+esp_err_t esp_now_init();
+esp_err_t esp_now_deinit();
+esp_err_t esp_now_register_send_cb(esp_now_send_cb_t cb);
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t cb);
+esp_err_t esp_now_unregister_send_cb();
+esp_err_t esp_now_unregister_recv_cb();
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t *peer);
+esp_err_t esp_now_del_peer(const uint8_t *peer_addr);
+esp_err_t esp_now_mod_peer(const esp_now_peer_info_t *peer);
+esp_err_t esp_now_send(const uint8_t *peer_addr, const uint8_t *data, size_t len);
+esp_err_t esp_now_set_wake_window(uint16_t windowMs);
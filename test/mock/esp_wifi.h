@@ -0,0 +1,20 @@
+/*
+ * esp_wifi.h
+ *
+ *  Created on: 14.10.2026
+ *      Author: daenzell
+ */
+
+#pragma once
+
+/**
+ * @file esp_wifi.h
+ * @brief Host stand-in for the WiFi power save calls, which have no effect
+ */
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_wifi_types.h"
+
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type);
+esp_err_t esp_wifi_connectionless_module_set_wake_interval(uint16_t intervalMs);
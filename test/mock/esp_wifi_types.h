@@ -0,0 +1,31 @@
+/*
+ * esp_wifi_types.h
+ *
+ *  Created on: 14.10.2026
+ *      Author: daenzell
+ */
+
+#pragma once
+
+/**
+ * @file esp_wifi_types.h
+ * @brief Host stand-in for the WiFi types used by EmcEspNow
+ */
+
+#include <stdint.h>
+
+typedef struct
+{
+    signed rssi : 8;        ///< RSSI of the frame in dBm
+    unsigned rate : 5;      ///< PHY rate
+    unsigned channel : 4;   ///< Channel the frame was received on
+    signed noise_floor : 8; ///< Noise floor in dBm
+    uint32_t timestamp;     ///< Receive time in microseconds
+} wifi_pkt_rx_ctrl_t;
+
+typedef enum
+{
+    WIFI_PS_NONE,
+    WIFI_PS_MIN_MODEM,
+    WIFI_PS_MAX_MODEM
+} wifi_ps_type_t;
@@ -0,0 +1,765 @@
+/*
+ * test_espnow_sim.cpp
+ *
+ *  Created on: 14.10.2026
+ *      Author: daenzell
+ */
+
+/**
+ * @file test_espnow_sim.cpp
+ * @brief Protocol benchmarks of a master and a slave EmcEspNow on the simulated radio
+ *
+ * Every benchmark prints its numbers as "[bench]" lines and checks them
+ * against generous bounds, so a protocol change that makes discovery,
+ * latency, airtime or recovery clearly worse fails the run. Times are in
+ * simulated microseconds with a resolution of one simulation step.
+ *
+ * Run with: pio test -e native -v
+ */
+
+#include <unity.h>
+#include <algorithm>
+#include <memory>
+#include "EmcSimRadio.h"
+
+static const uint8_t MASTER_MAC[6] = {0x24, 0x6F, 0x28, 0x00, 0x00, 0x01};
+static const uint8_t SLAVE_MAC[6] = {0x24, 0x6F, 0x28, 0x00, 0x00, 0x02};
+
+static const uint32_t STEP_US = 50;       ///< Simulation step, the resolution of all times
+static const uint8_t MASTER_SLAVE_ID = 1; ///< Peer ID of the only slave on the master
+
+/**
+ * @struct bench_pair_t
+ * @brief A master and a slave, plus what the master received.
+ */
+struct bench_pair_t
+{
+    EmcSimNode master{MASTER_MAC};
+    EmcSimNode slave{SLAVE_MAC};
+    uint8_t received = 0;      ///< button_data[0] of the last slave data on the master
+    int64_t receivedUs = 0;    ///< Simulation time it arrived
+    uint32_t dataFrames = 0;   ///< FRAME_SLAVE_DATA and FRAME_SLAVE_DELTA frames sent by the slave
+    uint32_t presses = 0;      ///< Press edges of bit 0 reported by the master's edge handler
+    uint32_t releases = 0;     ///< Release edges of bit 0 reported by the master's edge handler
+};
+
+static std::unique_ptr<bench_pair_t> pair;
+
+/**
+ * @brief Starts master and slave, with the slave in compact uplink mode like the firmware.
+ * @param redundant true to put the slave into redundant edge mode.
+ */
+static void beginPair(bool redundant = false)
+{
+    pair.reset(new bench_pair_t());
+    bench_pair_t *p = pair.get();
+
+    p->master.run([p]()
+                  {
+                      p->master.espNow.onSlaveData([p](uint8_t peerID, const slave_data_t &data)
+                                                   {
+                                                       p->received = data.button_data[0];
+                                                       p->receivedUs = EmcSimRadio::now();
+                                                   });
+                      p->master.espNow.onEdge([p](uint8_t peerID, const edge_event_t &edge)
+                                              {
+                                                  if (edge.bit == 0)
+                                                      (edge.pressed ? p->presses : p->releases)++;
+                                              });
+                      p->master.espNow.begin(true);
+                  });
+    p->slave.run([p, redundant]()
+                 {
+                     p->slave.espNow.begin(false);
+                     p->slave.espNow.setCompactUplink(true);
+                     p->slave.espNow.setRedundantEdges(redundant);
+                 });
+
+    EmcSimRadio::setSniffer([p](const sim_frame_t &frame)
+                            {
+                                uint8_t type = frame.data[0];
+                                if (memcmp(frame.src, SLAVE_MAC, 6) == 0 && (type == FRAME_SLAVE_DATA || type == FRAME_SLAVE_DELTA))
+                                    p->dataFrames++;
+                            });
+}
+
+/**
+ * @brief Checks that master and slave see a connected link to each other.
+ */
+static bool isConnected()
+{
+    return pair->slave.espNow.getLinkState(1) == LINK_CONNECTED &&
+           pair->master.espNow.getLinkState(MASTER_SLAVE_ID) == LINK_CONNECTED;
+}
+
+/**
+ * @brief Sets the first button byte on the slave.
+ */
+static void press(uint8_t value)
+{
+    pair->slave.run([value]()
+                    { pair->slave.espNow.slaveSendData.button_data[0] = value; });
+}
+
+/**
+ * @brief Changes the first button byte on the slave and waits until the master has it.
+ * @return Latency in microseconds, -1 if the change did not arrive within @p timeoutUs.
+ */
+static int64_t measureChange(uint8_t value, int64_t timeoutUs = 100000)
+{
+    press(value);
+    return EmcSimRadio::runUntil([value]()
+                                 { return pair->received == value; },
+                                 timeoutUs, STEP_US);
+}
+
+/**
+ * @brief Returns the value below which @p percent of the samples fall.
+ */
+static int64_t percentile(std::vector<int64_t> samples, uint8_t percent)
+{
+    std::sort(samples.begin(), samples.end());
+    size_t rank = (samples.size() * percent + 99) / 100;
+    return samples[rank > 0 ? rank - 1 : 0];
+}
+
+/**
+ * @brief Runs a series of button changes and reports the latency distribution.
+ * @param loss Share of frames lost on the air.
+ * @param count Number of changes.
+ * @param redundant true to run the slave in redundant edge mode.
+ * @return 99th percentile of the latency in microseconds, -1 if a change did not arrive.
+ */
+static int64_t benchLatency(float loss, uint16_t count, bool redundant = false)
+{
+    beginPair(redundant);
+    if (EmcSimRadio::runUntil(isConnected, 2000000, STEP_US) < 0)
+        return -1;
+    EmcSimRadio::getLink().loss = loss;
+
+    std::vector<int64_t> latencies;
+    for (uint16_t i = 0; i < count; i++)
+    {
+        int64_t latency = measureChange(i % 255 + 1); // Every change differs from the one before
+        if (latency < 0)
+            return -1;
+        latencies.push_back(latency);
+        EmcSimRadio::run(10000 + EmcSimRadio::random(10000), STEP_US); // Next change 10-20 ms later
+    }
+
+    printf("[bench] latency loss=%.0f%%%s: p50 %lld us | p99 %lld us | max %lld us\n", loss * 100, redundant ? " redundant" : "",
+           (long long)percentile(latencies, 50), (long long)percentile(latencies, 99),
+           (long long)*std::max_element(latencies.begin(), latencies.end()));
+    return percentile(latencies, 99);
+}
+
+/**
+ * @struct bench_cockpit_t
+ * @brief A master with several slaves, like the boxes of one cockpit.
+ */
+struct bench_cockpit_t
+{
+    static const uint8_t SLAVES = 5;
+    EmcSimNode master{MASTER_MAC};
+    std::unique_ptr<EmcSimNode> slaves[SLAVES];
+    uint8_t received[ESPNOW_MAX_PEERS] = {0}; ///< button_data[0] of the last data per master peer ID
+};
+
+static std::unique_ptr<bench_cockpit_t> cockpit;
+
+/**
+ * @brief Checks that every slave of the cockpit is connected both ways.
+ */
+static bool cockpitConnected()
+{
+    for (auto &slave : cockpit->slaves)
+    {
+        int peerID = cockpit->master.espNow.peers.find(slave->mac);
+        if (peerID <= 0 || slave->espNow.getLinkState(1) != LINK_CONNECTED ||
+            cockpit->master.espNow.getLinkState(peerID) != LINK_CONNECTED)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Runs rounds in which every slave of a cockpit changes within 1 ms, on a channel where frames collide.
+ * @param scheduled true to let the master assign transmit slots.
+ * @param rounds Number of rounds.
+ * @param[out] failed Uplink frames that were not acknowledged during the rounds.
+ * @param[out] missed Changes that did not arrive within 100 ms, they count with 100 ms.
+ * @return Largest latency of a change in microseconds, -1 if the cockpit did not connect.
+ */
+static int64_t benchCockpit(bool scheduled, uint16_t rounds, uint32_t &failed, uint32_t &missed)
+{
+    cockpit.reset(new bench_cockpit_t());
+    bench_cockpit_t *c = cockpit.get();
+
+    c->master.run([c, scheduled]()
+                  {
+                      c->master.espNow.onSlaveData([c](uint8_t peerID, const slave_data_t &data)
+                                                   { c->received[peerID] = data.button_data[0]; });
+                      c->master.espNow.begin(true);
+                      c->master.espNow.setScheduled(scheduled);
+                  });
+    for (uint8_t i = 0; i < bench_cockpit_t::SLAVES; i++)
+    {
+        uint8_t mac[6] = {0x24, 0x6F, 0x28, 0x00, 0x01, i};
+        c->slaves[i].reset(new EmcSimNode(mac));
+        EmcSimNode *slave = c->slaves[i].get();
+        slave->run([slave]()
+                   {
+                       slave->espNow.begin(false);
+                       slave->espNow.setCompactUplink(true);
+                   });
+    }
+
+    if (EmcSimRadio::runUntil(cockpitConnected, 5000000, STEP_US) < 0)
+        return -1;
+    EmcSimRadio::run(100000, STEP_US); // Every slave is in the slot table of the latest sync
+    EmcSimRadio::getLink().collisionUs = 150;
+
+    auto txFail = [c]()
+    {
+        uint32_t sum = 0;
+        for (auto &slave : c->slaves)
+            sum += slave->espNow.getPeerStats(1) ? slave->espNow.getPeerStats(1)->txFail : 0;
+        return sum;
+    };
+    uint32_t failedBase = txFail();
+    missed = 0;
+
+    std::vector<int64_t> latencies;
+    for (uint16_t round = 0; round < rounds; round++)
+    {
+        uint8_t value = round % 255 + 1;
+        int64_t changedUs[bench_cockpit_t::SLAVES];
+        int64_t arrivedUs[bench_cockpit_t::SLAVES];
+        uint32_t offsetUs[bench_cockpit_t::SLAVES];
+        for (uint8_t i = 0; i < bench_cockpit_t::SLAVES; i++)
+        {
+            offsetUs[i] = EmcSimRadio::random(1000);
+            changedUs[i] = -1;
+            arrivedUs[i] = -1;
+        }
+
+        int64_t startUs = EmcSimRadio::now();
+        EmcSimRadio::runUntil([&]()
+                              {
+                                  bool done = true;
+                                  for (uint8_t i = 0; i < bench_cockpit_t::SLAVES; i++)
+                                  {
+                                      EmcSimNode *slave = c->slaves[i].get();
+                                      if (changedUs[i] < 0 && EmcSimRadio::now() - startUs >= offsetUs[i])
+                                      {
+                                          slave->run([slave, value]()
+                                                     { slave->espNow.slaveSendData.button_data[0] = value; });
+                                          changedUs[i] = EmcSimRadio::now();
+                                      }
+                                      int peerID = c->master.espNow.peers.find(slave->mac);
+                                      if (changedUs[i] >= 0 && arrivedUs[i] < 0 && peerID > 0 && c->received[peerID] == value)
+                                          arrivedUs[i] = EmcSimRadio::now();
+                                      done = done && arrivedUs[i] >= 0;
+                                  }
+                                  return done;
+                              },
+                              100000, STEP_US);
+
+        for (uint8_t i = 0; i < bench_cockpit_t::SLAVES; i++)
+        {
+            if (arrivedUs[i] < 0)
+                missed++;
+            latencies.push_back(arrivedUs[i] >= 0 ? arrivedUs[i] - changedUs[i] : 100000);
+        }
+        EmcSimRadio::run(20000 + EmcSimRadio::random(10000), STEP_US); // Next round 20-30 ms later
+    }
+    failed = txFail() - failedBase;
+
+    printf("[bench] cockpit %u slaves %s: p50 %lld us | p99 %lld us | max %lld us | failed frames %u | missed %u\n",
+           bench_cockpit_t::SLAVES, scheduled ? "scheduled" : "free-running", (long long)percentile(latencies, 50),
+           (long long)percentile(latencies, 99), (long long)*std::max_element(latencies.begin(), latencies.end()),
+           (unsigned)failed, (unsigned)missed);
+    return *std::max_element(latencies.begin(), latencies.end());
+}
+
+void setUp()
+{
+    EmcSimRadio::reset(12345);
+}
+
+void tearDown()
+{
+    pair.reset();
+    cockpit.reset();
+}
+
+/**
+ * @brief Time from both devices starting until master and slave are connected.
+ */
+void test_discovery_time()
+{
+    std::vector<int64_t> times;
+    for (uint32_t seed = 1; seed <= 20; seed++)
+    {
+        EmcSimRadio::reset(seed);
+        EmcSimRadio::getLink().loss = 0.1f;
+        beginPair();
+        int64_t time = EmcSimRadio::runUntil(isConnected, 5000000, STEP_US);
+        TEST_ASSERT_TRUE_MESSAGE(time >= 0, "No connection within 5 s");
+        times.push_back(time);
+    }
+
+    printf("[bench] discovery loss=10%%: p50 %lld us | max %lld us\n",
+           (long long)percentile(times, 50), (long long)*std::max_element(times.begin(), times.end()));
+    TEST_ASSERT_LESS_THAN(1000000, percentile(times, 50));
+}
+
+/**
+ * @brief Time from a button change on the slave until the master has it, on a clean channel.
+ */
+void test_button_latency()
+{
+    int64_t p99 = benchLatency(0, 200);
+    TEST_ASSERT_TRUE_MESSAGE(p99 >= 0, "Button change never reached the master");
+    TEST_ASSERT_LESS_THAN(2000, p99);
+}
+
+/**
+ * @brief Button latency with 10 % and 30 % loss, lost frames are repaired by retries.
+ */
+void test_button_latency_lossy()
+{
+    int64_t p99 = benchLatency(0.1f, 200);
+    TEST_ASSERT_TRUE_MESSAGE(p99 >= 0, "Button change never reached the master");
+    TEST_ASSERT_LESS_THAN(20000, p99);
+
+    p99 = benchLatency(0.3f, 200);
+    TEST_ASSERT_TRUE_MESSAGE(p99 >= 0, "Button change never reached the master");
+    TEST_ASSERT_LESS_THAN(50000, p99);
+}
+
+/**
+ * @brief Uplink data frames per button change, with keyframes, retries and 10 % loss.
+ */
+void test_frames_per_change()
+{
+    beginPair();
+    TEST_ASSERT_TRUE(EmcSimRadio::runUntil(isConnected, 2000000, STEP_US) >= 0);
+    EmcSimRadio::getLink().loss = 0.1f;
+
+    const uint16_t changes = 200;
+    pair->dataFrames = 0;
+    uint32_t slaveTx = pair->slave.txFrames;
+    for (uint16_t i = 0; i < changes; i++)
+    {
+        press(i & 1 ? 0x00 : 0x01);
+        EmcSimRadio::run(20000, STEP_US); // One change every 20 ms
+    }
+    uint32_t allFrames = pair->slave.txFrames - slaveTx;
+
+    float dataPerChange = (float)pair->dataFrames / changes;
+    printf("[bench] frames per change loss=10%%: data %.2f | all %.2f\n", dataPerChange, (float)allFrames / changes);
+    TEST_ASSERT_TRUE(dataPerChange < 2.0f);
+}
+
+/**
+ * @brief Time until a change made during an outage arrives once the channel is back.
+ */
+void test_recovery_time()
+{
+    const uint32_t outagesMs[] = {50, 250, 600, 1500, 3000}; // Retry, degraded and lost regimes
+    for (uint32_t outageMs : outagesMs)
+    {
+        EmcSimRadio::reset(outageMs);
+        beginPair();
+        TEST_ASSERT_TRUE(EmcSimRadio::runUntil(isConnected, 2000000, STEP_US) >= 0);
+
+        EmcSimRadio::getLink().loss = 1.0f;
+        press(0x55);
+        EmcSimRadio::run(outageMs * 1000, STEP_US);
+        EmcSimRadio::getLink().loss = 0;
+
+        // Both times count from the end of the outage
+        int64_t restoredUs = EmcSimRadio::now();
+        int64_t dataUs = -1;
+        int64_t linkUs = -1;
+        EmcSimRadio::runUntil([&]()
+                              {
+                                  if (dataUs < 0 && pair->received == 0x55)
+                                      dataUs = EmcSimRadio::now() - restoredUs;
+                                  if (linkUs < 0 && isConnected())
+                                      linkUs = EmcSimRadio::now() - restoredUs;
+                                  return dataUs >= 0 && linkUs >= 0;
+                              },
+                              10000000, STEP_US);
+        TEST_ASSERT_TRUE_MESSAGE(dataUs >= 0, "Change made during the outage was never delivered");
+        TEST_ASSERT_TRUE_MESSAGE(linkUs >= 0, "Link did not recover");
+
+        printf("[bench] recovery after %u ms outage: data %lld us | link %lld us\n",
+               (unsigned)outageMs, (long long)dataUs, (long long)linkUs);
+        TEST_ASSERT_LESS_THAN(ESPNOW_DISCOVERY_MAX_MS * 2000LL, dataUs);
+    }
+}
+
+/**
+ * @brief A short outage costs resends, but neither side drops the other.
+ *
+ * Runs at the simulation step and at a 1 ms update cadence, as a loop()
+ * without the task would. Only the peer timeout may remove a peer.
+ */
+void test_short_outage()
+{
+    const uint32_t stepsUs[] = {STEP_US, 1000};
+    const uint32_t outagesMs[] = {50, 100};
+    for (uint32_t stepUs : stepsUs)
+    {
+        for (uint32_t outageMs : outagesMs)
+        {
+            EmcSimRadio::reset(outageMs + stepUs);
+            beginPair();
+            TEST_ASSERT_TRUE(EmcSimRadio::runUntil(isConnected, 2000000, STEP_US) >= 0);
+
+            EmcSimRadio::getLink().loss = 1.0f;
+            press(0x55);
+            int64_t evictedUs = EmcSimRadio::runUntil([]()
+                                                      { return !pair->slave.espNow.peers.get(1) ||
+                                                               !pair->master.espNow.peers.get(MASTER_SLAVE_ID); },
+                                                      outageMs * 1000, stepUs);
+            EmcSimRadio::getLink().loss = 0;
+            TEST_ASSERT_TRUE_MESSAGE(evictedUs < 0, "Peer removed during a short outage");
+
+            int64_t dataUs = EmcSimRadio::runUntil([]()
+                                                   { return pair->received == 0x55; },
+                                                   1000000, stepUs);
+            const peer_stats_t *stats = pair->slave.espNow.getPeerStats(1);
+            printf("[bench] outage %u ms step %u us: data %lld us after it | failed frames %u | retries %u\n",
+                   (unsigned)outageMs, (unsigned)stepUs, (long long)dataUs, (unsigned)(stats ? stats->txFail : 0),
+                   (unsigned)(stats ? stats->txRetries : 0));
+            TEST_ASSERT_TRUE_MESSAGE(dataUs >= 0, "Change made during the outage was never delivered");
+            TEST_ASSERT_TRUE(isConnected());
+        }
+    }
+}
+
+/**
+ * @brief Runs short taps of button 0 on a lossy channel.
+ * @param redundant true to run the slave in redundant edge mode.
+ * @param taps Number of taps, each pressed for 1 ms.
+ * @return Taps whose press and release the master reported as edges.
+ */
+static uint32_t benchTaps(bool redundant, uint16_t taps)
+{
+    beginPair(redundant);
+    if (EmcSimRadio::runUntil(isConnected, 2000000, STEP_US) < 0)
+        return 0;
+    EmcSimRadio::getLink().loss = 0.3f;
+
+    // A tap counts as seen on the state if the master's data ever showed it pressed
+    uint32_t seenOnState = 0;
+    for (uint16_t i = 0; i < taps; i++)
+    {
+        bool seen = false;
+        press(0x01);
+        EmcSimRadio::runUntil([&seen]()
+                              { seen = seen || pair->received == 0x01; return false; },
+                              1000, STEP_US);
+        press(0x00);
+        EmcSimRadio::runUntil([&seen]()
+                              { seen = seen || pair->received == 0x01; return false; },
+                              20000 + EmcSimRadio::random(10000), STEP_US); // Next tap 20-30 ms later
+        seenOnState += seen;
+    }
+    EmcSimRadio::getLink().loss = 0;
+    EmcSimRadio::run(500000, STEP_US); // Let the keyframes and edges of the last taps arrive
+
+    uint32_t seenAsEdges = std::min(pair->presses, pair->releases);
+    const peer_stats_t *slaveStats = pair->slave.espNow.getPeerStats(1);
+    printf("[bench] taps loss=30%%%s: seen on state %u/%u | edges %u/%u | copies %u | retries %u\n",
+           redundant ? " redundant" : "", (unsigned)seenOnState, (unsigned)taps, (unsigned)seenAsEdges, (unsigned)taps,
+           (unsigned)(slaveStats ? slaveStats->txCopies : 0), (unsigned)(slaveStats ? slaveStats->txRetries : 0));
+    return seenAsEdges;
+}
+
+/**
+ * @brief Latency of five slaves that change at once, with and without transmit slots.
+ *
+ * Free-running slaves collide, and their resends after the same backoff
+ * collide again; the simulation has no carrier sense, so their numbers are
+ * a worst case. Scheduled slaves each send in their own slot, so nothing
+ * collides and every change arrives within one cycle plus the start window.
+ */
+void test_scheduled_latency()
+{
+    uint32_t failed = 0;
+    uint32_t missed = 0;
+    TEST_ASSERT_TRUE_MESSAGE(benchCockpit(false, 100, failed, missed) >= 0, "Free-running cockpit did not connect");
+
+    EmcSimRadio::reset(12345);
+    int64_t scheduledMax = benchCockpit(true, 100, failed, missed);
+    TEST_ASSERT_TRUE_MESSAGE(scheduledMax >= 0, "Scheduled cockpit did not connect");
+
+    const int64_t cycleUs = (bench_cockpit_t::SLAVES + 1) * ESPNOW_TDMA_SLOT_US;
+    TEST_ASSERT_EQUAL_UINT32(0, missed);
+    TEST_ASSERT_EQUAL_UINT32(0, failed);
+    TEST_ASSERT_LESS_THAN(cycleUs + ESPNOW_TDMA_SLOT_US, scheduledMax);
+}
+
+/**
+ * @brief Button latency and short taps with 30 % loss, with redundant copies and edges.
+ *
+ * Copies go out without waiting for the send status, so a lost frame costs
+ * the copy spacing instead of a retry backoff. Every tap is reported as a
+ * press and a release edge, also when both of its frames were lost.
+ */
+void test_redundant_edges()
+{
+    int64_t p99 = benchLatency(0.3f, 200, true);
+    TEST_ASSERT_TRUE_MESSAGE(p99 >= 0, "Button change never reached the master");
+    TEST_ASSERT_LESS_THAN(5000, p99);
+
+    const uint16_t taps = 200;
+    benchTaps(false, taps);
+    EmcSimRadio::reset(12345);
+    TEST_ASSERT_EQUAL_UINT32(taps, benchTaps(true, taps));
+}
+
+/**
+ * @brief A queued command arrives once, while the current command keeps being repeated.
+ *
+ * The master repeats its current command as a keep-alive. The slave must
+ * report it as changed once and must not queue the repeats as commands. The
+ * zeroed slots of begin() are no change either.
+ */
+void test_command_keepalive()
+{
+    EmcSimRadio::reset(12345);
+    beginPair();
+    master_cmd_t cmd;
+    slave_data_t data;
+    TEST_ASSERT_FALSE(pair->slave.espNow.tryGetLatest(cmd));
+    TEST_ASSERT_FALSE(pair->master.espNow.tryGetLatest(data));
+    TEST_ASSERT_TRUE(EmcSimRadio::runUntil(isConnected, 2000000, STEP_US) >= 0);
+
+    pair->master.run([]()
+                     {
+                         pair->master.espNow.masterCmdData.valueInt = 7;
+                         master_cmd_t cmd = {};
+                         cmd.valueInt = 3;
+                         pair->master.espNow.queueCommand(cmd);
+                     });
+
+    // Several keep-alive intervals, so the current command is repeated a few times
+    uint32_t popped = 0;
+    uint32_t changes = 0;
+    EmcSimRadio::runUntil([&popped, &changes]()
+                          {
+                              master_cmd_t cmd;
+                              while (pair->slave.espNow.popCommand(cmd))
+                                  popped += cmd.valueInt == 3 ? 1 : 100; // Anything else is a repeat that was queued
+                              if (pair->slave.espNow.tryGetLatest(cmd))
+                                  changes += cmd.valueInt == 7 ? 1 : 100; // Anything else was never sent
+                              return false;
+                          },
+                          5 * ESPNOW_CMD_KEEPALIVE_MS * 1000, STEP_US);
+    TEST_ASSERT_EQUAL_UINT32(1, popped);
+    TEST_ASSERT_EQUAL_UINT32(1, changes);
+}
+
+/**
+ * @brief Queued commands under 30 % loss arrive exactly once and in order.
+ *
+ * A batch that was not acknowledged goes out again with the next one, and the
+ * slave drops the commands of a batch whose acknowledge was lost.
+ */
+void test_command_delivery_lossy()
+{
+    EmcSimRadio::reset(12345);
+    beginPair();
+    TEST_ASSERT_TRUE(EmcSimRadio::runUntil(isConnected, 2000000, STEP_US) >= 0);
+    EmcSimRadio::getLink().loss = 0.3f;
+
+    // One command every 2 ms, a full queue is tried again on the next step
+    const int32_t commands = 500;
+    int32_t queued = 0;
+    int32_t next = 0;
+    uint32_t wrong = 0;
+    EmcSimRadio::runUntil([&]()
+                          {
+                              if (queued < commands && EmcSimRadio::now() % 2000 < STEP_US)
+                              {
+                                  pair->master.run([&queued]()
+                                                   {
+                                                       master_cmd_t cmd;
+                                                       cmd.valueInt = queued;
+                                                       queued += pair->master.espNow.queueCommand(cmd);
+                                                   });
+                              }
+                              master_cmd_t cmd;
+                              while (pair->slave.espNow.popCommand(cmd))
+                              {
+                                  wrong += cmd.valueInt != next; // Lost, repeated or out of order
+                                  next = cmd.valueInt + 1;
+                              }
+                              return next == commands;
+                          },
+                          10000000, STEP_US);
+
+    const peer_stats_t *stats = pair->master.espNow.getPeerStats(MASTER_SLAVE_ID);
+    printf("[bench] commands loss=30%%: %d/%d queued, %d delivered in order | wrong %u | master retries %u\n",
+           (int)queued, (int)commands, (int)next, (unsigned)wrong, (unsigned)(stats ? stats->txRetries : 0));
+    TEST_ASSERT_EQUAL_UINT32(commands, queued);
+    TEST_ASSERT_EQUAL_UINT32(commands, next);
+    TEST_ASSERT_EQUAL_UINT32(0, wrong);
+}
+
+/**
+ * @brief Commands queued in a tight loop are batched at the per-slave frame limit.
+ *
+ * The master queues a command on every step and never sends more than
+ * ESPNOW_CMD_MAX_RATE command frames per second to the slave.
+ */
+void test_command_rate_limit()
+{
+    EmcSimRadio::reset(12345);
+    beginPair();
+    TEST_ASSERT_TRUE(EmcSimRadio::runUntil(isConnected, 2000000, STEP_US) >= 0);
+
+    uint32_t cmdFrames = 0;
+    EmcSimRadio::setSniffer([&cmdFrames](const sim_frame_t &frame)
+                            {
+                                if (memcmp(frame.src, MASTER_MAC, 6) == 0 && frame.data[0] == FRAME_MASTER_CMD)
+                                    cmdFrames++;
+                            });
+
+    int32_t queued = 0;
+    int32_t popped = 0;
+    EmcSimRadio::runUntil([&]()
+                          {
+                              pair->master.run([&queued]()
+                                               {
+                                                   master_cmd_t cmd;
+                                                   cmd.valueInt = queued;
+                                                   queued += pair->master.espNow.queueCommand(cmd);
+                                               });
+                              master_cmd_t cmd;
+                              while (pair->slave.espNow.popCommand(cmd))
+                                  popped++;
+                              return false;
+                          },
+                          1000000, STEP_US);
+    EmcSimRadio::setSniffer(nullptr);
+
+    printf("[bench] command flood: %d queued, %d delivered in %u frames\n", (int)queued, (int)popped, (unsigned)cmdFrames);
+    TEST_ASSERT_TRUE(popped >= queued - 2 * ESPNOW_CMD_QUEUE_SIZE); // The rest is still on its way
+    TEST_ASSERT_LESS_THAN(ESPNOW_CMD_MAX_RATE + 2, cmdFrames);
+}
+
+/**
+ * @brief An edge with a bit beyond slave_data_t::button_data is not passed to the edge handler.
+ *
+ * A slave never sends one, so the frame is built by hand. The valid edge in
+ * the same block still arrives.
+ */
+void test_edge_bit_range()
+{
+    EmcSimRadio::reset(12345);
+    beginPair();
+    TEST_ASSERT_TRUE(EmcSimRadio::runUntil(isConnected, 2000000, STEP_US) >= 0);
+
+    uint32_t outOfRange = 0;
+    uint32_t valid = 0;
+    pair->master.run([&outOfRange, &valid]()
+                     {
+                         pair->master.espNow.onEdge([&outOfRange, &valid](uint8_t peerID, const edge_event_t &edge)
+                                                    { (edge.bit < ESPNOW_EDGE_BITS ? valid : outOfRange)++; });
+                     });
+
+    uint8_t frame[sizeof(frame_header_t) + sizeof(slave_data_t) + sizeof(slave_edges_t) + 2 * sizeof(edge_event_t)] = {0};
+    frame_header_t *header = (frame_header_t *)frame;
+    header->type = FRAME_SLAVE_DATA;
+    header->version = ESPNOW_PROTOCOL_VERSION;
+    header->seq = pair->master.espNow.getPeerStats(MASTER_SLAVE_ID)->lastSeq + 100;
+    slave_edges_t *edges = (slave_edges_t *)(frame + sizeof(frame_header_t) + sizeof(slave_data_t));
+    edges->firstEdge = 0;
+    edges->count = 2;
+    edge_event_t *events = (edge_event_t *)(edges + 1);
+    events[0].bit = 200;
+    events[0].pressed = true;
+    events[1].bit = 0;
+    events[1].pressed = true;
+    pair->slave.run([&frame]()
+                    { esp_now_send(MASTER_MAC, frame, sizeof(frame)); });
+    EmcSimRadio::run(10000, STEP_US);
+
+    TEST_ASSERT_EQUAL_UINT32(0, outOfRange);
+    TEST_ASSERT_EQUAL_UINT32(1, valid);
+}
+
+/**
+ * @brief Sends a hand-built frame without payload from a device that was not discovered.
+ */
+static void sendRaw(EmcSimNode &node, FrameType type, uint16_t seq)
+{
+    node.run([&node, type, seq]()
+             {
+                 frame_header_t header = {};
+                 header.type = type;
+                 header.version = ESPNOW_PROTOCOL_VERSION;
+                 header.seq = seq;
+                 esp_now_send(MASTER_MAC, (const uint8_t *)&header, sizeof(header));
+             });
+    EmcSimRadio::run(5000, STEP_US);
+}
+
+/**
+ * @brief A master only adds an unknown sender for slave uplink frames.
+ *
+ * Frames of a neighbouring master on the same channel leave the peer table
+ * alone, a heartbeat of a slave restored from deep sleep still adds it.
+ */
+void test_foreign_master_ignored()
+{
+    static const uint8_t OTHER_MAC[6] = {0x24, 0x6F, 0x28, 0x00, 0x00, 0x03};
+    EmcSimRadio::reset(12345);
+    beginPair();
+    TEST_ASSERT_TRUE(EmcSimRadio::runUntil(isConnected, 2000000, STEP_US) >= 0);
+
+    EmcSimNode other(OTHER_MAC);
+    other.wifiOn = true;
+    other.espNowInit = true;
+    other.channel = pair->master.channel;
+    other.run([]()
+              {
+                  esp_now_peer_info_t peer = {};
+                  memcpy(peer.peer_addr, MASTER_MAC, 6);
+                  esp_now_add_peer(&peer);
+              });
+
+    uint8_t known = pair->master.espNow.peers.size();
+    sendRaw(other, FRAME_MASTER_CMD, 1);
+    sendRaw(other, FRAME_CHANNEL, 2);
+    sendRaw(other, FRAME_SYNC, 3);
+    TEST_ASSERT_EQUAL_UINT32(known, pair->master.espNow.peers.size());
+
+    sendRaw(other, FRAME_HEARTBEAT, 4);
+    TEST_ASSERT_EQUAL_UINT32(known + 1, pair->master.espNow.peers.size());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_discovery_time);
+    RUN_TEST(test_button_latency);
+    RUN_TEST(test_button_latency_lossy);
+    RUN_TEST(test_frames_per_change);
+    RUN_TEST(test_recovery_time);
+    RUN_TEST(test_short_outage);
+    RUN_TEST(test_scheduled_latency);
+    RUN_TEST(test_redundant_edges);
+    RUN_TEST(test_command_keepalive);
+    RUN_TEST(test_command_delivery_lossy);
+    RUN_TEST(test_command_rate_limit);
+    RUN_TEST(test_edge_bit_range);
+    RUN_TEST(test_foreign_master_ignored);
+    return UNITY_END();
+}